@@ -0,0 +1,182 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#define _GNU_SOURCE //For CPU_SET and pthread_setaffinity_np()
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "affinity.h"
+
+static unsigned int cpus[CPU_SETSIZE];  //CPUs used by the threads, in order
+static unsigned int cpus_l = 0;         //0 if the threads are not pinned
+static unsigned int cpu_node[CPU_SETSIZE];//Node of every CPU, numbered from 0 in the order they are found
+static unsigned int nodes = 1;
+
+/**
+ * Returns the NUMA node of the CPU, as written in sysfs, or 0 if
+ * the system has no NUMA information.
+ * */
+static int affinity_sys_node(unsigned int cpu) {
+    char path[PATH_LEN];
+    int node = 0;
+
+    snprintf(path, PATH_LEN, "/sys/devices/system/cpu/cpu%u", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/**
+ * Parses a list like 0-3,8,10-11 into set.
+ * Returns false if it is not valid.
+ * */
+static bool affinity_parse(char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*list) {
+        char *end;
+        unsigned long int first = strtoul(list, &end, 10);
+        unsigned long int last = first;
+        if (end == list)
+            return false;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtoul(list, &end, 10);
+            if (end == list)
+                return false;
+        }
+        if (first > last || last >= CPU_SETSIZE)
+            return false;
+        for (unsigned long int cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return false;
+        list = end;
+    }
+    return true;
+}
+
+/**
+ * Pins the threads to the CPUs in list, one each in round-robin.
+ * The list is in the form 0-3,8,10-11, or "all" for all the CPUs
+ * the process is allowed to use.
+ * Returns false if the list is not valid or none of its CPUs can be used.
+ * */
+bool affinity_init(char *list) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t allowed, requested;
+    int sys_node[CPU_SETSIZE];  //Node of the system for each of our nodes
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return false;
+    if (strcmp(list, "all") == 0)
+        requested = allowed;
+    else if (!affinity_parse(list, &requested))
+        return false;
+
+    nodes = 0;
+    for (unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &requested) || !CPU_ISSET(cpu, &allowed))
+            continue;
+        cpus[cpus_l++] = cpu;
+
+        int node = affinity_sys_node(cpu);
+        unsigned int i;
+        for (i = 0; i < nodes && sys_node[i] != node; i++);
+        if (i == nodes)
+            sys_node[nodes++] = node;
+        cpu_node[cpu] = i;
+    }
+
+    if (cpus_l == 0) {
+        nodes = 1;
+        return false;
+    }
+    syslog(LOG_INFO, "Pinning the threads to %u CPUs on %u nodes", cpus_l, nodes);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Returns the number of nodes with CPUs used by the threads, 1 if
+ * they are not pinned.
+ * */
+unsigned int affinity_nodes() {
+    return nodes;
+}
+
+/**
+ * Pins the calling thread to the CPU for its id, and returns its node.
+ * It must be called before allocating the buffers of the thread: the
+ * kernel places the memory on the node of the thread that first
+ * touches it.
+ * */
+unsigned int affinity_pin(long int id) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if (cpus_l == 0)
+        return 0;
+
+    unsigned int cpu = cpus[id % cpus_l];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    return cpu_node[cpu];
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Returns the node of the CPU that handled the packets of the
+ * connection, 0 if it is not known.
+ * */
+unsigned int affinity_socket_node(int sock) {
+#ifdef SO_INCOMING_CPU
+    int cpu;
+    socklen_t len = sizeof(cpu);
+
+    if (nodes > 1 && getsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu >= 0 && cpu < CPU_SETSIZE)
+        return cpu_node[cpu];
+#endif
+    return 0;
+}
@@ -22,18 +22,28 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
 #include <syslog.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "types.h"
 #include "auth.h"
 #include "instance.h"
 #include "base64.h"
+#include "mystring.h"
+#include "htpasswd.h"
 
 extern weborf_configuration_t weborf_conf;
+extern pthread_key_t thread_key;            //key for pthread_setspecific
 
 #include "embedded_auth.h"
 
@@ -68,13 +78,305 @@ void auth_set_socket(char *u_socket) {
     fflush(stdout);
 }
 
+#ifndef EMBEDDED_AUTH
+/**
+Opens a new connection to the authentication daemon, with a timeout
+in milliseconds for the reads and writes.
+Returns the socket or -1 in case of failure.
+*/
+static int auth_connect(unsigned int read_timeout) {
+    struct sockaddr_un remote;
+
+    int s=socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+    if (s==-1)
+        return -1;
+
+    memset(&remote, 0, sizeof(remote));
+    remote.sun_family = AF_UNIX;
+    strncpy(remote.sun_path, weborf_conf.authsock, sizeof(remote.sun_path) - 1);
+    if (connect(s, (struct sockaddr *)&remote, sizeof(remote)) == -1) {//Unable to connect
+        close(s);
+        return -1;
+    }
+
+    //A stuck daemon must not block the thread forever
+    struct timeval timeout;
+    timeout.tv_sec = read_timeout / 1000;
+    timeout.tv_usec = (read_timeout % 1000) * 1000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return s;
+}
+
+/**
+Reads exactly count bytes from the socket.
+Returns 0 on success.
+*/
+static int auth_read_all(int s, void *buf, size_t count) {
+    while (count > 0) {
+        ssize_t r = read(s, buf, count);
+        if (r <= 0) {
+            if (r == -1 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += r;
+        count -= r;
+    }
+    return 0;
+}
+
+/**
+Sends one request over a persistent connection and reads the reply.
+
+Every message is preceded by its length, as a 32 bit unsigned integer in
+network byte order. The request is the same that is sent to daemons not
+using persistent connections. An empty reply grants the authorization, any
+other reply denies it.
+
+Returns 0 if the authorization is granted, -1 if it is denied, and 1 if the
+connection failed and must be discarded.
+*/
+static int auth_framed_request(int s, char *auth_str, uint32_t auth_str_l) {
+    uint32_t len = htonl(auth_str_l);
+    struct iovec iov[2];
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof(len);
+    iov[1].iov_base = auth_str;
+    iov[1].iov_len = auth_str_l;
+
+    //Requests are small, a short write means the connection is not usable
+    if (writev(s, iov, 2) != (ssize_t)(sizeof(len) + auth_str_l))
+        return 1;
+
+    if (auth_read_all(s, &len, sizeof(len)) != 0)
+        return 1;
+    len = ntohl(len);
+
+    if (len == 0)
+        return 0;
+
+    //Discards the content of the reply, only its presence matters
+    while (len > 0) {
+        size_t chunk = len > PWDLIMIT ? PWDLIMIT : len;
+        if (auth_read_all(s, auth_str, chunk) != 0)
+            return 1;
+        len -= chunk;
+    }
+    return -1;
+}
+
+/**
+Asks the authentication daemon, reusing the connection of the thread
+if there is one.
+
+If the daemon closed the connection in the meanwhile, a new connection
+is opened and the request is sent again.
+*/
+static int auth_keepalive_request(char *auth_str, int auth_str_l, unsigned int read_timeout) {
+    thread_prop_t *thread_prop = pthread_getspecific(thread_key);
+    int result = 1;
+
+    for (int attempt = 0; attempt < 2 && result == 1; attempt++) {
+        int s = thread_prop ? thread_prop->auth_sock : -1;
+
+        if (s == -1 && (s = auth_connect(read_timeout)) == -1)
+            return -1;
+
+        result = auth_framed_request(s, auth_str, auth_str_l);
+
+        if (result == 1 || thread_prop == NULL) {
+            close(s);
+            s = -1;
+        }
+        if (thread_prop)
+            thread_prop->auth_sock = s;
+    }
+
+    return result == 0 ? 0 : -1;
+}
+#endif
+
+/**
+Closes the persistent connection to the authentication daemon
+owned by the thread, if any.
+*/
+void auth_release_thread(thread_prop_t *thread_prop) {
+    if (thread_prop->auth_sock != -1) {
+        close(thread_prop->auth_sock);
+        thread_prop->auth_sock = -1;
+    }
+}
+
+typedef struct {
+    uint64_t hash;              //Hash of the key, 0 if the slot is empty
+    char *key;                  //Copy of the key, to tell apart different keys with the same hash
+    size_t key_l;               //Length of the key
+    time_t expires;             //Monotonic time after which the decision is no longer valid
+    int result;                 //Cached result of auth_ask_provider
+} auth_cache_entry_t;
+
+static auth_cache_entry_t auth_cache[AUTH_CACHE_SIZE];
+static pthread_mutex_t auth_cache_mutex[AUTH_CACHE_LOCKS];
+static unsigned long long auth_cache_hits, auth_cache_misses; //Only approximate, not locked
+
+/**
+Initializes the locks of the decision cache.
+*/
+void auth_cache_init() {
+    for (int i = 0; i < AUTH_CACHE_LOCKS; i++)
+        pthread_mutex_init(&auth_cache_mutex[i], NULL);
+}
+
+/**
+Prints the statistics of the decision cache.
+*/
+void auth_cache_print_status() {
+    if (weborf_conf.auth_cache_ttl == 0)
+        return;
+    printf("=== Auth cache ===\n"
+           "ttl:        %us\t"
+           "denied ttl: %us\n"
+           "hits:       %llu\t"
+           "misses:     %llu\n",
+           weborf_conf.auth_cache_ttl, weborf_conf.auth_cache_negative_ttl,
+           auth_cache_hits, auth_cache_misses);
+}
+
+/**
+Builds the key identifying the decision for a request: Authorization
+header, Host header in lower case, client address, method and path. The path is replaced by the
+configured prefix it starts with, if any, when the prefix ends at a / of the path.
+
+The fields are separated by a 0, the key is not null terminated.
+Returns the length of the key, or -1 if it does not fit in the buffer.
+*/
+static ssize_t auth_cache_key(connection_t *connection_prop, char *key, size_t size) {
+    char *page = connection_prop->page;
+    size_t page_l = connection_prop->page_len;
+    char *auth = "";
+    size_t auth_l = 0;
+
+    for (int i = 0; i < weborf_conf.auth_cache_prefix_l; i++) {
+        char *prefix = weborf_conf.auth_cache_prefix[i];
+        size_t l = strlen(prefix);
+        //Only whole components match: /foto is not a prefix of /fotobackup
+        if (l <= page_l && strncmp(page, prefix, l) == 0 &&
+                (l == page_l || page[l] == '/' || (l > 0 && prefix[l - 1] == '/'))) {
+            page = prefix;
+            page_l = l;
+            break;
+        }
+    }
+
+    char *header = strstr(connection_prop->http_param, "Authorization: ");
+    if (header != NULL) {
+        auth = header + 15;
+        char *end = strstr(auth, "\r\n");
+        auth_l = end ? (size_t)(end - auth) : strlen(auth);
+    }
+
+    //Virtual hosts can have different rules for the same path
+    char *host = "";
+    size_t host_l = 0;
+    header = strstr(connection_prop->http_param, "\r\nHost: ");
+    if (header != NULL) {
+        host = header + 8;
+        char *end = strstr(host, "\r\n");
+        host_l = end ? (size_t)(end - host) : strlen(host);
+    }
+
+    size_t ip_l = strlen(connection_prop->ip_addr);
+    size_t method_l = strlen(connection_prop->method);
+    size_t key_l = auth_l + host_l + ip_l + method_l + page_l + 4;
+    if (key_l > size)
+        return -1;
+
+    char *p = key;
+    memcpy(p, auth, auth_l);
+    p += auth_l;
+    *p++ = 0;
+    for (size_t i = 0; i < host_l; i++)
+        *p++ = (host[i] >= 'A' && host[i] <= 'Z') ? host[i] | 0x20 : host[i];
+    *p++ = 0;
+    memcpy(p, connection_prop->ip_addr, ip_l);
+    p += ip_l;
+    *p++ = 0;
+    memcpy(p, connection_prop->method, method_l);
+    p += method_l;
+    *p++ = 0;
+    memcpy(p, page, page_l);
+    return key_l;
+}
+
+/**
+Hash of the key. Never returns 0, that marks an empty slot.
+*/
+static uint64_t auth_cache_hash(char *key, size_t key_l) {
+    uint64_t hash = string_hash(key, key_l);
+    return hash ? hash : 1;
+}
+
+static time_t auth_cache_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+Looks for a valid decision in the cache.
+Returns 1 and sets result if the decision is found, 0 otherwise.
+*/
+static int auth_cache_get(char *key, size_t key_l, uint64_t hash, int *result) {
+    size_t slot = hash & (AUTH_CACHE_SIZE - 1);
+    auth_cache_entry_t *entry = &auth_cache[slot];
+    int found = 0;
+
+    pthread_mutex_lock(&auth_cache_mutex[slot % AUTH_CACHE_LOCKS]);
+    if (entry->hash == hash &&
+            entry->key_l == key_l &&
+            memcmp(entry->key, key, key_l) == 0 &&
+            entry->expires > auth_cache_now()) {
+        *result = entry->result;
+        found = 1;
+    }
+    pthread_mutex_unlock(&auth_cache_mutex[slot % AUTH_CACHE_LOCKS]);
+    return found;
+}
+
+/**
+Stores a decision in the cache, replacing the one in the same slot.
+*/
+static void auth_cache_put(char *key, size_t key_l, uint64_t hash, int result) {
+    unsigned int ttl = result == 0 ? weborf_conf.auth_cache_ttl : weborf_conf.auth_cache_negative_ttl;
+    if (ttl == 0)
+        return;
+
+    size_t slot = hash & (AUTH_CACHE_SIZE - 1);
+    auth_cache_entry_t *entry = &auth_cache[slot];
+
+    pthread_mutex_lock(&auth_cache_mutex[slot % AUTH_CACHE_LOCKS]);
+    if (entry->key_l < key_l) {
+        char *k = realloc(entry->key, key_l);
+        if (k == NULL) { //Keeps the old entry
+            pthread_mutex_unlock(&auth_cache_mutex[slot % AUTH_CACHE_LOCKS]);
+            return;
+        }
+        entry->key = k;
+    }
+    memcpy(entry->key, key, key_l);
+    entry->key_l = key_l;
+    entry->hash = hash;
+    entry->result = result;
+    entry->expires = auth_cache_now() + ttl;
+    pthread_mutex_unlock(&auth_cache_mutex[slot % AUTH_CACHE_LOCKS]);
+}
+
 /**
 This function checks if the authentication can be granted or not calling the external program.
 Returns 0 if authorization is granted.
 */
-int auth_check_request(connection_t *connection_prop) {
-    if (weborf_conf.authsock==NULL) return 0;
-
+static int auth_ask_provider(connection_t *connection_prop) {
     char username[PWDLIMIT*2];
     char* password=username; //will be changed if there is a password
 
@@ -107,6 +409,13 @@ int auth_check_request(connection_t *connection_prop) {
 
     int result=-1;
 
+    if (weborf_conf.htpasswd != NULL)
+        return htpasswd_check(connection_prop->page,
+                              connection_prop->ip_addr,
+                              connection_prop->method,
+                              username,
+                              password);
+
 #ifdef EMBEDDED_AUTH
     result=c_auth(connection_prop->page,
                   connection_prop->ip_addr,
@@ -116,16 +425,6 @@ int auth_check_request(connection_t *connection_prop) {
                   connection_prop->http_param);
 #else
     {
-        int s,len;
-        struct sockaddr_un remote;
-        s=socket(AF_UNIX,SOCK_STREAM,0);
-
-        remote.sun_family = AF_UNIX;
-        strcpy(remote.sun_path, weborf_conf.authsock);
-        len = strlen(remote.sun_path) + sizeof(remote.sun_family);
-        if (connect(s, (struct sockaddr *)&remote, len) == -1) {//Unable to connect
-            return -1;
-        }
         char* auth_str=malloc(HEADBUF+PWDLIMIT*2);
         if (auth_str==NULL) {
 #ifdef SERVERDBG
@@ -135,14 +434,56 @@ int auth_check_request(connection_t *connection_prop) {
         }
 
         int auth_str_l=snprintf(auth_str,HEADBUF+PWDLIMIT*2,"%s\r\n%s\r\n%s\r\n%s\r\n%s\r\n%s\r\n",connection_prop->page,connection_prop->ip_addr,connection_prop->method,username,password,connection_prop->http_param);
-        if (write(s,auth_str,auth_str_l)==auth_str_l && read(s,auth_str,1)==0) {//All data written and no output, ok
-            result=0;
+        if (auth_str_l >= HEADBUF+PWDLIMIT*2) //Truncated
+            auth_str_l = HEADBUF+PWDLIMIT*2-1;
+
+        if (weborf_conf.auth_keepalive) {
+            result=auth_keepalive_request(auth_str, auth_str_l, connection_prop->tunables->read_timeout);
+        } else {
+            int s=auth_connect(connection_prop->tunables->read_timeout);
+            if (s==-1) {//Unable to connect
+                free(auth_str);
+                return -1;
+            }
+            if (write(s,auth_str,auth_str_l)==auth_str_l && read(s,auth_str,1)==0) {//All data written and no output, ok
+                result=0;
+            }
+            close(s);
         }
 
-        close(s);
         free(auth_str);
     }
 #endif
 
     return result;
 }
+
+/**
+Checks if the authentication can be granted, using the cached decision
+for the same credentials, address, method and path if there is one.
+Returns 0 if authorization is granted.
+*/
+int auth_check_request(connection_t *connection_prop) {
+    if (!connection_prop->vhost->auth) return 0;
+
+    if (weborf_conf.auth_cache_ttl == 0)
+        return auth_ask_provider(connection_prop);
+
+    char key[HEADBUF + PWDLIMIT * 2];
+    ssize_t key_l = auth_cache_key(connection_prop, key, sizeof(key));
+    if (key_l == -1) //Too long to be cached
+        return auth_ask_provider(connection_prop);
+
+    uint64_t hash = auth_cache_hash(key, key_l);
+    int result;
+    if (auth_cache_get(key, key_l, hash, &result)) {
+        auth_cache_hits++;
+        return result;
+    }
+    auth_cache_misses++;
+
+    result = auth_ask_provider(connection_prop);
+    if (result == 0 || result == -1) //Errors are not decisions
+        auth_cache_put(key, key_l, hash, result);
+    return result;
+}
@@ -26,5 +26,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 void auth_set_socket(char *u_socket);
 int auth_check_request(connection_t* connection_prop);
+void auth_release_thread(thread_prop_t *thread_prop);
+void auth_cache_init();
+void auth_cache_print_status();
 
 #endif
\ No newline at end of file
@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "buffered_reader.h"
 #include "myio.h"
+#include "coro.h"
 
 /**
 This funcion inits the struct allocating a buffer of the specified size.
@@ -35,6 +36,7 @@ int buffer_init(buffered_read_t* buf, ssize_t size)
 {
     buf->buffer = malloc(sizeof(char) * size);
     buf->size = size;
+    buf->timeout = READ_TIMEOUT;
     buffer_reset(buf);
     return (buf->buffer == NULL) ? 1 : 0;
 }
@@ -47,6 +49,14 @@ void buffer_reset (buffered_read_t * buf) {
     buf->end = buf->start = buf->buffer;
 }
 
+/**
+Returns true if all the data read from the file descriptor
+has been consumed
+*/
+bool buffer_empty(buffered_read_t * buf) {
+    return buf->start == buf->end;
+}
+
 /**
 This function will free the memory allocated by the buffer used in the struct.
 */
@@ -59,15 +69,11 @@ static ssize_t buffer_fill(fd_t fd, buffered_read_t * buf) {
 
     buf->start = buf->buffer;
 
-    //Timeout implementation
-    struct pollfd monitor[1];
-    monitor[0].fd = myio_getfd(fd); //File descriptor to monitor
-    monitor[0].events = POLLIN; //Monitor on input events
-
     //Waits the timeout or reads the data.
     //If timeout is reached and no input is available
     //will behave like the stream is closed.
-    if (poll(monitor, 1, READ_TIMEOUT) == 0) {
+    //In a coroutine, the thread serves other connections meanwhile.
+    if (coro_wait(myio_getfd(fd), POLLIN, buf->timeout) == 0) {
         r = 0;
     } else {
         r = myio_read(fd, buf->buffer, buf->size);
@@ -88,7 +94,7 @@ buffer.
 When the buffer is empty, it will try to fill it.
 An important difference from the normal read is that this function will wait until
 the requested amount of bytes are available, or until the timeout occurs.
-Timeout duration is defined with the READ_TIMEOUT define.
+Timeout duration is the timeout field of the buffer, READ_TIMEOUT by default.
 On some special cases, the read data could be less than the requested one. For example if
 end of file is reached and it is impossible to do further reads.
 */
@@ -122,6 +128,27 @@ ssize_t buffer_read(fd_t fd, void *b, ssize_t count, buffered_read_t * buf) {
 }
 
 
+/**
+Writes to the file descriptor "to" up to count bytes of the data already
+in the buffer, without reading more from the stream.
+Returns the bytes written, or -1 in case of error.
+*/
+ssize_t buffer_flush(int to, ssize_t count, buffered_read_t * buf) {
+    ssize_t wrote = 0;
+
+    if (count > buf->end - buf->start)
+        count = buf->end - buf->start;
+
+    while (wrote < count) {
+        ssize_t r = write(to, buf->start, count - wrote);
+        if (r <= 0)
+            return -1;
+        buf->start += r;
+        wrote += r;
+    }
+    return wrote;
+}
+
 /**
  * This function returns how many bytes must be read in order to
  * read enough data for it to end with the string needle.
@@ -30,11 +30,14 @@ typedef struct {
     char *start;    //Pointer to non-consumed data
     char *end;      //Pointer to 1st byte after end of the data. A read must continue after end.
     int size;       //Size of the buffer
+    int timeout;    //Milliseconds to wait for data before considering the stream closed
 } buffered_read_t;
 
 void buffer_reset (buffered_read_t * buf);
+bool buffer_empty(buffered_read_t * buf);
 int buffer_init(buffered_read_t * buf, ssize_t size);
 void buffer_free(buffered_read_t * buf);
 ssize_t buffer_read(fd_t fd, void *b, ssize_t count, buffered_read_t * buf);
+ssize_t buffer_flush(int to, ssize_t count, buffered_read_t * buf);
 size_t buffer_strstr(fd_t fd, buffered_read_t * buf, char * needle);
 #endif
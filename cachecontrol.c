@@ -0,0 +1,321 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include "options.h"
+
+#include <sys/stat.h>
+#include <syslog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <time.h>
+
+#include "cachecontrol.h"
+#include "mime.h"
+#include "utils.h"
+
+extern weborf_configuration_t weborf_conf;
+
+#define MATCH_PREFIX 0          //Path starting with the pattern
+#define MATCH_SUFFIX 1          //Path ending with the pattern, from *.ext
+#define MATCH_GLOB 2            //Path matching the pattern with fnmatch(3)
+#define MATCH_MIME 3            //MIME type equal to the pattern
+#define MATCH_MIME_PREFIX 4     //MIME type starting with the pattern, from type/*
+
+typedef struct {
+    char *pattern;
+    size_t pattern_l;
+    int kind;
+    long max_age;               //Seconds, -1 if the responses are not cached
+    char header[CACHECONTROLLEN];//Cache-Control header, prepared when loading
+} cachecontrol_rule_t;
+
+typedef struct cachecontrol_table_t {
+    cachecontrol_rule_t *rules; //Rules, the first one matching the request is used
+    size_t rules_l;
+    bool mime;                  //True if some rule needs the MIME type
+    char *buf;                  //Content of the file, the patterns point here
+    time_t retired;             //When it was replaced, on the monotonic clock
+    struct cachecontrol_table_t *next;//Next replaced table waiting to be freed
+} cachecontrol_table_t;
+
+//Read without locks by cachecontrol_header()
+static _Atomic(cachecontrol_table_t *) cachecontrol_current = NULL;
+
+static pthread_mutex_t cachecontrol_mutex = PTHREAD_MUTEX_INITIALIZER; //Serializes reloads and reclaims
+static cachecontrol_table_t *cachecontrol_retired = NULL;
+
+static void cachecontrol_free(cachecontrol_table_t *table) {
+    if (table == NULL)
+        return;
+    free(table->rules);
+    free(table->buf);
+    free(table);
+}
+
+/**
+Reads a whole file in a null terminated buffer.
+Returns NULL in case of error.
+*/
+static char *cachecontrol_read_file(char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat sb;
+    char *buf = NULL;
+    if (fstat(fd, &sb) == 0 && (buf = malloc(sb.st_size + 1)) != NULL) {
+        ssize_t r = read(fd, buf, sb.st_size);
+        if (r < 0) {
+            free(buf);
+            buf = NULL;
+        } else {
+            buf[r] = 0;
+        }
+    }
+    close(fd);
+    return buf;
+}
+
+/**
+Decides how the pattern of a rule is matched, so that the common
+cases don't need fnmatch(3).
+Patterns starting with / or * are matched on the path, the others on
+the MIME type.
+*/
+static void cachecontrol_compile(cachecontrol_rule_t *rule, char *pattern) {
+    size_t l = strlen(pattern);
+    bool wildcards = strpbrk(pattern + 1, "*?[") != NULL; //After the first character
+
+    if (pattern[0] == '/' || pattern[0] == '*') {
+        if (pattern[0] == '/' && !wildcards) {
+            rule->kind = MATCH_PREFIX;
+        } else if (pattern[0] == '*' && !wildcards) {
+            rule->kind = MATCH_SUFFIX;
+            pattern++;
+            l--;
+        } else {
+            rule->kind = MATCH_GLOB;
+        }
+    } else if (l >= 2 && strcmp(pattern + l - 2, "/*") == 0) {
+        rule->kind = MATCH_MIME_PREFIX;
+        l--;
+    } else {
+        rule->kind = MATCH_MIME;
+    }
+    rule->pattern = pattern;
+    rule->pattern_l = l;
+}
+
+/**
+Parses the rules file. Every line contains:
+pattern max_age [immutable]
+
+max_age is in seconds, or no-cache or no-store.
+Returns NULL in case of error.
+*/
+static cachecontrol_table_t *cachecontrol_load(char *path) {
+    cachecontrol_table_t *table = calloc(1, sizeof(cachecontrol_table_t));
+    if (table == NULL)
+        return NULL;
+
+    table->buf = cachecontrol_read_file(path);
+    if (table->buf == NULL)
+        goto fail;
+
+    size_t count = 1;
+    for (char *c = table->buf; *c; c++)
+        if (*c == '\n')
+            count++;
+    table->rules = calloc(count, sizeof(cachecontrol_rule_t));
+    if (table->rules == NULL)
+        goto fail;
+
+    char *lasts;
+    int line_n = 0;
+    for (char *line = strtok_r(table->buf, "\n", &lasts); line; line = strtok_r(NULL, "\n", &lasts)) {
+        line_n++;
+        while (isspace(*line))
+            line++;
+        if (line[0] == '#' || line[0] == 0)
+            continue;
+
+        char *field[4];
+        char *l_field;
+        int n = 0;
+        for (char *f = strtok_r(line, " \t\r", &l_field); f && n < 4; f = strtok_r(NULL, " \t\r", &l_field))
+            field[n++] = f;
+
+        cachecontrol_rule_t *rule = &table->rules[table->rules_l];
+        bool immutable = n == 3 && strcmp(field[2], "immutable") == 0;
+        if (n < 2 || n > 3 || (n == 3 && !immutable)) {
+            syslog(LOG_ERR, "%s:%d: expected pattern max_age [immutable]", path, line_n);
+            goto fail;
+        }
+
+        if (strcmp(field[1], "no-cache") == 0 || strcmp(field[1], "no-store") == 0) {
+            rule->max_age = -1;
+            snprintf(rule->header, CACHECONTROLLEN, "Cache-Control: %s\r\n", field[1]);
+        } else {
+            char *end;
+            rule->max_age = strtol(field[1], &end, 10);
+            if (rule->max_age < 0 || end == field[1] || *end != 0) {
+                syslog(LOG_ERR, "%s:%d: invalid max_age %s", path, line_n, field[1]);
+                goto fail;
+            }
+            snprintf(rule->header, CACHECONTROLLEN, "Cache-Control: max-age=%ld%s\r\n", rule->max_age, immutable ? ", immutable" : "");
+        }
+
+        cachecontrol_compile(rule, field[0]);
+        if (rule->kind == MATCH_MIME || rule->kind == MATCH_MIME_PREFIX)
+            table->mime = true;
+        table->rules_l++;
+    }
+    return table;
+
+fail:
+    cachecontrol_free(table);
+    return NULL;
+}
+
+static time_t cachecontrol_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+Frees the replaced tables that nobody can be using any longer.
+
+Readers never take locks, so a replaced table is kept for
+CACHECONTROL_RECLAIM_GRACE seconds, much longer than writing the
+headers of a response can take.
+*/
+static void cachecontrol_reclaim() {
+    time_t now = cachecontrol_now();
+
+    pthread_mutex_lock(&cachecontrol_mutex);
+    cachecontrol_table_t **prev = &cachecontrol_retired;
+    while (*prev) {
+        cachecontrol_table_t *table = *prev;
+        if (now - table->retired >= CACHECONTROL_RECLAIM_GRACE) {
+            *prev = table->next;
+            cachecontrol_free(table);
+        } else {
+            prev = &table->next;
+        }
+    }
+    pthread_mutex_unlock(&cachecontrol_mutex);
+}
+
+/**
+Loads the rules, terminating the process if they can't be loaded.
+*/
+void cachecontrol_init() {
+    cachecontrol_table_t *table = cachecontrol_load(weborf_conf.cache_control);
+    if (table == NULL) {
+        fprintf(stderr, "Unable to load %s\n", weborf_conf.cache_control);
+        exit(6);
+    }
+    atomic_store_explicit(&cachecontrol_current, table, memory_order_release);
+}
+
+/**
+Loads the file again and replaces the current table.
+Requests already using the old table keep using it, it is freed
+later by cachecontrol_reclaim(). If the file can't be loaded, the
+old table stays.
+*/
+void cachecontrol_reload() {
+    if (atomic_load_explicit(&cachecontrol_current, memory_order_acquire) == NULL)
+        return;
+
+    cachecontrol_table_t *table = cachecontrol_load(weborf_conf.cache_control);
+    if (table == NULL) {
+        syslog(LOG_ERR, "Unable to load %s, keeping the previous rules", weborf_conf.cache_control);
+        return;
+    }
+
+    pthread_mutex_lock(&cachecontrol_mutex);
+    cachecontrol_table_t *old = atomic_exchange_explicit(&cachecontrol_current, table, memory_order_acq_rel);
+    old->retired = cachecontrol_now();
+    old->next = cachecontrol_retired;
+    cachecontrol_retired = old;
+    pthread_mutex_unlock(&cachecontrol_mutex);
+
+    syslog(LOG_INFO, "Reloaded %s", weborf_conf.cache_control);
+    cachecontrol_reclaim();
+}
+
+static bool cachecontrol_matches(cachecontrol_rule_t *rule, const char *page, size_t page_l, const char *mime) {
+    switch (rule->kind) {
+    case MATCH_PREFIX:
+        return strncmp(page, rule->pattern, rule->pattern_l) == 0;
+    case MATCH_SUFFIX:
+        return page_l >= rule->pattern_l && strcmp(page + page_l - rule->pattern_l, rule->pattern) == 0;
+    case MATCH_GLOB:
+        return fnmatch(rule->pattern, page, 0) == 0;
+    case MATCH_MIME:
+        return strcmp(mime, rule->pattern) == 0;
+    default: //MATCH_MIME_PREFIX
+        return strncmp(mime, rule->pattern, rule->pattern_l) == 0;
+    }
+}
+
+/**
+Writes in buf the Cache-Control and Expires headers of the first rule
+matching the page, or its MIME type, and returns their length.
+mime can be NULL, and it is then found only if some rule needs it.
+Returns 0 if there are no rules or none matches.
+buf must be at least CACHECONTROLLEN+HTTPDATELEN+16 bytes, and it is
+left untouched if no rule matches.
+*/
+int cachecontrol_header(const char *page, const char *strfile, const char *mime, char *buf, size_t size) {
+    cachecontrol_table_t *table = atomic_load_explicit(&cachecontrol_current, memory_order_acquire);
+    if (table == NULL)
+        return 0;
+
+    size_t page_l = strlen(page);
+    int len = 0;
+
+    if (mime == NULL && table->mime)
+        mime = get_mime(strfile);
+
+    for (size_t i = 0; i < table->rules_l; i++) {
+        cachecontrol_rule_t *rule = &table->rules[i];
+        if (!cachecontrol_matches(rule, page, page_l, mime))
+            continue;
+
+        len = snprintf(buf, size, "%s", rule->header);
+        if (rule->max_age >= 0) {
+            char date[HTTPDATELEN];
+            format_http_date(time(NULL) + rule->max_age, date, sizeof(date));
+            len += snprintf(buf + len, size - len, "Expires: %s\r\n", date);
+        }
+        break;
+    }
+    return len;
+}
@@ -35,21 +35,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "instance.h"
 
 
-char *cachedir=NULL;
-
 /**
 Generates the filename for the cached entity and stores it in the buffer
 */
 static inline void cached_filename(unsigned int uprefix,connection_t *connection_prop, char *buffer) {
-    snprintf(buffer,PATH_LEN,"%s/%u-%llu-%llu-%ld",cachedir,uprefix,(unsigned long long int)connection_prop->strfile_stat.st_ino,(unsigned long long int)connection_prop->strfile_stat.st_dev,connection_prop->strfile_stat.st_mtime);
+    snprintf(buffer,PATH_LEN,"%s/%u-%llu-%llu-%ld",connection_prop->vhost->cachedir,uprefix,(unsigned long long int)connection_prop->strfile_stat.st_ino,(unsigned long long int)connection_prop->strfile_stat.st_dev,connection_prop->strfile_stat.st_mtime);
 }
 
 /**
-Returns true if the caching is enabled and
-false otherwise
+Returns true if the caching is enabled for the host
+of the request and false otherwise
 */
-bool cache_is_enabled() {
-    return cachedir != NULL;
+bool cache_is_enabled(connection_t *connection_prop) {
+    return connection_prop->vhost->cachedir != NULL;
 }
 
 /**
@@ -73,12 +71,13 @@ bool cache_send_item(unsigned int uprefix,connection_t* connection_prop) {//Try
 
     write_file(connection_prop);
 
+    //Closes the cache file descriptor, unless it was closed already
+    if (connection_prop->strfile_fd != -1)
+        close(cachedfd);
+
     //Restore file descriptor so it can be closed later
     connection_prop->strfile_fd=oldfd;
 
-    //Closes the cache file descriptor
-    close(cachedfd);
-
     return true;
 }
 
@@ -88,7 +87,7 @@ This function returns the file descriptor to the file containing the cached
 item.
 
 If a cache miss occurs -1 will be returned
-If cache is not in use (cache_init was not called) it will always return -1
+If cache is not in use for the host of the request it will always return -1
 
 uprefix is an integer that must be unique for each call of get_cached_dir.
 Its purpose is to distinguish between calls that will eventually generate an
@@ -99,7 +98,7 @@ Acquires a shared lock on the file, so if the file is already opened in write mo
 the lock will fail and the function will return the same result of a cache miss.
 */
 int cache_get_item_fd(unsigned int uprefix,connection_t* connection_prop) {
-    if (!cachedir) return -1;
+    if (!cache_is_enabled(connection_prop)) return -1;
 
     char fname[PATH_LEN];
 
@@ -127,7 +126,7 @@ An exclusive lock will be acquired over the file, since it is being opened
 for writing too.
 */
 int cache_get_item_fd_wr(unsigned int uprefix,connection_t *connection_prop) {
-    if (!cachedir) return -1;
+    if (!cache_is_enabled(connection_prop)) return -1;
 
     char fname[PATH_LEN];
 
@@ -156,7 +155,7 @@ by another thread writing the same content on the file, waiting for the lock to
 override the content of the file with the same content.
 */
 void cache_store_item(unsigned int uprefix,connection_t* connection_prop, char *content, size_t content_len) {
-    if (!cachedir) return;
+    if (!cache_is_enabled(connection_prop)) return;
 
     char fname[PATH_LEN];
     cached_filename(uprefix,connection_prop,fname);
@@ -187,8 +186,6 @@ If it is impossible to delete and create files in it, weborf
 will just log a warning.
 */
 void cache_init(char* dir) {
-    cachedir=dir;
-
     {
         //Check if it exists
         struct stat stat_buf;
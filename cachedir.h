@@ -29,7 +29,7 @@ int cache_get_item_fd(unsigned int uprefix,connection_t* connection_prop);
 int cache_get_item_fd_wr(unsigned int uprefix,connection_t *connection_prop);
 void cache_store_item(unsigned int uprefix,connection_t* connection_prop, char *content, size_t content_len);
 void cache_init(char *dir);
-bool cache_is_enabled();
+bool cache_is_enabled(connection_t *connection_prop);
 
 
 #endif
@@ -29,12 +29,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "mystring.h"
 #include "cgi.h"
 #include "types.h"
 #include "instance.h"
 #include "myio.h"
+#include "coro.h"
 
 #define STDIN 0
 #define STDOUT 1
@@ -43,6 +49,192 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern char ** environ;                     //To reset environ vars
 extern weborf_configuration_t weborf_conf;
 
+/**
+ * Inits the concurrency limits of the host, one for each interpreter
+ * in its cgi_paths.
+ * Returns false if there is not enough memory.
+ * */
+bool cgi_limits_init(vhost_t *vhost) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    vhost->cgi_limits = calloc(MAXINDEXCOUNT / 2, sizeof(cgi_limit_t));
+    if (vhost->cgi_limits == NULL)
+        return false;
+
+    for (int i = 0; i < MAXINDEXCOUNT / 2; i++) {
+        pthread_mutex_init(&vhost->cgi_limits[i].mutex, NULL);
+        pthread_cond_init(&vhost->cgi_limits[i].for_slot, &attr);
+        vhost->cgi_limits[i].slot_fd = -1;
+    }
+    pthread_condattr_destroy(&attr);
+    return true;
+}
+
+static inline unsigned long long int cgi_elapsed_ms(struct timespec *from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - from->tv_sec) * 1000 + (now.tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/**
+ * Waits on the cgi_limit mutex, that is held, until a slot is free or
+ * until deadline. A coroutine can't sleep on the condition, the holders
+ * of the slots might be other coroutines of the same thread, so it
+ * yields until cgi_release() increments slot_fd.
+ * */
+static void cgi_wait_slot(vhost_t *vhost, cgi_limit_t *l, struct timespec *deadline) {
+    if (!coro_running()) {
+        while (l->running >= vhost->cgi_maxrunning) {
+            if (pthread_cond_timedwait(&l->for_slot, &l->mutex, deadline) == ETIMEDOUT)
+                break;
+        }
+        return;
+    }
+
+    if (l->slot_fd == -1 && (l->slot_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE)) == -1)
+        return;
+
+    //Every waiter needs its own descriptor, to be in the epoll of the thread
+    int fd = dup(l->slot_fd);
+    if (fd == -1)
+        return;
+
+    l->coro_waiting++;
+    while (l->running >= vhost->cgi_maxrunning) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long int left = (deadline->tv_sec - now.tv_sec) * 1000LL + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+        if (left <= 0)
+            break;
+
+        pthread_mutex_unlock(&l->mutex);
+        //Takes the token, EAGAIN if another waiter was faster
+        uint64_t token;
+        if (coro_wait(fd, POLLIN, left) > 0 && read(fd, &token, sizeof(token)) == -1 && errno != EAGAIN)
+            syslog(LOG_ERR, "Unable to wait for a CGI slot");
+        pthread_mutex_lock(&l->mutex);
+    }
+    l->coro_waiting--;
+    close(fd);
+}
+
+/**
+ * Reserves a slot to execute a script with the interpreter,
+ * which is the index of the couple in the cgi_paths of the host.
+ *
+ * If all the slots are in use, waits for one to be free, up to
+ * cgi_wait_timeout milliseconds.
+ * If there are already cgi_maxwaiting requests waiting, it fails
+ * immediately, so an overload of scripts doesn't take all the threads.
+ *
+ * Returns 0 on success, and then cgi_release must be called when
+ * the script terminates. Returns ERR_OVERLOADED otherwise.
+ * */
+int cgi_acquire(vhost_t *vhost, int interpreter) {
+    cgi_limit_t *l = &vhost->cgi_limits[interpreter];
+    int retval = 0;
+
+    if (vhost->cgi_maxrunning == 0)
+        return 0;
+
+    pthread_mutex_lock(&l->mutex);
+    if (l->running < vhost->cgi_maxrunning) {
+        l->running++;
+        pthread_mutex_unlock(&l->mutex);
+        return 0;
+    }
+
+    if (l->waiting >= vhost->cgi_maxwaiting) {
+        l->shed++;
+        pthread_mutex_unlock(&l->mutex);
+        return ERR_OVERLOADED;
+    }
+
+    struct timespec start, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline.tv_sec = start.tv_sec + vhost->cgi_wait_timeout / 1000;
+    deadline.tv_nsec = start.tv_nsec + (vhost->cgi_wait_timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    l->waiting++;
+    cgi_wait_slot(vhost, l, &deadline);
+    l->waiting--;
+
+    unsigned long long int waited = cgi_elapsed_ms(&start);
+    l->waited++;
+    l->wait_total += waited;
+    if (waited > l->wait_max)
+        l->wait_max = waited;
+
+    if (l->running >= vhost->cgi_maxrunning) {
+        l->timedout++;
+        retval = ERR_OVERLOADED;
+    } else {
+        l->running++;
+    }
+    pthread_mutex_unlock(&l->mutex);
+    return retval;
+}
+
+/**
+ * Frees the slot reserved with cgi_acquire
+ * */
+void cgi_release(vhost_t *vhost, int interpreter) {
+    cgi_limit_t *l = &vhost->cgi_limits[interpreter];
+
+    if (vhost->cgi_maxrunning == 0)
+        return;
+
+    pthread_mutex_lock(&l->mutex);
+    l->running--;
+    l->served++;
+    if (l->waiting > l->coro_waiting)
+        pthread_cond_signal(&l->for_slot);
+    if (l->coro_waiting > 0) {
+        uint64_t token = 1;
+        if (write(l->slot_fd, &token, sizeof(token)) == -1)
+            syslog(LOG_ERR, "Unable to wake the requests waiting for a CGI slot");
+    }
+    pthread_mutex_unlock(&l->mutex);
+}
+
+/**
+ * Prints the status of the queue of every interpreter of the host.
+ * */
+void cgi_print_status(vhost_t *vhost) {
+    printf("=== CGI %s ===\n"
+           "Max running: %u\tmax waiting: %u\ttimeout: %ums\n",
+           vhost->host ? vhost->host : "default",
+           vhost->cgi_maxrunning,
+           vhost->cgi_maxwaiting,
+           vhost->cgi_wait_timeout);
+
+    for (int i = 0; i < vhost->cgi_paths.len / 2; i++) {
+        cgi_limit_t *l = &vhost->cgi_limits[i];
+        pthread_mutex_lock(&l->mutex);
+        printf("%s (%s)\n"
+               "running:    %u\t"
+               "waiting:    %u\n"
+               "served:     %llu\t"
+               "shed:       %llu\t"
+               "timed out:  %llu\n"
+               "waited:     %llu\t"
+               "avg wait:   %llums\t"
+               "max wait:   %llums\n",
+               vhost->cgi_paths.data[i * 2],
+               vhost->cgi_paths.data[i * 2 + 1],
+               l->running, l->waiting,
+               l->served, l->shed, l->timedout,
+               l->waited, l->waited ? l->wait_total / l->waited : 0, l->wait_max);
+        pthread_mutex_unlock(&l->mutex);
+    }
+}
+
 /**
  * This function will set enviromental variables mapping the HTTP request.
  * Each variable will be prefixed with "HTTP_" and will be converted to
@@ -210,8 +402,13 @@ static inline char* cgi_child_chdir(connection_t *connection_prop) {
  * */
 static inline void cgi_execute_child(connection_t* connection_prop,string_t* post_param,char * executor,char* real_basedir,int *wpipe,int *ipipe) {
     char* errormsg = NULL;
+    sigset_t no_signals;
     close(wpipe[0]); //Closes unused end of the pipe
 
+    //The server handles some signals in a dedicated thread and blocks them elsewhere
+    sigemptyset(&no_signals);
+    sigprocmask(SIG_SETMASK, &no_signals, NULL);
+
     close(STDOUT);
     if (dup(wpipe[1]) == -1) { //Redirects the stdout
         errormsg = "dup() failed";
@@ -258,42 +455,44 @@ error:
 }
 
 
-static inline int cgi_waitfor_child(connection_t* connection_prop,string_t* post_param,char * executor,pid_t wpid,int *wpipe,int *ipipe) {
-    //Closing pipes, so if they're empty read is non blocking
-    close (wpipe[1]);
-
-    //Large buffer, must contain the output of the script
-    char* header_buf=malloc(MAXSCRIPTOUT+HEADBUF);
+/**
+ * Reads the output of a CGI-like program from fd and relays it to the client.
+ *
+ * The output must begin with a block of headers terminated by an empty line.
+ * A "Status: " header changes the HTTP status code. If the program replies
+ * with a full status line instead (as uwsgi applications do), the code is
+ * taken from there and the status line itself is not forwarded.
+ *
+ * The content that follows is streamed to the client, so the connection will
+ * not be kept alive after the response.
+ * */
+int cgi_relay_output(connection_t* connection_prop, int fd) {
+    //Large buffer, must contain the headers of the script
+    size_t buf_size=connection_prop->tunables->max_page_size+HEADBUF;
+    char* header_buf=malloc(buf_size);
 
     if (header_buf==NULL) { //Was unable to allocate the buffer
-        int state;
 #ifdef SERVERDBG
         syslog(LOG_CRIT,"Not enough memory to allocate buffers for CGI");
 #endif
-        close (wpipe[0]);
-        if (post_param->data!=NULL) {//Pipe created and used only if there is data to send to the script
-            close (ipipe[0]); //Closes unused end of the pipe
-            close (ipipe[1]); //Closes the pipe
-        }
-        kill(wpid,SIGKILL); //Kills cgi process
-        waitpid (wpid,&state,0); //Removes zombie process
-        return ERR_NOMEM;//Returns if buffer was not allocated
+        return ERR_NOMEM;
     }
 
-    if (post_param->data!=NULL) {//Pipe created and used only if there is data to send to the script
-        //Send post data to script's stdin
-        write(ipipe[1],post_param->data,post_param->len);
-        close (ipipe[0]); //Closes unused end of the pipe
-        close (ipipe[1]); //Closes the pipe
+    //Reads output of the script, until the end of the headers is found
+    ssize_t e_reads=0;
+    ssize_t r;
+    char* scrpt_buf=NULL;
+    while (e_reads < buf_size-1) {
+        r=read(fd,header_buf+e_reads,buf_size-1-e_reads);
+        if (r<=0)
+            break;
+        e_reads+=r;
+        header_buf[e_reads] = '\0';
+        if ((scrpt_buf=strstr(header_buf, "\r\n\r\n"))!=NULL)
+            break;
     }
 
-    //Reads output of the script
-    int e_reads=read(wpipe[0],header_buf,MAXSCRIPTOUT+HEADBUF-1);
-    header_buf[e_reads] = '\0';
-
     //Separating header from contents
-    char* scrpt_buf=strstr(header_buf, "\r\n\r\n");
-
     long long unsigned int cgi_content_s = 0;
     if (scrpt_buf!=NULL) {
         scrpt_buf+=2;
@@ -306,7 +505,14 @@ static inline int cgi_waitfor_child(connection_t* connection_prop,string_t* post
 
     if (e_reads>0) {//There is output from script
         unsigned int status = 200; //Standard status
-        {
+        char *headers = header_buf;
+        if (strncmp(header_buf,"HTTP/",5)==0) {
+            //Full status line, removing it from the headers
+            char *s=strchr(header_buf,' ');
+            if (s!=NULL)
+                status=(unsigned int)strtoul( s+1 , NULL, 10 );
+            headers=strstr(header_buf,"\r\n")+2;
+        } else {
             //Reading if there is another status
             char*s=strstr(header_buf,"Status: ");
             if (s!=NULL) {
@@ -319,35 +525,49 @@ static inline int cgi_waitfor_child(connection_t* connection_prop,string_t* post
         and we continue reading and writing to the socket */
 
         connection_prop->keep_alive = false;
-        send_http_header(status, NULL, header_buf, true, -1, connection_prop);
+        send_http_header(status, NULL, headers, true, NULL, connection_prop);
 
         if (cgi_content_s) {//Sends the page if there is something to send
             myio_write(connection_prop->sock, scrpt_buf, cgi_content_s);
         }
 
-
-        e_reads = 1;
-        while (e_reads) {
-            e_reads = read(wpipe[0],header_buf,MAXSCRIPTOUT+HEADBUF);
+        while ((e_reads = read(fd,header_buf,buf_size)) > 0) {
             if (myio_write(connection_prop->sock, header_buf, e_reads) != e_reads)
                 break; //Write error, just break, can't send errors now
         }
 
-        //Closing pipe
-        close(wpipe[0]);
-
     } else {//No output from script, maybe terminated...
         send_err(connection_prop,500,"Internal server error");
     }
 
     free(header_buf);
+    return 0;
+}
+
+static inline int cgi_waitfor_child(connection_t* connection_prop,string_t* post_param,char * executor,pid_t wpid,int *wpipe,int *ipipe) {
+    //Closing pipes, so if they're empty read is non blocking
+    close (wpipe[1]);
+
+    if (post_param->data!=NULL) {//Pipe created and used only if there is data to send to the script
+        //Send post data to script's stdin
+        write(ipipe[1],post_param->data,post_param->len);
+        close (ipipe[0]); //Closes unused end of the pipe
+        close (ipipe[1]); //Closes the pipe
+    }
+
+    int retval = cgi_relay_output(connection_prop, wpipe[0]);
+
+    //Closing pipe
+    close(wpipe[0]);
 
     {
         int state;
+        if (retval == ERR_NOMEM)
+            kill(wpid,SIGKILL); //Kills cgi process
         waitpid (wpid,&state,0); //Wait the termination of the script
     }
 
-    return 0;
+    return retval;
 }
 
 /**
@@ -26,5 +26,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "types.h"
 
 int exec_page(char * executor,string_t* post_param,char* real_basedir,connection_t* connection_prop);
+int cgi_relay_output(connection_t* connection_prop, int fd);
+bool cgi_limits_init(vhost_t *vhost);
+int cgi_acquire(vhost_t *vhost, int interpreter);
+void cgi_release(vhost_t *vhost, int interpreter);
+void cgi_print_status(vhost_t *vhost);
 
 #endif
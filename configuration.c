@@ -26,6 +26,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include <stdbool.h>
 #include <syslog.h>
+#include <limits.h>
+#include <pthread.h>
 
 #ifdef HAVE_LIBSSL
 #include <openssl/err.h>
@@ -37,6 +39,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "utils.h"
 #include "cachedir.h"
 #include "auth.h"
+#include "cgi.h"
+#include "htpasswd.h"
+#include "cachecontrol.h"
+#include "mime.h"
+#include "vhost.h"
+#include "listener.h"
+#include "affinity.h"
+
+//Options that only have the long form
+enum {
+    OPT_CGI_LIMIT = 256,
+    OPT_AUTH_KEEPALIVE,
+    OPT_AUTH_CACHE,
+    OPT_AUTH_CACHE_PREFIX,
+    OPT_HTPASSWD,
+    OPT_AUTH_RULES,
+    OPT_MIME_TYPES,
+    OPT_VHOST_CONFIG,
+    OPT_CONFIG,
+    OPT_PROCESSES,
+    OPT_CPUS,
+    OPT_BACKLOG,
+    OPT_DEFER_ACCEPT,
+    OPT_COROUTINES,
+    OPT_CACHE_CONTROL,
+};
 
 weborf_configuration_t weborf_conf = {
     .is_inetd=false,
@@ -45,6 +73,22 @@ weborf_configuration_t weborf_conf = {
     .ip = NULL,
     .port = PORT,
     .basedir=BASEDIR,
+    .authsock = NULL,
+    .auth_keepalive = false,
+    .auth_cache_ttl = 0,
+    .auth_cache_prefix_l = 0,
+    .htpasswd = NULL,
+    .auth_rules = NULL,
+    .cache_control = NULL,
+    .config = NULL,
+    .processes = 1,
+    .backlog = MAXQ,
+    .defer_accept = 0,
+    .coroutines = 0,
+    .cachedir = NULL,
+    .cgi_maxrunning = CGI_MAXRUNNING,
+    .cgi_maxwaiting = CGI_MAXWAITING,
+    .cgi_wait_timeout = CGI_WAIT_TIMEOUT,
 #ifdef HAVE_LIBSSL
     .sslctx = NULL,
 #endif
@@ -55,19 +99,25 @@ weborf_configuration_t weborf_conf = {
 };
 
 /**
-Sets the base dir, making sure that it is really a directory.
+Makes sure that the base dir is really a directory, and returns it.
  */
-static void configuration_set_basedir(char * bd) {
+static char *configuration_check_basedir(char * bd) {
     struct stat stat_buf;
-    stat(bd, &stat_buf);
 
-    if (!S_ISDIR(stat_buf.st_mode)) {
+    if (stat(bd, &stat_buf) != 0 || !S_ISDIR(stat_buf.st_mode)) {
         //Not a directory
         fprintf(stderr, "%s must be a directory\n", bd);
         syslog(LOG_ERR, "%s must be a directory\n", bd);
         exit(1);
     }
-    weborf_conf.basedir = bd;
+    return bd;
+}
+
+/**
+Sets the base dir, making sure that it is really a directory.
+ */
+static void configuration_set_basedir(char * bd) {
+    weborf_conf.basedir = configuration_check_basedir(bd);
 }
 
 /**
@@ -94,20 +144,24 @@ static void configuration_set_default_index() {
     weborf_conf.indexes_l = 1;
 }
 
-static void configuration_set_cgi(char *optarg) {
+/**
+ * Sets the extensions of the scripts and their interpreters,
+ * from a comma separated list of extension,interpreter
+ * */
+static void configuration_set_cgi(char *optarg, array_ll *cgi_paths) {
     if (!optarg || strlen(optarg) == 0) {
-        weborf_conf.cgi_paths.len = 0; //count of indexes
+        cgi_paths->len = 0; //count of indexes
         return;
     }
     int i = 0;
-    weborf_conf.cgi_paths.len = 1; //count of indexes
-    weborf_conf.cgi_paths.data[0] = optarg; //1st one points to begin of param
+    cgi_paths->len = 1; //count of indexes
+    cgi_paths->data[0] = optarg; //1st one points to begin of param
     while (optarg[++i] != 0) { //Reads the string
         if (optarg[i] == ',') {
             optarg[i] = 0; //Nulling the comma
             //Increasing counter and making next item point to char after the comma
-            weborf_conf.cgi_paths.data[weborf_conf.cgi_paths.len++] = &optarg[i + 1];
-            if (weborf_conf.cgi_paths.len == MAXINDEXCOUNT) {
+            cgi_paths->data[cgi_paths->len++] = &optarg[i + 1];
+            if (cgi_paths->len == MAXINDEXCOUNT) {
                 fprintf(stderr, "Too many cgis, server not acceptable.\n");
                 syslog(LOG_ERR, "Too many cgis, change MAXINDEXCOUNT in options.h to allow more\n");
                 exit(6);
@@ -115,15 +169,15 @@ static void configuration_set_cgi(char *optarg) {
         }
     }
 
-    if (weborf_conf.cgi_paths.len % 2 == 1) {
+    if (cgi_paths->len % 2 == 1) {
         fprintf(stderr, "--cgi: Unexpected args number(should be 2n).\nSyntax: <format>,<interpreter path>\n");
         syslog(LOG_ERR, "--cgi components must be an even number\n");
         exit(6);
     }
 
-    for (i=0; i<weborf_conf.cgi_paths.len; i++) {
-        weborf_conf.cgi_paths.data_l[i]=strlen(weborf_conf.cgi_paths.data[i]);
-        if (i % 2 == 0 && weborf_conf.cgi_paths.data_l[i] == 0) {
+    for (i=0; i<cgi_paths->len; i++) {
+        cgi_paths->data_l[i]=strlen(cgi_paths->data[i]);
+        if (i % 2 == 0 && cgi_paths->data_l[i] == 0) {
             fprintf(stderr, "file extension can't have length 0\n");
             syslog(LOG_ERR, "file extension can't have length 0\n");
             exit(6);
@@ -132,17 +186,91 @@ static void configuration_set_cgi(char *optarg) {
 
 }
 
-static void configuration_set_index_list(char *optarg) { //Setting list of indexes
+/**
+ * Sets the limits for the execution of CGI scripts, in the form
+ * running[,waiting[,timeout]]
+ * */
+static void configuration_set_cgi_limit(char *optarg, unsigned int *running, unsigned int *waiting, unsigned int *timeout) {
+    char *end;
+
+    *running = strtoul(optarg, &end, 10);
+    if (end[0] == ',')
+        *waiting = strtoul(end + 1, &end, 10);
+    if (end[0] == ',')
+        *timeout = strtoul(end + 1, &end, 10);
+
+    if (end[0] != '\0') {
+        fprintf(stderr, "--cgi-limit: expected running[,waiting[,timeout]]\n");
+        syslog(LOG_ERR, "--cgi-limit: invalid value\n");
+        exit(6);
+    }
+}
+
+/**
+Sets the time to live of the authentication cache, from a string
+in the form ttl[,denied_ttl]
+*/
+static void configuration_set_auth_cache(char *optarg) {
+    char *end;
+
+    weborf_conf.auth_cache_ttl = strtoul(optarg, &end, 10);
+    weborf_conf.auth_cache_negative_ttl = weborf_conf.auth_cache_ttl;
+    if (end[0] == ',')
+        weborf_conf.auth_cache_negative_ttl = strtoul(end + 1, &end, 10);
+
+    if (end[0] != '\0') {
+        fprintf(stderr, "--auth-cache: expected ttl[,denied_ttl]\n");
+        syslog(LOG_ERR, "--auth-cache: invalid value\n");
+        exit(6);
+    }
+}
+
+/**
+Parses the value of a numeric option, that must be between min and max.
+*/
+static int configuration_parse_int(char *name, char *optarg, int min, int max) {
+    char *end;
+    long int value = strtol(optarg, &end, 10);
+
+    if (end == optarg || end[0] != '\0' || value < min || value > max) {
+        fprintf(stderr, "--%s: expected a number between %d and %d\n", name, min, max);
+        syslog(LOG_ERR, "--%s: invalid value\n", name);
+        exit(6);
+    }
+    return value;
+}
+
+/**
+Sets the list of path prefixes that share the same authentication decision.
+*/
+static void configuration_set_auth_cache_prefix(char *optarg) {
+    int i = 0;
+    weborf_conf.auth_cache_prefix_l = 1;
+    weborf_conf.auth_cache_prefix[0] = optarg;
+    while (optarg[i++] != 0) {
+        if (optarg[i] == ',') {
+            optarg[i++] = 0;
+            weborf_conf.auth_cache_prefix[weborf_conf.auth_cache_prefix_l++] = &optarg[i];
+            if (weborf_conf.auth_cache_prefix_l == MAXINDEXCOUNT) {
+                fprintf(stderr, "Too many prefixes.\n");
+                syslog(LOG_ERR, "Too many prefixes, change MAXINDEXCOUNT in options.h to allow more\n");
+                exit(6);
+            }
+        }
+    }
+}
+
+static void configuration_set_index_list(char *optarg, char **indexes, int *indexes_l) { //Setting list of indexes
     int i = 0;
-    weborf_conf.indexes_l = 1; //count of indexes
-    weborf_conf.indexes[0] = optarg; //1st one points to begin of param
+    *indexes_l = 1; //count of indexes
+    indexes[0] = optarg; //1st one points to begin of param
     while (optarg[i++] != 0) { //Reads the string
 
         if (optarg[i] == ',') {
             optarg[i++] = 0; //Nulling the comma
             //Increasing counter and making next item point to char after the comma
-            weborf_conf.indexes[weborf_conf.indexes_l++] = &optarg[i];
-            if (weborf_conf.indexes_l == MAXINDEXCOUNT) {
+            indexes[(*indexes_l)++] = &optarg[i];
+            if (*indexes_l == MAXINDEXCOUNT) {
                 fprintf(stderr, "Too many index.\n");
                 syslog(LOG_ERR, "Too many indexes, change MAXINDEXCOUNT in options.h to allow more\n");
                 exit(6);
@@ -152,20 +280,443 @@ static void configuration_set_index_list(char *optarg) { //Setting list of index
 
 }
 
-static void configuration_set_virtualhost(char *optarg) {
+/**
+Sets the host used for the requests without a matching virtual host,
+from the global settings.
+*/
+static void configuration_set_default_vhost() {
+    vhost_t *vhost = &weborf_conf.default_vhost;
+
+    vhost->host = NULL;
+    vhost->basedir = weborf_conf.basedir;
+    memcpy(vhost->indexes, weborf_conf.indexes, sizeof(vhost->indexes));
+    vhost->indexes_l = weborf_conf.indexes_l;
+    vhost->exec_script = weborf_conf.exec_script;
+    vhost->cgi_paths = weborf_conf.cgi_paths;
+    vhost->cgi_maxrunning = weborf_conf.cgi_maxrunning;
+    vhost->cgi_maxwaiting = weborf_conf.cgi_maxwaiting;
+    vhost->cgi_wait_timeout = weborf_conf.cgi_wait_timeout;
+    vhost->cachedir = weborf_conf.cachedir;
+    vhost->auth = weborf_conf.authsock != NULL;
+#ifdef SEND_MIMETYPES
+    vhost->send_content_type = weborf_conf.send_content_type;
+#endif
+    vhost->sendfile = false;
+    vhost->read_size = 0;
+
+    if (!cgi_limits_init(vhost))
+        exit(NOMEM);
+}
+
+/**
+Parses the value of a boolean key of the virtual hosts file
+*/
+static bool configuration_parse_bool(char *key, char *value, unsigned int line) {
+    if (strcmp(value, "true") == 0)
+        return true;
+    if (strcmp(value, "false") == 0)
+        return false;
+    fprintf(stderr, "Line %u: %s must be true or false\n", line, key);
+    exit(6);
+}
+
+/**
+Sets one key of a virtual host. own_limits is set to true if the
+host needs its own CGI limits, instead of sharing the default ones.
+*/
+static void configuration_set_vhost_key(vhost_t *vhost, char *key, char *value, unsigned int line, bool *own_limits) {
+    if (strcmp(key, "basedir") == 0) {
+        vhost->basedir = configuration_check_basedir(value);
+    } else if (strcmp(key, "indexes") == 0) {
+        if (value[0])
+            configuration_set_index_list(value, vhost->indexes, &vhost->indexes_l);
+        else
+            vhost->indexes_l = 0; //Always lists the directories
+    } else if (strcmp(key, "use-cgi") == 0) {
+        vhost->exec_script = configuration_parse_bool(key, value, line);
+    } else if (strcmp(key, "cgi") == 0) {
+        configuration_set_cgi(value, &vhost->cgi_paths);
+        *own_limits = true;
+    } else if (strcmp(key, "cgi-limit") == 0) {
+        configuration_set_cgi_limit(value, &vhost->cgi_maxrunning, &vhost->cgi_maxwaiting, &vhost->cgi_wait_timeout);
+        *own_limits = true;
+    } else if (strcmp(key, "cachedir") == 0) {
+        if (value[0]) {
+            cache_init(value);
+            vhost->cachedir = value;
+        } else {
+            vhost->cachedir = NULL;
+        }
+    } else if (strcmp(key, "auth") == 0) {
+        vhost->auth = configuration_parse_bool(key, value, line);
+        if (vhost->auth && weborf_conf.authsock == NULL) {
+            fprintf(stderr, "Line %u: auth requires an authentication provider\n", line);
+            exit(6);
+        }
+#ifdef SEND_MIMETYPES
+    } else if (strcmp(key, "use-mime") == 0) {
+        vhost->send_content_type = configuration_parse_bool(key, value, line);
+#endif
+    } else if (strcmp(key, "sendfile") == 0) {
+        vhost->sendfile = configuration_parse_bool(key, value, line);
+    } else if (strcmp(key, "read-size") == 0) {
+        char *end;
+        vhost->read_size = strtoul(value, &end, 10);
+        if (vhost->read_size == 0 || end[0] != '\0') {
+            fprintf(stderr, "Line %u: read-size must be a positive number of bytes\n", line);
+            exit(6);
+        }
+    } else {
+        fprintf(stderr, "Line %u: unknown key %s\n", line, key);
+        exit(6);
+    }
+}
+
+/**
+Ends a block of the virtual hosts file: the hosts from first to count
+get the settings of the first one.
+*/
+static void configuration_end_vhost_block(vhost_t *settings, vhost_t *vhosts, size_t first, size_t count, bool own_limits) {
+    if (settings == NULL)
+        return;
+
+    if (own_limits && !cgi_limits_init(settings))
+        exit(NOMEM);
+
+    for (size_t i = first + 1; i < count; i++) {
+        char *host = vhosts[i].host;
+        vhosts[i] = vhosts[first];
+        vhosts[i].host = host;
+    }
+}
+
+/**
+Loads the virtual hosts from a file made of blocks like
+
+[example.com,*.example.com]
+basedir=/srv/www/example/
+cgi=.php,scgi:/run/php.sock
+
+The hosts of a block start from the settings of the default host, and
+the block [default] changes the settings of the default host itself,
+for the blocks that follow it.
+The hosts are appended to *vhosts, and the new count is returned.
+*/
+static size_t configuration_load_vhosts(char *path, vhost_t **vhosts, size_t count) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        syslog(LOG_ERR, "Unable to open %s\n", path);
+        exit(6);
+    }
+
+    char *buf = NULL;
+    size_t buf_size = 0;
+    unsigned int line = 0;
+    vhost_t *settings = NULL;   //Host receiving the keys of the current block
+    size_t first = count;       //First host of the current block
+    bool own_limits = false;
+
+    while (getline(&buf, &buf_size, f) != -1) {
+        line++;
+
+        //The strings are used by the hosts, so every line is kept
+        char *l = buf;
+        while (*l == ' ' || *l == '\t')
+            l++;
+        size_t len = strlen(l);
+        while (len > 0 && (l[len - 1] == '\n' || l[len - 1] == '\r' || l[len - 1] == ' ' || l[len - 1] == '\t'))
+            l[--len] = 0;
+        if (len == 0 || l[0] == '#')
+            continue;
+        if ((l = strdup(l)) == NULL)
+            exit(NOMEM);
+
+        if (l[0] == '[') {
+            if (l[len - 1] != ']') {
+                fprintf(stderr, "Line %u: expected [host]\n", line);
+                exit(6);
+            }
+            l[len - 1] = 0;
+
+            configuration_end_vhost_block(settings, *vhosts, first, count, own_limits);
+            own_limits = false;
+            first = count;
+
+            if (strcmp(l + 1, "default") == 0) {
+                settings = &weborf_conf.default_vhost;
+                continue;
+            }
+
+            char *lasts;
+            for (char *host = strtok_r(l + 1, ",", &lasts); host; host = strtok_r(NULL, ",", &lasts)) {
+                vhost_t *resized = realloc(*vhosts, (count + 1) * sizeof(vhost_t));
+                if (resized == NULL)
+                    exit(NOMEM);
+                *vhosts = resized;
+                (*vhosts)[count] = weborf_conf.default_vhost;
+                (*vhosts)[count++].host = host;
+            }
+            if (first == count) {
+                fprintf(stderr, "Line %u: expected [host]\n", line);
+                exit(6);
+            }
+            settings = &(*vhosts)[first];
+            continue;
+        }
+
+        char *value = strchr(l, '=');
+        if (value == NULL || settings == NULL) {
+            fprintf(stderr, "Line %u: expected key=value inside a [host] block\n", line);
+            exit(6);
+        }
+        *value++ = 0;
+        configuration_set_vhost_key(settings, l, value, line, &own_limits);
+    }
+    configuration_end_vhost_block(settings, *vhosts, first, count, own_limits);
+
+    free(buf);
+    fclose(f);
+    return count;
+}
+
+/**
+Sets the virtual hosts, from the file with their settings and from
+a comma separated list of host=basedir.
+The hosts of the list use the settings of the default host.
+*/
+static void configuration_set_virtualhost(char *path, char *optarg) {
+    vhost_t *vhosts = NULL;
+    size_t count = 0;
+
     weborf_conf.virtual_host = true;
 
-    int i = 0;
-    char *virtual = optarg; //1st one points to begin of param
+    if (path)
+        count = configuration_load_vhosts(path, &vhosts, count);
 
-    while (optarg[i++] != 0) { //Reads the string
-        if (optarg[i] == ',') {
-            optarg[i++] = 0; //Nulling the comma
-            putenv(virtual);
-            virtual = &optarg[i];
+    if (optarg) {
+        char *lasts;
+        for (char *virtual = strtok_r(optarg, ",", &lasts); virtual; virtual = strtok_r(NULL, ",", &lasts)) {
+            char *basedir = strchr(virtual, '=');
+            if (basedir == NULL) {
+                fprintf(stderr, "Virtual host %s must be in the form host=basedir\n", virtual);
+                exit(6);
+            }
+            *basedir++ = 0;
+
+            vhost_t *resized = realloc(vhosts, (count + 1) * sizeof(vhost_t));
+            if (resized == NULL)
+                exit(NOMEM);
+            vhosts = resized;
+            vhosts[count] = weborf_conf.default_vhost;
+            vhosts[count].host = virtual;
+            vhosts[count++].basedir = basedir;
+        }
+    }
+
+    vhost_table_t *table = vhost_build(vhosts, count);
+    if (table == NULL)
+        exit(NOMEM);
+    vhost_publish(table);
+}
+
+static pthread_mutex_t tunables_mutex = PTHREAD_MUTEX_INITIALIZER;
+static weborf_tunables_t *tunables_current = NULL;
+
+/**
+Sets one of the tunables from a line of the configuration file.
+Returns 1 if the key is not a tunable, -1 if the value is invalid
+and 0 on success.
+*/
+static int tunables_set(weborf_tunables_t *t, char *key, char *value) {
+    struct {
+        char *key;
+        unsigned int *uint_field;
+        size_t *size_field;
+    } keys[] = {
+        {"max-threads", &t->max_threads, NULL},
+        {"min-threads", &t->min_threads, NULL},
+        {"initial-threads", &t->initial_threads, NULL},
+        {"low-threads", &t->low_threads, NULL},
+        {"max-free-threads", &t->max_free_threads, NULL},
+        {"read-timeout", &t->read_timeout, NULL},
+        {"drain-timeout", &t->drain_timeout, NULL},
+        {"request-buffer", NULL, &t->request_buffer},
+        {"file-buffer", NULL, &t->file_buffer},
+        {"max-page-size", NULL, &t->max_page_size},
+        {"reader-buffer", NULL, &t->reader_buffer},
+        {"post-max-size", NULL, &t->post_max_size},
+    };
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strcmp(key, keys[i].key) != 0)
+            continue;
+
+        char *end;
+        unsigned long long int v = strtoull(value, &end, 10);
+        if (end == value || end[0] != '\0' || v == 0 || v > UINT_MAX)
+            return -1;
+        if (keys[i].uint_field)
+            *keys[i].uint_field = v;
+        else
+            *keys[i].size_field = v;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+Checks that the number of threads are consistent with max-threads.
+*/
+static bool tunables_check(weborf_tunables_t *t) {
+    return t->low_threads < t->max_threads && t->initial_threads <= t->max_threads && t->min_threads <= t->max_threads;
+}
+
+/**
+Loads the tunables from the file, starting from the default values.
+The other keys are ignored, so the same file can be used by the launcher.
+Returns 0 on success and -1 if the file can't be read or is invalid.
+*/
+static int tunables_load(char *path, weborf_tunables_t *t) {
+    *t = (weborf_tunables_t) {
+        .max_threads = MAXTHREAD,
+        .min_threads = MINTHREAD,
+        .initial_threads = INITIALTHREAD,
+        .low_threads = LOWTHREAD,
+        .max_free_threads = MAXFREETHREAD,
+        .read_timeout = READ_TIMEOUT,
+        .drain_timeout = DRAIN_TIMEOUT,
+        .request_buffer = INBUFFER,
+        .file_buffer = FILEBUF,
+        .max_page_size = MAXSCRIPTOUT,
+        .reader_buffer = BUFFERED_READER_SIZE,
+        .post_max_size = POST_MAX_SIZE,
+    };
+
+    if (path == NULL)
+        return 0;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        syslog(LOG_ERR, "Unable to open %s", path);
+        return -1;
+    }
+
+    char line[PATH_LEN];
+    unsigned int line_n = 0;
+    int retval = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_n++;
+        line[strcspn(line, "\r\n")] = 0;
+
+        char *value = strchr(line, '=');
+        if (line[0] == '#' || value == NULL)
+            continue;
+        *value++ = 0;
+
+        if (tunables_set(t, line, value) == -1) {
+            fprintf(stderr, "%s:%u: invalid value for %s\n", path, line_n, line);
+            syslog(LOG_ERR, "%s:%u: invalid value for %s", path, line_n, line);
+            retval = -1;
+        }
+    }
+    fclose(f);
+
+    if (!tunables_check(t)) {
+        fprintf(stderr, "%s: low-threads must be less than max-threads, min-threads and initial-threads can't be more\n", path);
+        syslog(LOG_ERR, "%s: low-threads must be less than max-threads, min-threads and initial-threads can't be more", path);
+        retval = -1;
+    }
+    return retval;
+}
+
+/**
+Makes t the snapshot used by the new requests.
+*/
+static void tunables_publish(weborf_tunables_t *t) {
+    pthread_mutex_lock(&tunables_mutex);
+    weborf_tunables_t *old = tunables_current;
+    t->refs = 1;
+    t->version = old ? old->version + 1 : 1;
+    tunables_current = t;
+    pthread_mutex_unlock(&tunables_mutex);
+
+    if (old)
+        tunables_release(old);
+}
+
+/**
+Returns the current tunables, that remain valid until they are passed
+to tunables_release().
+*/
+weborf_tunables_t *tunables_acquire() {
+    pthread_mutex_lock(&tunables_mutex);
+    weborf_tunables_t *t = tunables_current;
+    t->refs++;
+    pthread_mutex_unlock(&tunables_mutex);
+    return t;
+}
+
+void tunables_release(weborf_tunables_t *t) {
+    if (t == NULL)
+        return;
+
+    pthread_mutex_lock(&tunables_mutex);
+    unsigned int refs = --t->refs;
+    pthread_mutex_unlock(&tunables_mutex);
+
+    if (refs == 0)
+        free(t);
+}
+
+/**
+Loads the configuration file again. If it is not valid, the current
+tunables are kept. max-threads can't change while running.
+*/
+void configuration_reload() {
+    if (weborf_conf.config == NULL)
+        return;
+
+    weborf_tunables_t *t = malloc(sizeof(weborf_tunables_t));
+    if (t == NULL)
+        return;
+
+    if (tunables_load(weborf_conf.config, t) != 0) {
+        syslog(LOG_ERR, "Keeping the previous configuration");
+        free(t);
+        return;
+    }
+
+    weborf_tunables_t *current = tunables_acquire();
+    if (t->max_threads != current->max_threads) {
+        syslog(LOG_WARNING, "max-threads can't change without a restart");
+        t->max_threads = current->max_threads;
+        if (!tunables_check(t)) {
+            syslog(LOG_ERR, "Keeping the previous configuration");
+            tunables_release(current);
+            free(t);
+            return;
         }
     }
-    putenv(virtual);
+    tunables_release(current);
+
+    tunables_publish(t);
+#ifdef SERVERDBG
+    syslog(LOG_INFO, "Loaded configuration version %u", t->version);
+#endif
+}
+
+/**
+Loads the tunables at startup, terminating if they are not valid.
+*/
+static void configuration_set_tunables() {
+    weborf_tunables_t *t = malloc(sizeof(weborf_tunables_t));
+    if (t == NULL)
+        exit(NOMEM);
+    if (tunables_load(weborf_conf.config, t) != 0)
+        exit(6);
+    tunables_publish(t);
 }
 
 #ifdef HAVE_LIBSSL
@@ -206,6 +757,8 @@ void configuration_load(int argc, char *argv[]) {
     char *certificate = NULL;
     char *key = NULL;
 #endif
+    char *virtual = NULL;       //Virtual hosts from the command line
+    char *vhost_config = NULL;  //File with the virtual hosts
 
     //Declares options
     struct option long_options[] = {
@@ -217,9 +770,28 @@ void configuration_load(int argc, char *argv[]) {
         {"basedir", required_argument, 0, 'b'},
         {"index", required_argument, 0, 'I'},
         {"virtual", required_argument, 0, 'V'},
+        {"vhost-config", required_argument, 0, OPT_VHOST_CONFIG},
+        {"config", required_argument, 0, OPT_CONFIG},
+        {"processes", required_argument, 0, OPT_PROCESSES},
+        {"cpus", required_argument, 0, OPT_CPUS},
+        {"backlog", required_argument, 0, OPT_BACKLOG},
+        {"defer-accept", required_argument, 0, OPT_DEFER_ACCEPT},
+        {"coroutines", required_argument, 0, OPT_COROUTINES},
         {"cgi", required_argument, 0, 'c'},
         {"cache", required_argument, 0, 'C'},
         {"inetd", no_argument,0,'T'},
+#ifdef SEND_MIMETYPES
+        {"mime", no_argument, 0, 'm'},
+        {"mime-types", required_argument, 0, OPT_MIME_TYPES},
+        {"cache-control", required_argument, 0, OPT_CACHE_CONTROL},
+#endif
+        {"cgi-limit", required_argument, 0, OPT_CGI_LIMIT},
+        {"auth", required_argument, 0, 'a'},
+        {"auth-keepalive", no_argument, 0, OPT_AUTH_KEEPALIVE},
+        {"auth-cache", required_argument, 0, OPT_AUTH_CACHE},
+        {"auth-cache-prefix", required_argument, 0, OPT_AUTH_CACHE_PREFIX},
+        {"htpasswd", required_argument, 0, OPT_HTPASSWD},
+        {"auth-rules", required_argument, 0, OPT_AUTH_RULES},
 #ifdef HAVE_LIBSSL
         {"cert", required_argument, 0, 'S'},
         {"key", required_argument, 0, 'K'},
@@ -249,18 +821,76 @@ void configuration_load(int argc, char *argv[]) {
         case 'T':
             weborf_conf.is_inetd=true;
             break;
+#ifdef SEND_MIMETYPES
+        case 'm':
+            weborf_conf.send_content_type = true;
+            break;
+        case OPT_MIME_TYPES:
+            mime_init(optarg);
+            break;
+#endif
+        case OPT_CACHE_CONTROL:
+            weborf_conf.cache_control = optarg;
+            break;
         case 'C':
             cache_init(optarg);
+            weborf_conf.cachedir = optarg;
             break;
         case 'c':
             weborf_conf.exec_script = true;
-            configuration_set_cgi(optarg);
+            configuration_set_cgi(optarg, &weborf_conf.cgi_paths);
+            break;
+        case OPT_CGI_LIMIT:
+            configuration_set_cgi_limit(optarg, &weborf_conf.cgi_maxrunning, &weborf_conf.cgi_maxwaiting, &weborf_conf.cgi_wait_timeout);
+            break;
+        case 'a':
+            auth_set_socket(optarg);
+            break;
+        case OPT_AUTH_KEEPALIVE:
+            weborf_conf.auth_keepalive = true;
+            break;
+        case OPT_AUTH_CACHE:
+            configuration_set_auth_cache(optarg);
+            break;
+        case OPT_AUTH_CACHE_PREFIX:
+            configuration_set_auth_cache_prefix(optarg);
+            break;
+        case OPT_HTPASSWD:
+            weborf_conf.htpasswd = optarg;
+            break;
+        case OPT_AUTH_RULES:
+            weborf_conf.auth_rules = optarg;
             break;
         case 'V':
-            configuration_set_virtualhost(optarg);
+            virtual = optarg;
+            break;
+        case OPT_VHOST_CONFIG:
+            vhost_config = optarg;
+            break;
+        case OPT_CONFIG:
+            weborf_conf.config = optarg;
+            break;
+        case OPT_PROCESSES:
+            weborf_conf.processes = configuration_parse_int("processes", optarg, 1, MAXPROCESSES);
+            break;
+        case OPT_BACKLOG:
+            weborf_conf.backlog = configuration_parse_int("backlog", optarg, 1, INT_MAX);
+            break;
+        case OPT_DEFER_ACCEPT:
+            weborf_conf.defer_accept = configuration_parse_int("defer-accept", optarg, 0, INT_MAX);
+            break;
+        case OPT_COROUTINES:
+            weborf_conf.coroutines = configuration_parse_int("coroutines", optarg, 0, MAXCOROUTINES);
+            break;
+        case OPT_CPUS:
+            if (!affinity_init(optarg)) {
+                fprintf(stderr, "--cpus: expected a list like 0-3,8 of usable CPUs, or all\n");
+                syslog(LOG_ERR, "--cpus: invalid value\n");
+                exit(6);
+            }
             break;
         case 'I':
-            configuration_set_index_list(optarg);
+            configuration_set_index_list(optarg, weborf_conf.indexes, &weborf_conf.indexes_l);
             break;
         case 'b':
             configuration_set_basedir(optarg);
@@ -292,8 +922,30 @@ void configuration_load(int argc, char *argv[]) {
 
     }
 
+#ifdef EMBEDDED_AUTH
     // Init AUTH anyway
     auth_set_socket("");
+#endif
+
+    if (weborf_conf.htpasswd != NULL) {
+        htpasswd_init();
+        if (weborf_conf.authsock == NULL)
+            weborf_conf.authsock = weborf_conf.htpasswd;
+    } else if (weborf_conf.auth_rules != NULL) {
+        fprintf(stderr, "--auth-rules requires --htpasswd\n");
+        exit(6);
+    }
+
+    if (weborf_conf.cache_control != NULL)
+        cachecontrol_init();
+
+    auth_cache_init();
+    configuration_set_tunables();
+
+    //The virtual hosts start from the settings of the default one
+    configuration_set_default_vhost();
+    if (virtual || vhost_config)
+        configuration_set_virtualhost(vhost_config, virtual);
 
 #ifdef HAVE_LIBSSL
     if (certificate || key) {
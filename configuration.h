@@ -25,5 +25,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "options.h"
 
 void configuration_load(int argc, char *argv[]);
+void configuration_reload();
+weborf_tunables_t *tunables_acquire();
+void tunables_release(weborf_tunables_t *t);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,324 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include "options.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "coro.h"
+#include "types.h"
+
+extern pthread_key_t thread_key;
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#define CORO_EVENTS 64          //Events read at every wakeup of the scheduler
+
+typedef enum {
+    CORO_FREE = 0,              //Waiting for a connection to serve
+    CORO_RUNNING,
+    CORO_WAITING,               //Waiting for its file descriptor
+} coro_state_t;
+
+typedef struct {
+    ucontext_t ctx;
+    void *stack;
+    coro_state_t state;
+    int sock;                   //Connection it is serving
+    int fd;                     //File descriptor it is waiting for
+    int result;                 //Returned by coro_wait(), 0 on timeout
+    bool expires;               //True if it waits with a timeout
+    struct timespec deadline;
+    void *local;                //Kept between the connections, see coro_init()
+} coro_t;
+
+/**
+ * Scheduler of the coroutines of a thread.
+ * */
+struct coro_sched_t {
+    ucontext_t main;            //Context of the thread
+    coro_t *current;            //Coroutine running, NULL in the thread
+    coro_t **coros;
+    unsigned int max;
+    unsigned int created;
+    unsigned int active;        //Coroutines serving a connection
+    int epoll;
+    coro_fn_t fn;
+    void (*release)(void *local);
+};
+
+static coro_sched_t *coro_sched() {
+    thread_prop_t *thread_prop = pthread_getspecific(thread_key);
+    return thread_prop ? thread_prop->coro : NULL;
+}
+
+/**
+ * Body of every coroutine. They never end, after a connection they wait
+ * to be given another one.
+ * */
+static void coro_main() {
+    coro_sched_t *sched = coro_sched();
+    coro_t *coro = sched->current;
+
+    while (true) {
+        sched->fn(coro->sock, &coro->local);
+        coro->state = CORO_FREE;
+        sched->active--;
+        swapcontext(&coro->ctx, &sched->main);
+    }
+}
+
+static void coro_resume(coro_sched_t *sched, coro_t *coro) {
+    coro->state = CORO_RUNNING;
+    sched->current = coro;
+    swapcontext(&sched->main, &coro->ctx);
+    sched->current = NULL;
+}
+
+static coro_t *coro_create() {
+    //getcontext() can return twice, so the pointer must not be kept in a register
+    coro_t * volatile coro = calloc(1, sizeof(coro_t));
+    if (coro == NULL)
+        return NULL;
+
+    //The memory is only used when touched, the lowest page catches overflows
+    coro->stack = mmap(NULL, COROUTINE_STACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (coro->stack == MAP_FAILED) {
+        free(coro);
+        return NULL;
+    }
+    mprotect(coro->stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+
+    getcontext(&coro->ctx);
+    coro->ctx.uc_stack.ss_sp = coro->stack;
+    coro->ctx.uc_stack.ss_size = COROUTINE_STACK;
+    coro->ctx.uc_link = NULL;
+    makecontext(&coro->ctx, coro_main, 0);
+    return coro;
+}
+
+/**
+ * Creates the scheduler of the calling thread, that will run up to max
+ * coroutines, each one calling fn for every connection it is given.
+ * The local pointer passed to fn is kept by the coroutine between the
+ * connections, and passed to release when the scheduler is freed.
+ * Returns NULL if it is not possible, then the connections must be served
+ * by the thread.
+ * */
+coro_sched_t *coro_init(unsigned int max, coro_fn_t fn, void (*release)(void *local)) {
+    coro_sched_t *sched = calloc(1, sizeof(coro_sched_t));
+    if (sched == NULL)
+        return NULL;
+
+    sched->coros = calloc(max, sizeof(coro_t *));
+    sched->epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (sched->coros == NULL || sched->epoll == -1) {
+        if (sched->epoll != -1)
+            close(sched->epoll);
+        free(sched->coros);
+        free(sched);
+        return NULL;
+    }
+    sched->max = max;
+    sched->fn = fn;
+    sched->release = release;
+    return sched;
+}
+
+void coro_free(coro_sched_t *sched) {
+    if (sched == NULL)
+        return;
+
+    for (unsigned int i = 0; i < sched->created; i++) {
+        if (sched->coros[i]->local)
+            sched->release(sched->coros[i]->local);
+        munmap(sched->coros[i]->stack, COROUTINE_STACK);
+        free(sched->coros[i]);
+    }
+    free(sched->coros);
+    close(sched->epoll);
+    free(sched);
+}
+
+/**
+ * Returns the number of connections being served.
+ * */
+unsigned int coro_count(coro_sched_t *sched) {
+    return sched->active;
+}
+
+/**
+ * Serves sock in a coroutine, that runs until it has to wait.
+ * Returns false if all the coroutines are busy, or a new one can't be
+ * created, and then sock is not used.
+ * */
+bool coro_spawn(coro_sched_t *sched, int sock) {
+    coro_t *coro = NULL;
+
+    for (unsigned int i = 0; i < sched->created && coro == NULL; i++)
+        if (sched->coros[i]->state == CORO_FREE)
+            coro = sched->coros[i];
+
+    if (coro == NULL && sched->created < sched->max) {
+        coro = coro_create();
+        if (coro != NULL)
+            sched->coros[sched->created++] = coro;
+    }
+    if (coro == NULL)
+        return false;
+
+    coro->sock = sock;
+    sched->active++;
+    coro_resume(sched, coro);
+    return true;
+}
+
+static void coro_wake(coro_sched_t *sched, coro_t *coro, int result) {
+    epoll_ctl(sched->epoll, EPOLL_CTL_DEL, coro->fd, NULL);
+    coro->result = result;
+    coro_resume(sched, coro);
+}
+
+/**
+ * Waits up to timeout milliseconds, -1 for no limit, for the file
+ * descriptors of the coroutines, and runs the ones that are ready or
+ * whose timeout expired.
+ * */
+void coro_run(coro_sched_t *sched, int timeout) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    //Doesn't sleep past the first timeout of the coroutines
+    for (unsigned int i = 0; i < sched->created; i++) {
+        coro_t *coro = sched->coros[i];
+        if (coro->state != CORO_WAITING || !coro->expires)
+            continue;
+        long long int left = (coro->deadline.tv_sec - now.tv_sec) * 1000LL + (coro->deadline.tv_nsec - now.tv_nsec) / 1000000 + 1;
+        if (left < 0)
+            left = 0;
+        if (timeout < 0 || left < timeout)
+            timeout = left;
+    }
+
+    struct epoll_event events[CORO_EVENTS];
+    int count = epoll_wait(sched->epoll, events, CORO_EVENTS, timeout);
+    for (int i = 0; i < count; i++) {
+        coro_t *coro = events[i].data.ptr;
+        coro_wake(sched, coro, 1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (unsigned int i = 0; i < sched->created; i++) {
+        coro_t *coro = sched->coros[i];
+        if (coro->state != CORO_WAITING || !coro->expires)
+            continue;
+        if (now.tv_sec > coro->deadline.tv_sec || (now.tv_sec == coro->deadline.tv_sec && now.tv_nsec >= coro->deadline.tv_nsec))
+            coro_wake(sched, coro, 0);
+    }
+}
+
+/**
+ * Returns true if the caller runs in a coroutine, and so must not block
+ * the thread, that is serving other connections.
+ * */
+bool coro_running() {
+    coro_sched_t *sched = coro_sched();
+    return sched != NULL && sched->current != NULL;
+}
+
+/**
+ * Waits for events (POLLIN or POLLOUT) on fd, for up to timeout
+ * milliseconds, -1 for no limit.
+ * In a coroutine the thread serves the other connections meanwhile,
+ * otherwise it is the same as poll().
+ * Returns 0 on timeout and a positive value if fd is ready.
+ * */
+int coro_wait(int fd, short events, int timeout) {
+    coro_sched_t *sched = coro_sched();
+
+    if (sched != NULL && sched->current != NULL) {
+        coro_t *coro = sched->current;
+        struct epoll_event event = {
+            .events = events | EPOLLONESHOT,
+            .data.ptr = coro,
+        };
+
+        if (epoll_ctl(sched->epoll, EPOLL_CTL_ADD, fd, &event) == 0) {
+            coro->fd = fd;
+            coro->expires = timeout >= 0;
+            if (coro->expires) {
+                clock_gettime(CLOCK_MONOTONIC, &coro->deadline);
+                coro->deadline.tv_sec += timeout / 1000;
+                coro->deadline.tv_nsec += (timeout % 1000) * 1000000L;
+                if (coro->deadline.tv_nsec >= 1000000000L) {
+                    coro->deadline.tv_sec++;
+                    coro->deadline.tv_nsec -= 1000000000L;
+                }
+            }
+            coro->state = CORO_WAITING;
+            swapcontext(&coro->ctx, &sched->main);
+            return coro->result;
+        }
+    }
+
+    struct pollfd monitor = { .fd = fd, .events = events };
+    return poll(&monitor, 1, timeout);
+}
+
+#else
+
+coro_sched_t *coro_init(unsigned int max, coro_fn_t fn, void (*release)(void *local)) {
+    return NULL;
+}
+
+void coro_free(coro_sched_t *sched) {
+}
+
+unsigned int coro_count(coro_sched_t *sched) {
+    return 0;
+}
+
+bool coro_spawn(coro_sched_t *sched, int sock) {
+    return false;
+}
+
+void coro_run(coro_sched_t *sched, int timeout) {
+}
+
+bool coro_running() {
+    return false;
+}
+
+int coro_wait(int fd, short events, int timeout) {
+    struct pollfd monitor = { .fd = fd, .events = events };
+    return poll(&monitor, 1, timeout);
+}
+
+#endif
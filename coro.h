@@ -0,0 +1,37 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_CORO_H
+#define WEBORF_CORO_H
+
+#include <stdbool.h>
+
+typedef struct coro_sched_t coro_sched_t;
+typedef void (*coro_fn_t)(int sock, void **local);
+
+coro_sched_t *coro_init(unsigned int max, coro_fn_t fn, void (*release)(void *local));
+void coro_free(coro_sched_t *sched);
+unsigned int coro_count(coro_sched_t *sched);
+bool coro_spawn(coro_sched_t *sched, int sock);
+void coro_run(coro_sched_t *sched, int timeout);
+bool coro_running();
+int coro_wait(int fd, short events, int timeout);
+
+#endif
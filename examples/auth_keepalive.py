@@ -0,0 +1,85 @@
+#!/usr/bin/python3
+# This is an example authentication script for weborf started with
+# --auth-keepalive. You can modify it to make it fit your needs
+
+# Weborf
+# Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+#
+# Weborf is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+
+# Every weborf thread keeps its connection open and sends many requests
+# over it. Each request and each reply is preceded by its length, as a
+# 32 bit unsigned integer in network byte order. The request is the same
+# that weborf sends to auth.py. An empty reply allows the request, any
+# other reply denies it.
+
+import asyncio
+import os
+import struct
+from typing import NamedTuple
+
+
+class Request(NamedTuple):
+    url: bytes
+    addr: bytes
+    method: bytes
+    username: bytes
+    password: bytes
+    protocol: bytes
+
+SOCKET_PATH = "/run/weborf/weborf_auth.socket"
+
+
+def check(request: Request) -> bool:
+    # Allow all from internal network
+    if request.addr.startswith(b'::ffff:10.0.'):
+        return True
+
+    # Require a password for some content
+    if request.url.startswith(b'/movies/') or request.url.startswith(b'/music/'):
+        return request.username == b'user' and request.password == b'pass'
+    # Require another password for all other content
+    return request.username == b'user2' and request.password == b'pass2'
+
+
+async def handle(reader: asyncio.StreamReader, writer: asyncio.StreamWriter) -> None:
+    try:
+        while True:
+            size = struct.unpack('!I', await reader.readexactly(4))[0]
+            fields = (await reader.readexactly(size)).split(b'\r\n')
+            request = Request(*fields[:6])
+
+            if check(request):
+                writer.write(struct.pack('!I', 0))
+            else:
+                writer.write(struct.pack('!I', 1) + b' ')
+            await writer.drain()
+    except asyncio.IncompleteReadError:
+        pass
+    writer.close()
+
+
+async def main():
+    try:
+        os.remove(SOCKET_PATH)
+    except OSError:
+        pass
+
+    server = await asyncio.start_unix_server(handle, SOCKET_PATH)
+    await server.serve_forever()
+
+
+asyncio.run(main())
@@ -0,0 +1,452 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include "options.h"
+
+#include <sys/stat.h>
+#include <syslog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <ctype.h>
+
+#ifdef HAVE_LIBCRYPT
+#include <crypt.h>
+#endif
+
+#ifdef HAVE_LIBCRYPTO
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#endif
+
+#include "htpasswd.h"
+#include "mystring.h"
+
+extern weborf_configuration_t weborf_conf;
+
+#define RULE_ALLOW 0
+#define RULE_DENY 1
+#define RULE_AUTH 2
+
+//Verified for the unknown users, when there are no users to take a hash from
+#define DUMMY_HASH "$6$weborfdummysalt$ULsJrQpgWg2gmGHICEDRC0dkGoYW.PL5w9XQlkoAhOodRszGm9psavNdpHm.7dyfYaYb1vSuhq7x9OCR6Uqsv."
+
+typedef struct {
+    char *user;
+    char *hash;                 //Hash in the format used by crypt(3)
+#ifdef HAVE_LIBCRYPTO
+    unsigned char memo[EVP_MAX_MD_SIZE];//Digest of the last password that was verified
+    unsigned int memo_len;      //Bytes of memo in use, 0 if no password was verified
+#endif
+} htpasswd_user_t;
+
+typedef struct {
+    char *prefix;               //Path prefix
+    size_t prefix_l;
+    char *methods;              //Comma separated methods, NULL for any method
+    char *addr;                 //Address prefix, NULL for any address
+    int action;
+} htpasswd_rule_t;
+
+typedef struct {
+    unsigned int refs;          //Threads using the table, plus one while it is the current table
+    size_t size;                //Slots in the table, power of 2
+    htpasswd_user_t *slots;     //Open addressing table, slots with NULL user are empty
+    htpasswd_rule_t *rules;     //Rules, the first one matching the request is used
+    size_t rules_l;
+    char *dummy_hash;           //Hash of a user, verified for the unknown ones so they take the same time
+    char *users_buf;            //Content of the files, all the strings point here
+    char *rules_buf;
+    pthread_mutex_t memo_mutex; //Protects the memo fields
+} htpasswd_table_t;
+
+static pthread_mutex_t htpasswd_mutex = PTHREAD_MUTEX_INITIALIZER;
+static htpasswd_table_t *htpasswd_current = NULL;
+
+#ifdef HAVE_LIBCRYPTO
+static unsigned char memo_secret[32];//Random, so the memo is useless outside of this process
+#endif
+
+/**
+Reads a whole file in a null terminated buffer.
+Returns NULL in case of error.
+*/
+static char *htpasswd_read_file(char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat sb;
+    char *buf = NULL;
+    if (fstat(fd, &sb) == 0 && (buf = malloc(sb.st_size + 1)) != NULL) {
+        ssize_t r = read(fd, buf, sb.st_size);
+        if (r < 0) {
+            free(buf);
+            buf = NULL;
+        } else {
+            buf[r] = 0;
+        }
+    }
+    close(fd);
+    return buf;
+}
+
+static void htpasswd_free(htpasswd_table_t *table) {
+    if (table == NULL)
+        return;
+    pthread_mutex_destroy(&table->memo_mutex);
+    free(table->slots);
+    free(table->rules);
+    free(table->users_buf);
+    free(table->rules_buf);
+    free(table);
+}
+
+static htpasswd_user_t *htpasswd_find(htpasswd_table_t *table, char *user) {
+    size_t mask = table->size - 1;
+    size_t i = string_hash(user, strlen(user)) & mask;
+
+    while (table->slots[i].user != NULL) {
+        if (strcmp(table->slots[i].user, user) == 0)
+            return &table->slots[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+Parses a file in the htpasswd format, one user:hash per line, into
+the hash table.
+Returns 0 on success.
+*/
+static int htpasswd_parse_users(htpasswd_table_t *table, char *path) {
+    table->users_buf = htpasswd_read_file(path);
+    if (table->users_buf == NULL)
+        return -1;
+
+    size_t count = 0;
+    for (char *c = table->users_buf; *c; c++)
+        if (*c == '\n')
+            count++;
+
+    //Keeps the load under 50%
+    table->size = 16;
+    while (table->size < (count + 1) * 2)
+        table->size *= 2;
+    table->slots = calloc(table->size, sizeof(htpasswd_user_t));
+    if (table->slots == NULL)
+        return -1;
+
+    char *lasts;
+    for (char *line = strtok_r(table->users_buf, "\r\n", &lasts); line; line = strtok_r(NULL, "\r\n", &lasts)) {
+        if (line[0] == '#')
+            continue;
+
+        char *hash = strchr(line, ':');
+        if (hash == NULL)
+            continue;
+        *hash++ = 0;
+
+        if (hash[0] != '$') {
+            syslog(LOG_WARNING, "%s: unsupported password format for %s, use bcrypt or sha-crypt", path, line);
+            continue;
+        }
+
+        if (htpasswd_find(table, line) != NULL)
+            continue;
+
+        size_t i = string_hash(line, strlen(line)) & (table->size - 1);
+        while (table->slots[i].user != NULL)
+            i = (i + 1) & (table->size - 1);
+        table->slots[i].user = line;
+        table->slots[i].hash = hash;
+        if (table->dummy_hash == NULL)
+            table->dummy_hash = hash;
+    }
+    return 0;
+}
+
+/**
+Parses the rules file. Every line contains:
+path_prefix methods address_prefix action
+
+methods is a comma separated list or *, address_prefix is * to match
+any address and action is one of allow, deny, auth.
+Returns 0 on success.
+*/
+static int htpasswd_parse_rules(htpasswd_table_t *table, char *path) {
+    table->rules_buf = htpasswd_read_file(path);
+    if (table->rules_buf == NULL)
+        return -1;
+
+    size_t count = 1;
+    for (char *c = table->rules_buf; *c; c++)
+        if (*c == '\n')
+            count++;
+    table->rules = calloc(count, sizeof(htpasswd_rule_t));
+    if (table->rules == NULL)
+        return -1;
+
+    char *lasts;
+    int line_n = 0;
+    for (char *line = strtok_r(table->rules_buf, "\n", &lasts); line; line = strtok_r(NULL, "\n", &lasts)) {
+        line_n++;
+        while (isspace(*line))
+            line++;
+        if (line[0] == '#' || line[0] == 0)
+            continue;
+
+        char *field[4];
+        char *l_field;
+        int n = 0;
+        for (char *f = strtok_r(line, " \t\r", &l_field); f && n < 4; f = strtok_r(NULL, " \t\r", &l_field))
+            field[n++] = f;
+
+        htpasswd_rule_t *rule = &table->rules[table->rules_l];
+        if (n != 4) {
+            syslog(LOG_ERR, "%s:%d: expected prefix methods address action", path, line_n);
+            return -1;
+        } else if (strcmp(field[3], "allow") == 0) {
+            rule->action = RULE_ALLOW;
+        } else if (strcmp(field[3], "deny") == 0) {
+            rule->action = RULE_DENY;
+        } else if (strcmp(field[3], "auth") == 0) {
+            rule->action = RULE_AUTH;
+        } else {
+            syslog(LOG_ERR, "%s:%d: unknown action %s", path, line_n, field[3]);
+            return -1;
+        }
+
+        rule->prefix = field[0];
+        rule->prefix_l = strlen(field[0]);
+        rule->methods = strcmp(field[1], "*") ? field[1] : NULL;
+        rule->addr = strcmp(field[2], "*") ? field[2] : NULL;
+        table->rules_l++;
+    }
+    return 0;
+}
+
+static htpasswd_table_t *htpasswd_load() {
+    htpasswd_table_t *table = calloc(1, sizeof(htpasswd_table_t));
+    if (table == NULL)
+        return NULL;
+    pthread_mutex_init(&table->memo_mutex, NULL);
+    table->refs = 1;
+
+    if (htpasswd_parse_users(table, weborf_conf.htpasswd) != 0) {
+        syslog(LOG_ERR, "Unable to load %s", weborf_conf.htpasswd);
+        htpasswd_free(table);
+        return NULL;
+    }
+    if (weborf_conf.auth_rules != NULL && htpasswd_parse_rules(table, weborf_conf.auth_rules) != 0) {
+        syslog(LOG_ERR, "Unable to load %s", weborf_conf.auth_rules);
+        htpasswd_free(table);
+        return NULL;
+    }
+    return table;
+}
+
+static htpasswd_table_t *htpasswd_acquire() {
+    pthread_mutex_lock(&htpasswd_mutex);
+    htpasswd_table_t *table = htpasswd_current;
+    table->refs++;
+    pthread_mutex_unlock(&htpasswd_mutex);
+    return table;
+}
+
+static void htpasswd_release(htpasswd_table_t *table) {
+    pthread_mutex_lock(&htpasswd_mutex);
+    unsigned int refs = --table->refs;
+    pthread_mutex_unlock(&htpasswd_mutex);
+    if (refs == 0)
+        htpasswd_free(table);
+}
+
+/**
+Loads the credentials and the rules, terminating the process if
+they can't be loaded.
+*/
+void htpasswd_init() {
+#ifndef HAVE_LIBCRYPT
+    fprintf(stderr, "--htpasswd is not supported, weborf was built without libcrypt\n");
+    exit(5);
+#endif
+#ifdef HAVE_LIBCRYPTO
+    RAND_bytes(memo_secret, sizeof(memo_secret));
+#endif
+    htpasswd_current = htpasswd_load();
+    if (htpasswd_current == NULL) {
+        fprintf(stderr, "Unable to load the credentials\n");
+        exit(5);
+    }
+}
+
+/**
+Loads the files again and replaces the current table.
+Requests already using the old table keep using it until they
+are done. If the files can't be loaded, the old table stays.
+*/
+void htpasswd_reload() {
+    if (htpasswd_current == NULL)
+        return;
+
+    htpasswd_table_t *table = htpasswd_load();
+    if (table == NULL)
+        return;
+
+    pthread_mutex_lock(&htpasswd_mutex);
+    htpasswd_table_t *old = htpasswd_current;
+    htpasswd_current = table;
+    pthread_mutex_unlock(&htpasswd_mutex);
+    htpasswd_release(old);
+
+    syslog(LOG_INFO, "Reloaded %s", weborf_conf.htpasswd);
+}
+
+static bool htpasswd_method_matches(char *methods, char *method) {
+    if (methods == NULL)
+        return true;
+
+    size_t l = strlen(method);
+    for (char *m = methods; m; m = strchr(m, ',')) {
+        if (m[0] == ',')
+            m++;
+        if (strncmp(m, method, l) == 0 && (m[l] == ',' || m[l] == 0))
+            return true;
+    }
+    return false;
+}
+
+/**
+Checks the password of the user. The digest of the last password that
+was verified is remembered, so the expensive hashing only runs when the
+password changes.
+
+For unknown users a hash of another user is verified anyway, otherwise
+the faster answer would tell which users exist.
+*/
+static int htpasswd_check_password(htpasswd_table_t *table, char *username, char *password) {
+#ifdef HAVE_LIBCRYPT
+    htpasswd_user_t *user = htpasswd_find(table, username);
+    if (user == NULL) {
+        struct crypt_data *data = calloc(1, sizeof(struct crypt_data));
+        if (data != NULL)
+            crypt_r(password, table->dummy_hash ? table->dummy_hash : DUMMY_HASH, data);
+        free(data);
+        return -1;
+    }
+
+#ifdef HAVE_LIBCRYPTO
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == NULL)
+        return -1;
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    EVP_DigestUpdate(ctx, memo_secret, sizeof(memo_secret));
+    EVP_DigestUpdate(ctx, password, strlen(password));
+    EVP_DigestFinal_ex(ctx, digest, &digest_len);
+    EVP_MD_CTX_free(ctx);
+
+    pthread_mutex_lock(&table->memo_mutex);
+    bool memo_hit = digest_len != 0 && user->memo_len == digest_len && CRYPTO_memcmp(user->memo, digest, digest_len) == 0;
+    pthread_mutex_unlock(&table->memo_mutex);
+    if (memo_hit)
+        return 0;
+#endif
+
+    struct crypt_data *data = calloc(1, sizeof(struct crypt_data));
+    if (data == NULL)
+        return -1;
+
+    int result = -1;
+    char *hashed = crypt_r(password, user->hash, data);
+    if (hashed != NULL && hashed[0] != '*' && strcmp(hashed, user->hash) == 0)
+        result = 0;
+    free(data);
+
+#ifdef HAVE_LIBCRYPTO
+    if (result == 0 && digest_len != 0) {
+        pthread_mutex_lock(&table->memo_mutex);
+        memcpy(user->memo, digest, digest_len);
+        user->memo_len = digest_len;
+        pthread_mutex_unlock(&table->memo_mutex);
+    }
+#endif
+    return result;
+#else
+    return -1;
+#endif
+}
+
+/**
+Returns true if the client address matches the address of a rule: the
+same address, or a beginning of it made of whole components, so that
+10.0.0.1 doesn't match 10.0.0.10.
+*/
+static bool htpasswd_addr_matches(char *addr, char *ip_addr) {
+    if (addr == NULL)
+        return true;
+
+    size_t l = strlen(addr);
+    if (strncmp(ip_addr, addr, l) != 0)
+        return false;
+    return ip_addr[l] == 0 || ip_addr[l] == '.' || ip_addr[l] == ':' || addr[l - 1] == '.' || addr[l - 1] == ':';
+}
+
+/**
+Decides about a request using the rules and the credentials.
+Requests not matching any rule require a valid user.
+Returns 0 to allow the request, -1 to deny it.
+*/
+int htpasswd_check(char *page, char *ip_addr, char *method, char *username, char *password) {
+    htpasswd_table_t *table = htpasswd_acquire();
+    int action = RULE_AUTH;
+
+    for (size_t i = 0; i < table->rules_l; i++) {
+        htpasswd_rule_t *rule = &table->rules[i];
+        if (strncmp(page, rule->prefix, rule->prefix_l) == 0 &&
+                htpasswd_method_matches(rule->methods, method) &&
+                htpasswd_addr_matches(rule->addr, ip_addr)) {
+            action = rule->action;
+            break;
+        }
+    }
+
+    int result;
+    switch (action) {
+    case RULE_ALLOW:
+        result = 0;
+        break;
+    case RULE_AUTH:
+        result = username[0] ? htpasswd_check_password(table, username, password) : -1;
+        break;
+    default:
+        result = -1;
+    }
+
+    htpasswd_release(table);
+    return result;
+}
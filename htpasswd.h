@@ -0,0 +1,31 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_HTPASSWD_H
+#define WEBORF_HTPASSWD_H
+
+#include "options.h"
+#include "types.h"
+
+void htpasswd_init();
+void htpasswd_reload();
+int htpasswd_check(char *page, char *ip_addr, char *method, char *username, char *password);
+
+#endif
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 @author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
 @author Salvo Rinaldi <salvin@anche.no>
  */
+#define _GNU_SOURCE //For mkostemp() and fallocate()
 #include "options.h"
 
 #include <time.h>
@@ -38,10 +39,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <pthread.h>
 #include <sys/un.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <limits.h>
+#include <stdint.h>
 
 #include "utils.h"
 #include "myio.h"
 #include "cgi.h"
+#include "scgi.h"
 #include "queue.h"
 #include "mystring.h"
 #include "mime.h"
@@ -50,8 +56,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "types.h"
 #include "auth.h"
 #include "mynet.h"
-
-extern syn_queue_t queue;                   //Queue for open sockets
+#include "vhost.h"
+#include "configuration.h"
+#include "affinity.h"
+#include "park.h"
+#include "uring.h"
+#include "cachecontrol.h"
+#include "upload.h"
+#include "treewalk.h"
+#include "coro.h"
+
+extern syn_queue_t *queues;                 //Queues for open sockets, one for each NUMA node
 
 extern t_thread_info thread_info;
 
@@ -60,6 +75,12 @@ extern weborf_configuration_t weborf_conf;
 extern char* indexes[MAXINDEXCOUNT];        //Array containing index files
 extern int indexes_l;                       //Length of array
 extern pthread_key_t thread_key;            //key for pthread_setspecific
+extern atomic_bool draining;                //The server is stopping
+
+typedef struct {
+    unsigned long long int from;    //First byte
+    unsigned long long int to;      //Last byte, included
+} byte_range_t;
 
 
 int request_auth(connection_t *connection_prop);
@@ -67,30 +88,101 @@ void piperr();
 int write_dir(char *real_basedir, connection_t * connection_prop);
 static int send_page(buffered_read_t* read_b, connection_t* connection_prop);
 static int send_error_header(int retval, connection_t *connection_prop);
-static int get_or_post(connection_t *connection_prop, string_t post_param);
+static int send_err_headers(connection_t *connection_prop, int err, char* descr, char* headers);
+static int http_header(int code, unsigned long long int *size,char* headers,bool content,struct stat *st,connection_t* connection_prop,char *head);
+static int get_or_post(connection_t *connection_prop, string_t post_param, buffered_read_t* read_b);
+static inline int cgi_index(connection_t *connection_prop);
+static inline void release_basedir(connection_t *connection_prop);
+static bool parse_position(const char **s, unsigned long long int *value);
+
+/**
+Returns true if the list of entity tags of an If-Match or If-None-Match
+header contains etag, or is "*". The list is modified.
+Weak tags only match if weak is true, as in If-None-Match.
+*/
+static bool etag_listed(char *list, const char *etag, bool weak) {
+    size_t etag_len = strlen(etag);
+    char *save;
+
+    for (char *tag = strtok_r(list, ",", &save); tag != NULL; tag = strtok_r(NULL, ",", &save)) {
+        while (*tag == ' ' || *tag == '\t')
+            tag++;
+        if (tag[0] == '*')
+            return true;
+        if (tag[0] == 'W' && tag[1] == '/') {
+            if (!weak)
+                continue;
+            tag += 2;
+        }
+        if (strncmp(tag, etag, etag_len) == 0 && (tag[etag_len] == 0 || tag[etag_len] == ' ' || tag[etag_len] == '\t'))
+            return true;
+    }
+    return false;
+}
 
 /**
-Checks if the required resource has the same date as the one cached in the client.
-If they are the same, returns 0,
+Evaluates If-Match, If-Unmodified-Since, If-None-Match and If-Modified-Since
+against connection_prop->strfile_stat, in the order given by RFC 7232.
+Returns 0 if the resource must be sent, or the status code to send instead:
+304 if the copy cached in the client is still valid, 412 if a precondition
+failed.
+*/
+static int check_preconditions(connection_t* connection_prop) {
+    char *if_match="If-Match";
+    char *if_unmodified_since="If-Unmodified-Since";
+    char *if_none_match="If-None-Match";
+    char *if_modified_since="If-Modified-Since";
+    char a[RBUFFER]; //Buffer for the headers
+    char etag[ETAGLEN];
+    time_t mtime = connection_prop->strfile_stat.st_mtime;
+
+    format_etag(&connection_prop->strfile_stat, etag, sizeof(etag));
+
+    if (get_param_value(connection_prop->http_param,if_match,a,sizeof(a),strlen(if_match))) {
+        if (!etag_listed(a, etag, false))
+            return 412;
+    } else if (get_param_value(connection_prop->http_param,if_unmodified_since,a,sizeof(a),strlen(if_unmodified_since))) {
+        time_t since = parse_http_date(a);
+        if (since != -1 && mtime > since)
+            return 412;
+    }
+
+    if (get_param_value(connection_prop->http_param,if_none_match,a,sizeof(a),strlen(if_none_match))) {
+        if (etag_listed(a, etag, true))
+            return connection_prop->method_id == GET ? 304 : 412;
+    } else if (connection_prop->method_id == GET && get_param_value(connection_prop->http_param,if_modified_since,a,sizeof(a),strlen(if_modified_since))) {
+        time_t since = parse_http_date(a);
+        if (since != -1 && mtime <= since)
+            return 304;
+    }
+    return 0;
+}
+
+/**
+Checks the preconditions of the request on the resource.
+If they say that the resource must not be sent, returns 0,
 returns 1 otherwise
 
-If the ETag matches this function will send to the client a 304 response too, so
+If the copy cached in the client is still valid this function will send
+to the client a 304 response too, or a 412 if a precondition failed, so
 if this function returns 0, the HTTP request has been already served.
-
-The char* buffer must be at least RBUFFER bytes (see definitions in options.h)
 */
-static inline int check_etag(connection_t* connection_prop,char *a) {
-    //Find if it is a range request, 13 is strlen of "if-none-match"
-    char *if_none_match="If-None-Match";
-    if (get_param_value(connection_prop->http_param,if_none_match,a,RBUFFER,strlen(if_none_match))) {
-        time_t etag=(time_t)strtol(a+1,NULL,0);
-        if (connection_prop->strfile_stat.st_mtime==etag) {
-            //Browser has the item in its cache, sending 304
-            send_http_header(304, NULL, NULL, true, etag, connection_prop);
-            return 0;
-        }
+static inline int check_etag(connection_t* connection_prop) {
+    int code = check_preconditions(connection_prop);
+    if (code == 0)
+        return 1;
+
+    if (code == 304) {
+        //Browser has the item in its cache, sending 304 with the caching policy
+        char headers[CACHECONTROLLEN+HTTPDATELEN+16];
+        headers[0] = 0;
+        cachecontrol_header(connection_prop->page, connection_prop->strfile, NULL, headers, sizeof(headers));
+        send_http_header(304, NULL, headers, true, &connection_prop->strfile_stat, connection_prop);
+    } else {
+        unsigned long long int size_zero = 0;
+        send_http_header(code, &size_zero, NULL, true, NULL, connection_prop);
     }
-    return 1;
+    return 0;
 }
 
 /**
@@ -127,18 +219,53 @@ static inline void set_connection_props(connection_t *connection_prop) {
     split_get_params(connection_prop);//Splits URI into page and parameters
     modURL(connection_prop->page, false);//Operations on the url string
     modURL(connection_prop->get_params, true);
-    connection_prop->basedir=get_basedir(connection_prop->http_param);
+    get_basedir(connection_prop);
 }
 
-static inline void handle_requests(char* buf,buffered_read_t * read_b,int * bufFull,connection_t* connection_prop,long int id) {
+/**
+Returns true if the client has not sent anything after the last request,
+so the connection can wait for it without holding the thread.
+*/
+static inline bool connection_idle(fd_t sock, buffered_read_t *read_b) {
+    if (park_fd() == -1 || !buffer_empty(read_b))
+        return false;
+
+#ifdef HAVE_LIBSSL
+    if (sock.ssl && SSL_pending(sock.ssl) > 0)
+        return false;
+    struct pollfd monitor = { .fd = sock.fd, .events = POLLIN };
+#else
+    struct pollfd monitor = { .fd = sock, .events = POLLIN };
+#endif
+    //The next request might be already there, no need to park then
+    return poll(&monitor, 1, 0) == 0;
+}
+
+/**
+Serves the requests of a connection. buf is the buffer for the request
+header, of buf_size bytes plus the terminator.
+Returns true if the connection is idle between two requests, with no
+data buffered, and can be parked until the client sends the next one.
+*/
+static inline bool handle_requests(char* buf,size_t buf_size,buffered_read_t * read_b,int * bufFull,connection_t* connection_prop,long int id) {
     int from;
     fd_t sock = connection_prop->sock;
     char *lasts;//Used by strtok_r
 
     short int r; //Readed char
     char *end; //Pointer to header's end
+    bool served = false; //A request was already served on this connection
 
     while (true) { //Infinite cycle to handle all pipelined requests
+        if (served && connection_idle(sock, read_b))
+            return true;
+        served = true;
+
+        //Every request uses the tunables that are current when it starts
+        tunables_release(connection_prop->tunables);
+        connection_prop->tunables = tunables_acquire();
+        read_b->timeout = connection_prop->tunables->read_timeout;
+
         if ((*bufFull)!=0) {
             memset(buf,0,(*bufFull));//Sets to 0 the buffer, only the part used for the previous request in the same connection
             (*bufFull)=0;
@@ -149,7 +276,7 @@ static inline void handle_requests(char* buf,buffered_read_t * read_b,int * bufF
             r=buffer_read(sock, buf+(*bufFull),2,read_b);//Reads 2 char and adds to the buffer
 
             if (r<=0) { //Connection closed or error
-                return;
+                return false;
             }
 
             if (!(buf[*bufFull]==10 || buf[*bufFull]==13)) {//Optimization to make strstr parse only the ending part of the string
@@ -159,7 +286,7 @@ static inline void handle_requests(char* buf,buffered_read_t * read_b,int * bufF
             (*bufFull)+=r;//Sets the end of the user buffer (may contain more than one header)
 
             //Buffer full and still no valid http header
-            if ((*bufFull)>=INBUFFER) goto bad_request;
+            if ((*bufFull)>=buf_size) goto bad_request;
 
         }
 
@@ -197,7 +324,13 @@ static inline void handle_requests(char* buf,buffered_read_t * read_b,int * bufF
         //Stores the parameters of the request
         set_connection_props(connection_prop);
 
-        if (send_page(read_b, connection_prop) < 0) {
+        //The server is stopping, the next request must go to a new connection
+        if (atomic_load(&draining))
+            connection_prop->keep_alive = false;
+
+        int sent = send_page(read_b, connection_prop);
+        release_basedir(connection_prop);
+        if (sent < 0) {
 #ifdef REQUESTDBG
             syslog(LOG_INFO,
                    "%s - FAILED - %s %s",
@@ -205,7 +338,7 @@ static inline void handle_requests(char* buf,buffered_read_t * read_b,int * bufF
                    connection_prop->method,
                    connection_prop->page);
 #endif
-            return; //Unable to send an error
+            return false; //Unable to send an error
         }
 
 #ifdef REQUESTDBG
@@ -220,7 +353,7 @@ static inline void handle_requests(char* buf,buffered_read_t * read_b,int * bufF
 
 
         //Non pipelined
-        if (connection_prop->keep_alive==false) return;
+        if (connection_prop->keep_alive==false) return false;
 
     } /* while */
 
@@ -229,7 +362,7 @@ bad_request:
 #ifdef REQUESTDBG
     syslog(LOG_INFO, "%s - %d", connection_prop->ip_addr, connection_prop->status_code);
 #endif
-    return;
+    return false;
 }
 
 /**
@@ -247,6 +380,175 @@ void change_free_thread(long int id,int free_d, int count_d) {
     pthread_mutex_unlock(&thread_info.mutex);
 }
 
+/**
+Buffers and state of the connection being served by a thread, or by
+one of its coroutines.
+*/
+typedef struct {
+    int bufFull;                    //Amount of buf used
+    size_t buf_size;
+    char *buf;                      //Buffer to contain the HTTP request
+    connection_t connection_prop;   //Struct to contain properties of the connection
+    buffered_read_t read_b;         //Buffer for buffered reader
+} session_t;
+
+static void session_free(void *data) {
+    session_t *session = data;
+    free(session->buf);
+    free(session->connection_prop.strfile);
+    buffer_free(&session->read_b);
+    free(session);
+}
+
+/**
+Allocates the buffers for serving the connections, sized by the
+current tunables. Returns NULL if there is not enough memory.
+*/
+static session_t *session_new() {
+    session_t *session = calloc(1, sizeof(session_t));
+    if (session == NULL)
+        return NULL;
+
+    weborf_tunables_t *tunables=tunables_acquire();
+    session->buf_size=tunables->request_buffer;
+    session->buf=calloc(session->buf_size+1,sizeof(char));
+    session->connection_prop.strfile=malloc(URI_LEN);        //buffer for filename
+    int init_failed = buffer_init(&session->read_b, tunables->reader_buffer);
+    tunables_release(tunables);
+
+    if (init_failed != 0 || session->buf == NULL || session->connection_prop.strfile == NULL) { //Unable to allocate the buffer
+#ifdef SERVERDBG
+        syslog(LOG_CRIT, "Not enough memory to allocate buffers for new thread");
+#endif
+        session_free(session);
+        return NULL;
+    }
+    return session;
+}
+
+/**
+Serves the requests of sock, then closes it or parks it until the
+client sends the next request.
+*/
+static void serve_connection(session_t *session, int sock) {
+    connection_t *connection_prop = &session->connection_prop;
+    thread_prop_t *thread_prop = pthread_getspecific(thread_key);
+
+    net_getpeername(sock, connection_prop->ip_addr);
+
+#ifdef HAVE_LIBSSL
+    connection_prop->sock.fd = sock;
+
+    if (park_resume(&connection_prop->sock)) {
+        //Parked connection, the TLS session is already established
+    } else if (weborf_conf.sslctx) {
+        connection_prop->sock.ssl = SSL_new(weborf_conf.sslctx);
+        SSL_set_fd(connection_prop->sock.ssl, sock);
+
+        weborf_tunables_t *tunables = tunables_acquire();
+        int accepted = myio_ssl_accept(connection_prop->sock.ssl, tunables->read_timeout);
+        tunables_release(tunables);
+        if (accepted != 1) {
+            syslog(LOG_INFO, "SSL connection failed from %s", connection_prop->ip_addr);
+            goto closeconnection;
+        }
+    } else {
+        connection_prop->sock.ssl = NULL;
+    }
+#else
+    connection_prop->sock = sock;
+    park_resume(&connection_prop->sock);
+#endif
+
+
+#ifdef THREADDBG
+    syslog(LOG_DEBUG, "Thread %ld: Reading from socket", thread_prop->id);
+#endif
+    bool idle = handle_requests(session->buf, session->buf_size, &session->read_b, &session->bufFull, connection_prop, thread_prop->id);
+    tunables_release(connection_prop->tunables);
+    connection_prop->tunables = NULL;
+
+    //Waits for the next request without holding the thread
+    if (idle && park_connection(connection_prop->sock)) {
+        buffer_reset(&session->read_b);
+        return;
+    }
+
+closeconnection:
+#ifdef THREADDBG
+    syslog(LOG_DEBUG, "Thread %ld: Closing socket with client", thread_prop->id);
+#endif
+
+#ifdef HAVE_LIBSSL
+    if (weborf_conf.sslctx) {
+        SSL_shutdown(connection_prop->sock.ssl);
+        SSL_free(connection_prop->sock.ssl);
+    }
+#endif
+    close(sock); //Closing the socket
+    buffer_reset(&session->read_b);
+}
+
+/**
+Serves a connection in a coroutine. Every coroutine allocates its
+buffers the first time, and keeps them for the next connections.
+*/
+static void serve_coroutine(int sock, void **local) {
+    if (*local == NULL)
+        *local = session_new();
+
+    if (*local == NULL)
+        close(sock);
+    else
+        serve_connection(*local, sock);
+}
+
+/**
+Takes the sockets from the queue and serves them in coroutines, so that
+while a client is slow the thread serves the others.
+Returns after a termination order, when all of its connections are done.
+*/
+static void coroutine_loop(thread_prop_t *thread_prop, syn_queue_t *queue) {
+    bool stopping = false;
+    bool busy = false;
+
+    change_free_thread(thread_prop->id, 1, 0);
+
+    while (!stopping || coro_count(thread_prop->coro) > 0) {
+        unsigned int active = coro_count(thread_prop->coro);
+        bool room = !stopping && active < weborf_conf.coroutines;
+
+        if (room) {
+            int sock;
+            bool got = true;
+            //Only waits on the queue when it has nothing else to do
+            if (active == 0)
+                q_get(queue, &sock);
+            else
+                got = q_try_get(queue, &sock) == 0;
+
+            if (got && !busy) {
+                change_free_thread(thread_prop->id, -1, 0);//Sets this thread as busy
+                busy = true;
+            }
+
+            if (got && sock < 0) //Was not a socket but a termination order
+                stopping = true;
+            else if (got && !coro_spawn(thread_prop->coro, sock))
+                close(sock);
+        }
+
+        //Looks at the queue again after a while, if there is room for more
+        if (coro_count(thread_prop->coro) > 0)
+            coro_run(thread_prop->coro, room ? COROUTINE_POLL : -1);
+
+        if (!stopping && busy && coro_count(thread_prop->coro) == 0) {
+            change_free_thread(thread_prop->id, 1, 0);//Sets this thread as free
+            busy = false;
+        }
+    }
+}
+
 /**
 Function executed at the beginning of the thread
 Takes open sockets from the queue and serves the requests
@@ -258,100 +560,208 @@ void * instance(void * nulla) {
 
     //General init of the thread
     thread_prop.id=(long int)nulla;//Set thread's id
+    thread_prop.auth_sock=-1;
+    thread_prop.uring=NULL;
+    thread_prop.coro=NULL;
+
+    //Before allocating the buffers, so they are on the node of the thread
+    unsigned int node = affinity_pin(thread_prop.id);
 #ifdef THREADDBG
     syslog(LOG_DEBUG,"Starting thread %ld",thread_prop.id);
 #endif
 
-    //Vars
-    int bufFull=0;                                  //Amount of buf used
-    connection_t connection_prop;                   //Struct to contain properties of the connection
-    buffered_read_t read_b;                         //Buffer for buffered reader
-    int sock=0;                                     //Socket with the client
-    char * buf=calloc(INBUFFER+1,sizeof(char));     //Buffer to contain the HTTP request
-    connection_prop.strfile=malloc(URI_LEN);        //buffer for filename
-
     signal(SIGPIPE, SIG_IGN);//Ignores SIGPIPE
 
-#ifdef IPV6
-    struct sockaddr_in6 addr;//Local and remote address
-    socklen_t addr_l=sizeof(struct sockaddr_in6);
-#else
-    struct sockaddr_in addr;
-    int addr_l=sizeof(struct sockaddr_in);
-#endif
+    if (weborf_conf.coroutines) {
+        thread_prop.coro = coro_init(weborf_conf.coroutines, serve_coroutine, session_free);
+        if (thread_prop.coro != NULL) {
+            coroutine_loop(&thread_prop, &queues[node]);
+            goto release_resources;
+        }
+    } else {
+        //The sockets of the coroutines are non blocking, io_uring is not used for them
+        thread_prop.uring = uring_init(URING_BUFFER);
+    }
 
-    if (buffer_init(&read_b, BUFFERED_READER_SIZE) != 0 || buf == NULL || connection_prop.strfile == NULL) { //Unable to allocate the buffer
-#ifdef SERVERDBG
-        syslog(LOG_CRIT, "Not enough memory to allocate buffers for new thread");
-#endif
+    int sock=0;                                     //Socket with the client
+    session_t *session = session_new();
+    if (session == NULL)
         goto release_resources;
-    }
 
     //Start accepting sockets
     change_free_thread(thread_prop.id, 1, 0);
 
     while (true) {
-        q_get(&queue, &sock);//Gets a socket from the queue
+        q_get(&queues[node], &sock);//Gets a socket from the queue
         change_free_thread(thread_prop.id, -1, 0);//Sets this thread as busy
 
         if (sock<0) { //Was not a socket but a termination order
-            goto release_resources;
+            break;
         }
 
-        net_getpeername(sock, connection_prop.ip_addr);
-
-#ifdef HAVE_LIBSSL
-        connection_prop.sock.fd = sock;
+        serve_connection(session, sock);
+        change_free_thread(thread_prop.id, 1, 0);//Sets this thread as free
+    }
+    session_free(session);
 
-        if (weborf_conf.sslctx) {
-            connection_prop.sock.ssl = SSL_new(weborf_conf.sslctx);
-            SSL_set_fd(connection_prop.sock.ssl, sock);
-            if (SSL_accept(connection_prop.sock.ssl) != 1) {
-                syslog(LOG_INFO, "SSL connection failed from %s", connection_prop.ip_addr);
-                goto closeconnection;
-            }
-        } else {
-            connection_prop.sock.ssl = NULL;
-        }
-#else
-    connection_prop.sock = sock;
+release_resources:
+#ifdef THREADDBG
+    syslog(LOG_DEBUG,"Terminating thread %ld",thread_prop.id);
 #endif
+    auth_release_thread(&thread_prop);
+    uring_free(thread_prop.uring);
+    coro_free(thread_prop.coro);
+    change_free_thread(thread_prop.id,0,-1);//Reduces count of threads
+    pthread_exit(0);
+    return NULL;//Never reached
+}
+
+/**
+Returns true if the client waits for a 100 Continue response before
+sending the body of the request.
+*/
+static bool expects_continue(connection_t* connection_prop) {
+    char a[NBUFFER]; //Buffer for Expect
+    char *expect="Expect";
 
+    return connection_prop->protocol_version == HTTP_1_1 &&
+           get_param_value(connection_prop->http_param,expect,a,sizeof(a),strlen(expect)) &&
+           strcasecmp(a, "100-continue") == 0;
+}
 
-#ifdef THREADDBG
-        syslog(LOG_DEBUG, "Thread %ld: Reading from socket", thread_prop.id);
+/**
+Copies count bytes of the request body to the file fd, reading them with
+the buffered reader. Used when splice(2) can't receive them.
+Returns the bytes copied.
+*/
+static long long int read_file_copy(connection_t* connection_prop, buffered_read_t* read_b, int fd, long long int count) {
+    size_t buf_size = connection_prop->tunables->file_buffer;
+    char* buf=malloc(buf_size);//Buffer to read from the socket
+    if (buf==NULL) {
+#ifdef SERVERDBG
+        syslog(LOG_CRIT,"Not enough memory to allocate buffers");
 #endif
-        handle_requests(buf, &read_b, &bufFull, &connection_prop, thread_prop.id);
+        return 0;
+    }
 
-closeconnection:
-#ifdef THREADDBG
-        syslog(LOG_DEBUG, "Thread %ld: Closing socket with client", thread_prop.id);
-#endif
+    long long int tot_read=0;
+    long long int to_read;
 
-#ifdef HAVE_LIBSSL
-    if (weborf_conf.sslctx) {
-        SSL_shutdown(connection_prop.sock.ssl);
-        SSL_free(connection_prop.sock.ssl);
+    while ((to_read=(count-tot_read)>buf_size?buf_size:count-tot_read)>0) {
+        ssize_t read_=buffer_read(connection_prop->sock,buf,to_read,read_b);
+        if (read_<=0 || write(fd,buf,read_)!=read_)
+            break;
+        tot_read += read_;
     }
-#endif
-        close(sock); //Closing the socket
-        buffer_reset(&read_b);
 
-        change_free_thread(thread_prop.id, 1, 0);//Sets this thread as free
+    free(buf);
+    return tot_read;
+}
+
+/**
+Writes count bytes of the request body to the file fd, at its current
+position. The request is accepted, so if the client waits for a
+100 Continue before sending the body, it is sent here.
+Returns the bytes written.
+*/
+static long long int read_file_body(connection_t* connection_prop, buffered_read_t* read_b, int fd, long long int count) {
+    fd_t sock = connection_prop->sock;
+
+    if (expects_continue(connection_prop)) {
+        char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+        myio_write(sock, cont, strlen(cont));
     }
 
+    //Data that arrived together with the header
+    long long int received = buffer_flush(fd, count, read_b);
+    if (received >= 0 && received < count) {
+        long long int spliced = fd_receive(sock, fd, count - received, read_b->timeout);
+        if (spliced == -1)
+            spliced = read_file_copy(connection_prop, read_b, fd, count - received);
+        received += spliced;
+    }
+    return received;
+}
 
+/**
+Handles a PUT request with a Content-Range header, that sends a part of a
+file, or with an asterisk instead of the range and no body, that asks
+which parts the server has.
+
+The parts are written in a staging file next to the destination, the
+destination followed by PUT_PARTIAL_SUFFIX, that replaces it when all
+the parts have arrived. Until then, the response is a 202 with a Range
+header listing the parts received, so the client can resume an
+interrupted upload by sending only the missing ones.
+*/
+static int read_file_part(connection_t* connection_prop, buffered_read_t* read_b, char *content_range, long long int content_l, struct stat *existed) {
+    unsigned long long int from = 0, to = 0, total;
+    const char *p = content_range;
+    bool query = false;
 
-release_resources:
-#ifdef THREADDBG
-    syslog(LOG_DEBUG,"Terminating thread %ld",thread_prop.id);
+    //bytes from-to/total or bytes */total
+    if (strncmp(p, "bytes ", 6) != 0)
+        return ERR_NODATA;
+    p += 6;
+    if (*p == '*') {
+        p++;
+        query = true;
+    } else if (!parse_position(&p, &from) || *p++ != '-' || !parse_position(&p, &to)) {
+        return ERR_NODATA;
+    }
+    if (*p++ != '/' || !parse_position(&p, &total) || *p != 0)
+        return ERR_NODATA;
+    if (query ? content_l != 0 : (from > to || to >= total || to - from + 1 != (unsigned long long int) content_l))
+        return ERR_NODATA;
+
+    char stage[URI_LEN+sizeof(PUT_PARTIAL_SUFFIX)];
+    char range[UPLOADRANGELEN];
+    int state;
+    snprintf(stage, sizeof(stage), "%s" PUT_PARTIAL_SUFFIX, connection_prop->strfile);
+
+    //Parts of another upload of the same file are refused before writing them
+    state = upload_status(stage, total, range, sizeof(range));
+    if (!query && state == UPLOAD_PARTIAL) {
+        int fd = open(stage, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (fd == -1)
+            return ERR_FILENOTFOUND;
+        if (existed) //Keeps the permissions of the file being replaced
+            fchmod(fd, existed->st_mode & 07777);
+
+#ifdef HAVE_FALLOCATE
+        //Reserves the space of the part, without changing the size of the file
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, from, content_l) == -1 && (errno == ENOSPC || errno == EDQUOT)) {
+            close(fd);
+            return ERR_INSUFFICIENT_STORAGE;
+        }
 #endif
-    free(buf);
-    free(connection_prop.strfile);
-    buffer_free(&read_b);
-    change_free_thread(thread_prop.id,0,-1);//Reduces count of threads
-    pthread_exit(0);
-    return NULL;//Never reached
+
+        long long int received = -1;
+        if (lseek(fd, from, SEEK_SET) != -1)
+            received = read_file_body(connection_prop, read_b, fd, content_l);
+        if (close(fd) != 0 || received != content_l)
+            return ERR_BRKPIPE;
+
+        state = upload_record(stage, connection_prop->strfile, from, to, total, range, sizeof(range));
+    }
+
+    switch (state) {
+    case UPLOAD_COMPLETE:
+        return existed ? OK_NOCONTENT : OK_CREATED;
+    case UPLOAD_PARTIAL: {
+        char headers[UPLOADRANGELEN + 16];
+        unsigned long long int size_zero = 0;
+        headers[0] = 0;
+        if (range[0]) //Nothing was received yet otherwise
+            snprintf(headers, sizeof(headers), "Range: %s\r\n", range);
+        send_http_header(202, &size_zero, headers, true, NULL, connection_prop);
+        return 0;
+    }
+    case UPLOAD_CONFLICT:
+        return ERR_CONFLICT;
+    default:
+        return ERR_BRKPIPE;
+    }
 }
 
 /**
@@ -360,76 +770,86 @@ This function handles a PUT request.
 It requires the socket, connection_t struct and buffered_read_t to read from
 the socket, since the reading is internally buffered.
 
+The body is written to a temporary file in the same directory, that
+replaces the destination only once it is complete, so an aborted upload
+leaves the previous file untouched. The data already read with the header
+is written first, and the rest goes from the socket to the file with
+splice(2) when possible.
+
+When the request is refused before reading the body, the connection is
+not kept alive, so the body is never parsed as a request.
+
 PUT size has no hardcoded limits.
 Auth provider has to check for the file's size and refuse it if it is the case.
 This function will not work if there is no auth provider.
 */
 int read_file(connection_t* connection_prop,buffered_read_t* read_b) {
-    fd_t sock = connection_prop->sock;
-    if (weborf_conf.authsock==NULL) {
-        return ERR_NOT_ALLOWED;
-    }
-
     char a[NBUFFER]; //Buffer for field's value
     int retval;
     long long int content_l;  //Length of the put data
+    struct stat st;
 
-    //Gets the value of content-length header
-    bool r=get_param_value(connection_prop->http_param,"Content-Length", a,NBUFFER,strlen("Content-Length"));//14 is content-length's len
+    //The body is not read if the request is refused
+    bool keep_alive = connection_prop->keep_alive;
+    connection_prop->keep_alive = false;
 
+    if (!connection_prop->vhost->auth) {
+        return ERR_NOT_ALLOWED;
+    }
 
-    if (r!=false) {//If there is no content-length returns error
-        content_l=strtoll( a , NULL, 0 );
+    //Gets the value of content-length header
+    if (get_param_value(connection_prop->http_param,"Content-Length", a,NBUFFER,strlen("Content-Length"))) {
+        char *end;
+        content_l=strtoll(a, &end, 10);
+        if (end == a || *end != 0 || content_l < 0)
+            return ERR_NODATA;
     } else {//No data
         return ERR_NODATA;
     }
 
     //Checks if file already exists or not (needed for response code)
-    if (file_exists(connection_prop->strfile)) {//Resource already existed (No content)
-        retval=OK_NOCONTENT;
-    } else {//Resource was created (Created)
-        retval=OK_CREATED;
+    bool existed = stat(connection_prop->strfile, &st) == 0;
+    if (existed && S_ISDIR(st.st_mode)) {
+        return ERR_NOT_ALLOWED;
+    }
+    retval = existed ? OK_NOCONTENT : OK_CREATED;
+
+    //Part of a resumable upload
+    char content_range[RBUFFER];
+    if (get_param_value(connection_prop->http_param,"Content-Range",content_range,sizeof(content_range),strlen("Content-Range"))) {
+        retval = read_file_part(connection_prop, read_b, content_range, content_l, existed ? &st : NULL);
+        if (retval >= 0) //The body was read
+            connection_prop->keep_alive = keep_alive;
+        return retval;
     }
 
-    int fd=open(connection_prop->strfile,O_WRONLY|O_CREAT,S_IRUSR|S_IWUSR);
+    char tmp[URI_LEN+sizeof(PUT_TEMP_SUFFIX)];
+    snprintf(tmp, sizeof(tmp), "%s" PUT_TEMP_SUFFIX, connection_prop->strfile);
+    int fd=mkostemp(tmp, O_CLOEXEC);
     if (fd == -1) {
         return ERR_FILENOTFOUND;
     }
+    if (existed) //Keeps the permissions of the file being replaced
+        fchmod(fd, st.st_mode & 07777);
 
-    if (ftruncate(fd, content_l) == -1) {
+#ifdef HAVE_FALLOCATE
+    //Reserves the space, so the disk can't fill up halfway
+    if (content_l > 0 && fallocate(fd, 0, 0, content_l) == -1 && (errno == ENOSPC || errno == EDQUOT)) {
         close(fd);
-        return ERR_NOMEM;
+        unlink(tmp);
+        return ERR_INSUFFICIENT_STORAGE;
     }
-
-    char* buf=malloc(FILEBUF);//Buffer to read from file
-    if (buf==NULL) {
-#ifdef SERVERDBG
-        syslog(LOG_CRIT,"Not enough memory to allocate buffers");
 #endif
-        close(fd);
-        return ERR_NOMEM;
-    }
-
-    long long int read_,write_;
-    long long int tot_read=0;
-    long long int to_read;
-
-    while ((to_read=(content_l-tot_read)>FILEBUF?FILEBUF:content_l-tot_read)>0) {
-        read_=buffer_read(sock,buf,to_read,read_b);
-        write_=write(fd,buf,read_);
 
-        if (write_!=read_) {
-            retval = ERR_BRKPIPE;
-            break;
-        }
+    long long int received = read_file_body(connection_prop, read_b, fd, content_l);
 
-        tot_read += read_;
+    if (close(fd) == 0 && received == content_l && rename(tmp, connection_prop->strfile) == 0) {
+        connection_prop->keep_alive = keep_alive;
+        return retval;
     }
 
-    free(buf);
-    close(fd);
-
-    return retval;
+    unlink(tmp);
+    return ERR_BRKPIPE;
 }
 
 /**
@@ -443,7 +863,7 @@ This function will not work if there is no auth provider.
 int delete_file(connection_t* connection_prop) {
     int retval;
 
-    if (weborf_conf.authsock==NULL) {
+    if (!connection_prop->vhost->auth) {
         return ERR_NOT_ALLOWED;
     }
 
@@ -454,7 +874,20 @@ int delete_file(connection_t* connection_prop) {
     }
 
     if (S_ISDIR(stat_d.st_mode)) {
-        retval=dir_remove(connection_prop->strfile);
+        tree_failures_t failures;
+        retval=dir_remove(connection_prop->strfile,&failures);
+
+#ifdef WEBDAV
+        //Some members could not be deleted
+        if (retval==0 && failures.count) {
+            retval=send_multistatus(connection_prop,connection_prop->page,&failures);
+            tree_failures_free(&failures);
+            return retval;
+        }
+#endif
+        if (failures.count)
+            retval=ERR_FORBIDDEN;
+        tree_failures_free(&failures);
     } else {
         retval=unlink(connection_prop->strfile);
     }
@@ -478,7 +911,7 @@ static inline int options (connection_t* connection_prop) {
 #define ALLOWED "Allow: GET,POST,PUT,DELETE,OPTIONS\r\n"
 #endif
 
-    send_http_header(200, NULL, ALLOWED, true, -1, connection_prop);
+    send_http_header(200, NULL, ALLOWED, true, NULL, connection_prop);
     return 0;
 }
 
@@ -491,6 +924,8 @@ static int send_page(buffered_read_t* read_b, connection_t* connection_prop) {
     string_t post_param; //Contains POST data
     post_param.data = NULL;
     post_param.len = 0;
+    bool body_pending = false; //True if the body was left to be read later
+    connection_prop->strfile_fd = -1; //Not opened yet, must not close the one of the previous request
 
 #ifdef SENDINGDBG
     syslog (LOG_DEBUG,"URL changed into %s",connection_prop->page);
@@ -538,8 +973,26 @@ static int send_page(buffered_read_t* read_b, connection_t* connection_prop) {
         goto escape;
     }
 
-    if (connection_prop->method_id == POST)
-        post_param = read_post_data(connection_prop,read_b);
+    if (connection_prop->method_id == POST) {
+        //SCGI and uwsgi backends read the body while it arrives
+        int q_ = cgi_index(connection_prop);
+        if (q_ != -1 && scgi_is_backend(connection_prop->vhost->cgi_paths.data[q_ + 1]))
+            body_pending = true;
+        else
+            post_param = read_post_data(connection_prop,read_b);
+    }
+
+    /*
+    Revalidations of static files are answered after a stat, without
+    opening the file. Requests without conditional headers skip the stat.
+    */
+    if (connection_prop->method_id == GET &&
+            strstr(connection_prop->http_param, "If-") != NULL &&
+            cgi_index(connection_prop) == -1 &&
+            stat(connection_prop->strfile, &connection_prop->strfile_stat) == 0 &&
+            S_ISREG(connection_prop->strfile_stat.st_mode) &&
+            check_etag(connection_prop) == 0)
+        goto escape;
 
     if ((connection_prop->strfile_fd=open(connection_prop->strfile,O_RDONLY | O_LARGEFILE))<0) {
         //File doesn't exist. Must return errorcode
@@ -549,11 +1002,15 @@ static int send_page(buffered_read_t* read_b, connection_t* connection_prop) {
 
     fstat(connection_prop->strfile_fd, &connection_prop->strfile_stat);
 
-    retval = get_or_post(connection_prop, post_param);
+    retval = get_or_post(connection_prop, post_param, read_b);
 
 escape:
     free(post_param.data);
 
+    //The request body might still be in the socket
+    if (body_pending)
+        connection_prop->keep_alive = false;
+
     //Closing local file previously opened
     if ((connection_prop->method_id==GET || connection_prop->method_id==POST) && connection_prop->strfile_fd>=0) {
         close(connection_prop->strfile_fd);
@@ -562,12 +1019,37 @@ escape:
     return send_error_header(retval, connection_prop);
 }
 
+/**
+ * Returns the position in the cgi_paths of the host of the extension that makes the requested
+ * page a CGI script, the interpreter is in the following position.
+ * Returns -1 if the page is not a script or scripts are disabled.
+ * */
+static inline int cgi_index(connection_t *connection_prop) {
+    array_ll *cgi_paths = &connection_prop->vhost->cgi_paths;
+
+    if (!connection_prop->vhost->exec_script) //Scripts disabled
+        return -1;
+
+    int q_;
+    int f_len;
+    for (q_=0; q_<cgi_paths->len; q_+=2) { //Check if it is a CGI script
+        f_len=cgi_paths->data_l[q_];
+        if (f_len <= connection_prop->page_len && endsWith(connection_prop->page+connection_prop->page_len-f_len,cgi_paths->data[q_],f_len,f_len)) {
+            return q_;
+        }
+    }
+    return -1;
+}
+
 /**
  * With get or post this function is called, it decides if execute CGI or send
  * the simple file, and if the request points to a directory it will redirect to
  * the appropriate index file or show the list of the files.
+ *
+ * read_b is needed by the SCGI and uwsgi backends, that stream the request
+ * body from the client.
  * */
-static int get_or_post(connection_t *connection_prop, string_t post_param) {
+static int get_or_post(connection_t *connection_prop, string_t post_param, buffered_read_t* read_b) {
     unsigned long long int size_zero = 0;
 
     if (S_ISDIR(connection_prop->strfile_stat.st_mode)) {//Requested a directory
@@ -576,20 +1058,21 @@ static int get_or_post(connection_t *connection_prop, string_t post_param) {
         if (!endsWith(connection_prop->strfile,"/",connection_prop->strfile_len,1)) {//Putting the ending / and redirect
             char head[URI_LEN+12];//12 is the size for the location header
             snprintf(head,URI_LEN+12,"Location: %s/\r\n",connection_prop->page);
-            send_http_header(301, &size_zero, head, true, -1, connection_prop);
+            send_http_header(301, &size_zero, head, true, NULL, connection_prop);
             return 0;
         } else {//Requested directory with "/" Search for index files or list directory
 
             char* index_name=&connection_prop->strfile[connection_prop->strfile_len];//Pointer to where to write the filename
+            vhost_t *vhost = connection_prop->vhost;
             int i;
 
             //Cyclyng through the indexes
-            for (i=0; i<weborf_conf.indexes_l; i++) {
-                snprintf(index_name,INDEXMAXLEN,"%s",weborf_conf.indexes[i]);//Add INDEX to the url
+            for (i=0; i<vhost->indexes_l; i++) {
+                snprintf(index_name,INDEXMAXLEN,"%s",vhost->indexes[i]);//Add INDEX to the url
                 if (file_exists(connection_prop->strfile)) { //If index exists, redirect to it
                     char head[URI_LEN+12];//12 is the size for the location header
-                    snprintf(head,URI_LEN+12,"Location: %s%s\r\n",connection_prop->page,weborf_conf.indexes[i]);
-                    send_http_header(303, &size_zero, head, true, -1, connection_prop);
+                    snprintf(head,URI_LEN+12,"Location: %s%s\r\n",connection_prop->page,vhost->indexes[i]);
+                    send_http_header(303, &size_zero, head, true, NULL, connection_prop);
                     return 0;
                 }
             }
@@ -600,16 +1083,23 @@ static int get_or_post(connection_t *connection_prop, string_t post_param) {
 
 
     } else {//Requested an existing file
-        if (weborf_conf.exec_script) { //Scripts enabled
-
-            int q_;
-            int f_len;
-            for (q_=0; q_<weborf_conf.cgi_paths.len; q_+=2) { //Check if it is a CGI script
-                f_len=weborf_conf.cgi_paths.data_l[q_];
-                if (endsWith(connection_prop->page+connection_prop->page_len-f_len,weborf_conf.cgi_paths.data[q_],f_len,f_len)) {
-                    return exec_page(weborf_conf.cgi_paths.data[++q_],&post_param,connection_prop->basedir,connection_prop);
-                }
-            }
+        int q_ = cgi_index(connection_prop);
+        if (q_ != -1) { //It is a CGI script
+            vhost_t *vhost = connection_prop->vhost;
+            char *executor = vhost->cgi_paths.data[q_ + 1];
+            int retval;
+
+            //Limits how many scripts can run at the same time
+            if (cgi_acquire(vhost, q_ / 2) != 0)
+                return ERR_OVERLOADED;
+
+            if (scgi_is_backend(executor))
+                retval = scgi_exec_page(executor, &post_param, read_b, connection_prop);
+            else
+                retval = exec_page(executor,&post_param,connection_prop->basedir,connection_prop);
+
+            cgi_release(vhost, q_ / 2);
+            return retval;
         }
 
         //send normal file, control reaches this point if scripts are disabled or if the filename doesn't trigger CGI
@@ -625,6 +1115,7 @@ static int get_or_post(connection_t *connection_prop, string_t post_param) {
 static int send_error_header(int retval, connection_t *connection_prop) {
     switch (retval) {
     case 0:
+    case ERR_SOCKWRITE: //Part of the response is already sent, nothing can follow it
         return 0;
     case ERR_BRKPIPE:
         return send_err(connection_prop,500,"Internal server error");
@@ -633,8 +1124,13 @@ static int send_error_header(int retval, connection_t *connection_prop) {
     case ERR_SERVICE_UNAVAILABLE:
     case ERR_NOMEM:
         return send_err(connection_prop,503,"Service Unavailable");
-    case ERR_RANGE_NOT_SATISFIABLE:
-        return send_err(connection_prop,416,"Range not satisfiable");
+    case ERR_OVERLOADED:
+        return send_err_headers(connection_prop,503,"Service Unavailable","Retry-After: " CGI_RETRY_AFTER "\r\n");
+    case ERR_RANGE_NOT_SATISFIABLE: {
+        char head[NBUFFER + 32];
+        snprintf(head, sizeof(head), "Content-Range: bytes */%lld\r\n", (long long int)connection_prop->strfile_stat.st_size);
+        return send_err_headers(connection_prop,416,"Range not satisfiable",head);
+    }
     case ERR_NODATA:
     case ERR_NOTHTTP:
         return send_err(connection_prop,400,"Bad request");
@@ -653,9 +1149,12 @@ static int send_error_header(int retval, connection_t *connection_prop) {
     case ERR_NOAUTH:
         return request_auth(connection_prop);//Sends a request for authentication
     case OK_NOCONTENT:
-        return send_http_header(204, NULL, NULL, true, -1, connection_prop);
-    case OK_CREATED:
-        return send_http_header(201, NULL, NULL, true, -1, connection_prop);
+        return send_http_header(204, NULL, NULL, true, NULL, connection_prop);
+    case OK_CREATED: {
+        //Without a length the client can't keep the connection alive
+        unsigned long long int size_zero = 0;
+        return send_http_header(201, &size_zero, NULL, true, NULL, connection_prop);
+    }
     }
     return 0; //Make gcc happy
 }
@@ -673,11 +1172,8 @@ int write_dir(char* real_basedir,connection_t* connection_prop) {
     since the impact of using ETag for generated directory list is not known
     yet, if ETag goes away, also the following block will have to be deleted
     */
-    {
-        char a[RBUFFER+MIMETYPELEN+16]; //Buffer for if-none-match from header
-        //Check if the resource cached in the client is the same
-        if (check_etag(connection_prop,&a[0])==0) return 0;
-    }
+    //Check if the resource cached in the client is the same
+    if (check_etag(connection_prop)==0) return 0;
 
 
     //Tries to send the item from the cache
@@ -699,7 +1195,8 @@ int write_dir(char* real_basedir,connection_t* connection_prop) {
             parent=true;
     }
 
-    char* html=malloc(MAXSCRIPTOUT);//Memory for the html page
+    size_t html_size=connection_prop->tunables->max_page_size;
+    char* html=malloc(html_size);//Memory for the html page
     if (html==NULL) { //No memory
 #ifdef SERVERDBG
         syslog(LOG_CRIT,"Not enough memory to allocate buffers to list directory");
@@ -707,9 +1204,10 @@ int write_dir(char* real_basedir,connection_t* connection_prop) {
         return ERR_NOMEM;
     }
 
-    if ((pagelen=list_dir (connection_prop,html,MAXSCRIPTOUT,parent))<0) { //Creates the page
+    int listed=list_dir (connection_prop,html,html_size,parent); //Creates the page
+    if (listed<0) {
         free(html);//Frees the memory used for the page
-        switch (pagelen) {
+        switch (listed) {
             case -1:
                 return ERR_FILENOTFOUND;
             case -2:
@@ -722,6 +1220,7 @@ int write_dir(char* real_basedir,connection_t* connection_prop) {
 
 
     } else { //If there are no errors sends the page
+        pagelen=listed;
 
         /*WARNING using the directory's mtime here allows better caching and
         the mtime will anyway be changed when files are added or deleted.
@@ -736,7 +1235,7 @@ int write_dir(char* real_basedir,connection_t* connection_prop) {
             &pagelen,
             "Content-Type: text/html;charset=UTF-8\r\n",
             true,
-            connection_prop->strfile_stat.st_mtime,
+            &connection_prop->strfile_stat,
             connection_prop
         );
         myio_write(sock, html, pagelen);
@@ -790,7 +1289,7 @@ static inline int write_compressed_file(connection_t* connection_prop ) {
                      &connection_prop->strfile_stat.st_size,
                      "Content-Encoding: gzip\r\n",
                      false,
-                     connection_prop->strfile_stat.st_mtime,
+                     &connection_prop->strfile_stat,
                      connection_prop);
     int pid=fork();
 
@@ -814,96 +1313,245 @@ static inline int write_compressed_file(connection_t* connection_prop ) {
 
 
 /**
- * Returns the amount of bytes to send
- * Collaterally, this function seeks the file to the requested position
- * finds out the mimetype
- * sends the header
- *
- * a must be a pointer to a buffer large at least RBUFFER+MIMETYPELEN+16
+ * Reads a byte position from *s, moving it after the digits.
+ * Returns false if there are no digits or the value overflows.
  * */
-static inline unsigned long long int bytes_to_send(connection_t* connection_prop, char *a, int *errcode) {
-    int http_code=200;
-    errno=0;
-    unsigned long long int count;
-    char *hbuf=a;
-    int remain=RBUFFER+MIMETYPELEN+16, t;
-    a[0]='\0';
+static bool parse_position(const char **s, unsigned long long int *value) {
+    const char *p = *s;
+    *value = 0;
+    while (*p >= '0' && *p <= '9') {
+        unsigned int digit = *p - '0';
+        if (*value > (ULLONG_MAX - digit) / 10)
+            return false;
+        *value = *value * 10 + digit;
+        p++;
+    }
+    bool found = p != *s;
+    *s = p;
+    return found;
+}
 
-    char *range="Range";
-    char *if_range="If-Range";
+static int range_cmp(const void *a, const void *b) {
+    const byte_range_t *x = a, *y = b;
+    if (x->from == y->from)
+        return 0;
+    return x->from < y->from ? -1 : 1;
+}
+
+/**
+ * Parses the value of a Range header, like "bytes=0-99,200-,-50", for a
+ * file of size bytes. The satisfiable ranges are written in ranges,
+ * that must have space for MAXRANGES, sorted and with the overlapping
+ * or adjacent ones merged.
+ * Returns their count, 0 if none is satisfiable, or -1 if the header is
+ * invalid or lists more than MAXRANGES ranges, and must be ignored.
+ * */
+static int parse_ranges(const char *spec, unsigned long long int size, byte_range_t *ranges) {
+    int count = 0;
+    int parsed = 0;
 
-    bool range_header=get_param_value(connection_prop->http_param,range,a,RBUFFER,strlen(range));
-    time_t etag=connection_prop->strfile_stat.st_mtime;
+    if (strncasecmp(spec, "bytes=", 6) != 0)
+        return -1;
 
-    //Range header present, seeking for If-Range
-    if (range_header) {
-        char b[RBUFFER]; //Buffer for If-Range
-        if (get_param_value(connection_prop->http_param,if_range,&b[0],sizeof(b),strlen(if_range))) {
-            etag=(time_t)strtol(&b[1],NULL,0);
+    for (const char *p = spec + 6; *p != 0;) {
+        unsigned long long int first, last;
+
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == ',') { //Empty elements are allowed in the list
+            p++;
+            continue;
+        }
+
+        bool has_first = parse_position(&p, &first);
+        if (*p++ != '-')
+            return -1;
+        bool has_last = parse_position(&p, &last);
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == ',')
+            p++;
+        else if (*p != 0)
+            return -1;
+
+        if ((!has_first && !has_last) || (has_first && has_last && last < first))
+            return -1;
+        if (++parsed > MAXRANGES)
+            return -1;
+
+        if (!has_first) { //Suffix, the last bytes of the file
+            if (last == 0 || size == 0)
+                continue;
+            first = last >= size ? 0 : size - last;
+            last = size - 1;
+        } else {
+            if (first >= size)
+                continue;
+            if (!has_last || last >= size)
+                last = size - 1;
         }
+        ranges[count].from = first;
+        ranges[count].to = last;
+        count++;
     }
 
-    /*
-     * If range header is present and (If-Range has the same etag OR there is no If-Range)
-     * */
-    if (range_header && connection_prop->strfile_stat.st_mtime==etag) {//Find if it is a range request 5 is strlen of "range"
-        unsigned long long int from;
-        unsigned long long int to;
-
-        {
-            //Locating from and to
-            //Range: bytes=12323-123401
-            char *eq, *sep;
-
-            if ((eq=strstr(a,"="))==NULL ||(sep=strstr(eq,"-"))==NULL) {//Invalid data in Range header.
-                *errcode = ERR_NOTHTTP;
-                return 0;
-            }
-            sep[0]=0;
-            from=strtoll(eq+1,NULL,0);
-            to=strtoll(sep+1,NULL,0);
+    if (parsed == 0)
+        return -1;
 
-            if (to == 0 && strlen(sep +1) == 0) { //If no to is specified, it is to the end of the file
-                to=connection_prop->strfile_stat.st_size-1;
-            }
+    qsort(ranges, count, sizeof(byte_range_t), range_cmp);
+    int merged = 0;
+    for (int i = 0; i < count; i++) {
+        if (merged > 0 && ranges[i].from <= ranges[merged - 1].to + 1) {
+            if (ranges[i].to > ranges[merged - 1].to)
+                ranges[merged - 1].to = ranges[i].to;
+        } else {
+            ranges[merged++] = ranges[i];
         }
+    }
+    return merged;
+}
 
-        http_code=206;
+/**
+ * Finds the ranges of the file requested by the client, writing them in
+ * ranges, that must have space for MAXRANGES.
+ * Returns 0 if the whole file must be sent, -1 if no range is
+ * satisfiable, or the number of ranges.
+ * */
+static int requested_ranges(connection_t* connection_prop, byte_range_t *ranges) {
+    char *range="Range";
+    char *if_range="If-Range";
+    char a[HEADBUF]; //Buffer for Range
 
-        t=snprintf(hbuf,remain,"Accept-Ranges: bytes\r\nContent-Range: bytes %llu-%llu/%lld\r\n", from, to,(long long int)connection_prop->strfile_stat.st_size);
-        hbuf+=t;
-        remain-=t;
+    if (!get_param_value(connection_prop->http_param,range,a,sizeof(a),strlen(range)))
+        return 0;
 
-        count = to - from + 1;
-        if (from >= connection_prop->strfile_stat.st_size || from + count > connection_prop->strfile_stat.st_size) {
-            *errcode = ERR_RANGE_NOT_SATISFIABLE;
+    //If-Range with another ETag or date, the file changed and is sent whole
+    char b[RBUFFER]; //Buffer for If-Range
+    if (get_param_value(connection_prop->http_param,if_range,&b[0],sizeof(b),strlen(if_range))) {
+        if (b[0] == '"') {
+            char etag[ETAGLEN];
+            format_etag(&connection_prop->strfile_stat, etag, sizeof(etag));
+            if (strcmp(b, etag) != 0)
+                return 0;
+        } else if (parse_http_date(b) != connection_prop->strfile_stat.st_mtime) {
             return 0;
         }
+    }
 
-        if (from)
-            lseek(connection_prop->strfile_fd,from,SEEK_SET);
+    int count = parse_ranges(a, connection_prop->strfile_stat.st_size, ranges);
+    if (count == -1) //Invalid, it is ignored
+        return 0;
+    return count == 0 ? -1 : count;
+}
 
+/**
+ * Returns the amount of bytes to send, the size of the file or of the
+ * range, if range is not NULL.
+ * Collaterally, this function seeks the file to the requested position
+ * finds out the mimetype
+ * writes in a the headers to send and in http_code the status
+ *
+ * a must be a pointer to a buffer large at least RBUFFER+MIMETYPELEN+CACHECONTROLLEN+HTTPDATELEN+32
+ * */
+static inline unsigned long long int bytes_to_send(connection_t* connection_prop, char *a, byte_range_t *range, int *http_code) {
+    *http_code=200;
+    unsigned long long int count;
+    char *hbuf=a;
+    int remain=RBUFFER+MIMETYPELEN+CACHECONTROLLEN+HTTPDATELEN+32, t;
+    a[0]='\0';
 
-    } else //Normal request
-    {
-        a[0]=0; //Reset buffer in case it isn't used for headers
+    if (range) {
+        *http_code=206;
+
+        t=snprintf(hbuf,remain,"Accept-Ranges: bytes\r\nContent-Range: bytes %llu-%llu/%lld\r\n", range->from, range->to,(long long int)connection_prop->strfile_stat.st_size);
+        hbuf+=t;
+        remain-=t;
+
+        count = range->to - range->from + 1;
+        if (range->from)
+            lseek(connection_prop->strfile_fd,range->from,SEEK_SET);
+    } else { //Normal request
         count = connection_prop->strfile_stat.st_size;
     }
 
     //Sending MIME to the client
-    if (weborf_conf.send_content_type) {
-        thread_prop_t *thread_prop = pthread_getspecific(thread_key);
-        const char* mime=get_mime(connection_prop->strfile);
+    const char *mime = NULL;
+    if (connection_prop->vhost->send_content_type) {
+        mime=get_mime(connection_prop->strfile);
 
-        //t=
-        snprintf(hbuf,remain,"Content-Type: %s\r\n",mime);
-        //hbuf+=t;
-        //remain-=t;
+        t=snprintf(hbuf,remain,"Content-Type: %s\r\n",mime);
+        hbuf+=t;
+        remain-=t;
     }
-    send_http_header(http_code, &count,a,true,connection_prop->strfile_stat.st_mtime,connection_prop);
+
+    //Caching policy of the file
+    cachecontrol_header(connection_prop->page, connection_prop->strfile, mime, hbuf, remain);
     return count;
 }
 
+/**
+ * Writes in part the header of a part of a multipart/byteranges
+ * response, and returns its length.
+ * */
+static int range_part_header(char *part, const char *boundary, const char *mime, byte_range_t *range, unsigned long long int size) {
+    int len = snprintf(part, HEADBUF, "\r\n--%s\r\n", boundary);
+    if (mime)
+        len += snprintf(part + len, HEADBUF - len, "Content-Type: %s\r\n", mime);
+    len += snprintf(part + len, HEADBUF - len, "Content-Range: bytes %llu-%llu/%llu\r\n\r\n", range->from, range->to, size);
+    return len;
+}
+
+/**
+ * Sends more ranges of the file, in a multipart/byteranges response.
+ * Every part is sent from the file like a whole file would be.
+ * */
+static int write_ranges(connection_t* connection_prop, byte_range_t *ranges, int count) {
+    fd_t sock = connection_prop->sock;
+    unsigned long long int size = connection_prop->strfile_stat.st_size;
+    const char *mime = NULL;
+    char mime_buf[256];        //RFC 6838 allows 127 characters for the type and for the subtype
+
+    //The table can be replaced by a reload during a slow transfer, so the type is copied
+    if (connection_prop->vhost->send_content_type && (mime = get_mime(connection_prop->strfile)) != NULL) {
+        snprintf(mime_buf, sizeof(mime_buf), "%s", mime);
+        mime = mime_buf;
+    }
+    char part[HEADBUF];
+    char boundary[BOUNDARYLEN];
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    snprintf(boundary, sizeof(boundary), "%08lx%08lx", (unsigned long) now.tv_nsec, (unsigned long) (now.tv_sec ^ (uintptr_t) connection_prop));
+
+    //The length of the body is needed before sending it
+    unsigned long long int length = 2 + strlen(boundary) + 6; //Final "\r\n--boundary--\r\n"
+    for (int i = 0; i < count; i++)
+        length += range_part_header(part, boundary, mime, &ranges[i], size) + ranges[i].to - ranges[i].from + 1;
+
+    char headers[HEADBUF];
+    int headers_l = snprintf(headers, sizeof(headers), "Accept-Ranges: bytes\r\nContent-Type: multipart/byteranges; boundary=%s\r\n", boundary);
+    cachecontrol_header(connection_prop->page, connection_prop->strfile, mime, headers + headers_l, sizeof(headers) - headers_l);
+    if (send_http_header(206, &length, headers, true, &connection_prop->strfile_stat, connection_prop) != 0)
+        return 0;
+
+    size_t read_size = connection_prop->vhost->read_size ? connection_prop->vhost->read_size : connection_prop->tunables->file_buffer;
+    for (int i = 0; i < count; i++) {
+        int len = range_part_header(part, boundary, mime, &ranges[i], size);
+        if (myio_write(sock, part, len) != len)
+            return 0; //The client is gone, can't send errors now
+        lseek(connection_prop->strfile_fd, ranges[i].from, SEEK_SET);
+        if (fd_send(connection_prop->strfile_fd, sock, ranges[i].to - ranges[i].from + 1, read_size, connection_prop->vhost->sendfile) != 0) {
+            //Less than Content-Length was sent, the connection can't be reused
+            connection_prop->keep_alive = false;
+            return ERR_SOCKWRITE;
+        }
+    }
+
+    int len = snprintf(part, sizeof(part), "\r\n--%s--\r\n", boundary);
+    myio_write(sock, part, len);
+    return 0;
+}
+
 /**
 This function reads a file and writes it to the socket.
 Also sends the http header with the content length header
@@ -918,16 +1566,17 @@ If the file is larger, it will be sent using write_compressed_file,
 see that function for details.
 
 To work connection_prop.strfile_fd and connection_prop.strfile_stat must be set.
-The file sent is the one specified by strfile_fd, and it will not be closed after.
+The file sent is the one specified by strfile_fd. It might be closed, when
+sent with io_uring, and then strfile_fd is set to -1.
 */
 int write_file(connection_t* connection_prop) {
 
     fd_t sock = connection_prop->sock;
 
-    char a[RBUFFER+MIMETYPELEN+16]; //Buffer for Range, Content-Range headers, and reading if-none-match from header
+    char a[RBUFFER+MIMETYPELEN+CACHECONTROLLEN+HTTPDATELEN+32]; //Buffer for Range, Content-Range, Content-Type and Cache-Control headers
 
     //Check if the resource cached in the client is the same
-    if (check_etag(connection_prop,&a[0])==0) return 0;
+    if (check_etag(connection_prop)==0) return 0;
 
 #ifdef __COMPRESSION
     {
@@ -938,19 +1587,44 @@ int write_file(connection_t* connection_prop) {
 #endif
 
     //Determines how many bytes send, depending on file size and ranges
-    //Also sends the http header
-    int errcode = 0;
-    unsigned long long int count = bytes_to_send(connection_prop,&a[0], &errcode);
-    if (errcode != 0)
-        return errcode;
-    /*if (errno !=0) {
-        int e=errno;
-        errno=0;
-        return e;
-    }*/
+    byte_range_t ranges[MAXRANGES];
+    int ranges_l = requested_ranges(connection_prop, ranges);
+    if (ranges_l == -1)
+        return ERR_RANGE_NOT_SATISFIABLE;
+    if (ranges_l > 1)
+        return write_ranges(connection_prop, ranges, ranges_l);
+
+    int http_code;
+    unsigned long long int count = bytes_to_send(connection_prop,&a[0], ranges_l ? &ranges[0] : NULL, &http_code);
+
+    //Small files are read and sent with the header by a single io_uring submission
+    thread_prop_t *thread_prop = pthread_getspecific(thread_key);
+    size_t uring_size;
+    char *uring_buf = thread_prop->uring ? uring_buffer(thread_prop->uring, &uring_size) : NULL;
+#ifdef HAVE_LIBSSL
+    if (sock.ssl)
+        uring_buf = NULL;
+#endif
+    if (uring_buf != NULL && count + HEADBUF <= uring_size) {
+        bool closed;
+        int head_len = http_header(http_code, &count, a, true, &connection_prop->strfile_stat, connection_prop, uring_buf);
+        int r = uring_send_file(thread_prop->uring, connection_prop->strfile_fd, myio_getfd(sock), head_len, count, &closed);
+        if (closed)
+            connection_prop->strfile_fd = -1;
+        if (r != 0)
+            connection_prop->keep_alive = false;
+        return r;
+    }
+
+    send_http_header(http_code, &count,a,true,&connection_prop->strfile_stat,connection_prop);
 
     //Copy file using descriptors; from to and size
-    return fd_copy(fd2fd_t(connection_prop->strfile_fd), sock, count);
+    size_t read_size = connection_prop->vhost->read_size ? connection_prop->vhost->read_size : connection_prop->tunables->file_buffer;
+    if (fd_send(connection_prop->strfile_fd, sock, count, read_size, connection_prop->vhost->sendfile) != 0) {
+        connection_prop->keep_alive = false;
+        return ERR_SOCKWRITE;
+    }
+    return 0;
 }
 
 /**
@@ -962,7 +1636,8 @@ int request_auth(connection_t *connection_prop) {
     connection_prop->status_code=401;
 
     //Buffer for both header and page
-    char * head=malloc(MAXSCRIPTOUT+HEADBUF);
+    size_t page_size=connection_prop->tunables->max_page_size;
+    char * head=malloc(page_size+HEADBUF);
     if (head==NULL) {
 #ifdef SERVERDBG
         syslog(LOG_CRIT,"Not enough memory to allocate buffers");
@@ -973,7 +1648,9 @@ int request_auth(connection_t *connection_prop) {
     char * page=head+HEADBUF;
 
     //Prepares html page
-    int page_len=snprintf(page,MAXSCRIPTOUT,"%s<H1>Authorization required</H1><p>%s</p>%s",HTMLHEAD,descr,HTMLFOOT);
+    int page_len=snprintf(page,page_size,"%s<H1>Authorization required</H1><p>%s</p>%s",HTMLHEAD,descr,HTMLFOOT);
+    if (page_len >= page_size) //Truncated
+        page_len = page_size - 1;
 
     //Prepares http header
     int head_len = snprintf(head,HEADBUF,"HTTP/1.1 401 Authorization Required\r\nServer: " SIGNATURE "\r\nContent-Length: %d\r\nWWW-Authenticate: Basic realm=\"%s\"\r\n\r\n",page_len,descr);
@@ -999,11 +1676,20 @@ int request_auth(connection_t *connection_prop) {
 Sends an error to the client
 */
 int send_err(connection_t *connection_prop, int err, char* descr) {
+    return send_err_headers(connection_prop, err, descr, "");
+}
+
+/**
+Sends an error to the client, adding some headers to the response.
+Headers must be separated by \r\n and must have an \r\n at the end.
+*/
+static int send_err_headers(connection_t *connection_prop, int err, char* descr, char* headers) {
     fd_t sock = connection_prop->sock;
     connection_prop->status_code = err; //Sets status code, for the logs
 
     //Buffer for both header and page
-    char * head=malloc(MAXSCRIPTOUT+HEADBUF);
+    size_t page_size=connection_prop->tunables->max_page_size;
+    char * head=malloc(page_size+HEADBUF);
 
     if (head==NULL) {
 #ifdef SERVERDBG
@@ -1015,10 +1701,12 @@ int send_err(connection_t *connection_prop, int err, char* descr) {
     char * page=head+HEADBUF;
 
     //Prepares the page
-    int page_len=snprintf(page,MAXSCRIPTOUT,"%s <H1>Error %d</H1>%s %s",HTMLHEAD,err,descr,HTMLFOOT);
+    int page_len=snprintf(page,page_size,"%s <H1>Error %d</H1>%s %s",HTMLHEAD,err,descr,HTMLFOOT);
+    if (page_len >= page_size) //Truncated
+        page_len = page_size - 1;
 
     //Prepares the header
-    int head_len = snprintf(head,HEADBUF,"HTTP/1.1 %d %s\r\nServer: " SIGNATURE "\r\nContent-Length: %d\r\nContent-Type: text/html;charset=UTF-8\r\n\r\n",err,descr ,(int)page_len);
+    int head_len = snprintf(head,HEADBUF,"HTTP/1.1 %d %s\r\nServer: " SIGNATURE "\r\nContent-Length: %d\r\nContent-Type: text/html;charset=UTF-8\r\n%s\r\n",err,descr ,(int)page_len,headers);
 
     //Sends the http header
     if (myio_write(sock, head, head_len) != head_len) {
@@ -1055,7 +1743,7 @@ string_t read_post_data(connection_t* connection_prop, buffered_read_t* read_b)
     //If there is a request body
     if (get_param_value(connection_prop->http_param, content_length, a, NBUFFER, strlen(content_length))) {
         long int l = strtol(a, NULL, 0 );
-        if (l<=POST_MAX_SIZE && (res.data=malloc(l))!=NULL) {//Post size is ok and buffer is allocated
+        if (l<=connection_prop->tunables->post_max_size && (res.data=malloc(l))!=NULL) {//Post size is ok and buffer is allocated
             res.len=buffer_read(sock,res.data,l,read_b);
         }
     }
@@ -1063,29 +1751,45 @@ string_t read_post_data(connection_t* connection_prop, buffered_read_t* read_b)
 }
 
 /**
-This function returns a pointer to a string.
-It will use virtualhost settings to return this string and if no virtualhost is set for that host, it will return
-the default basedir.
-Those string must
+Sets the virtual host and the basedir of the request, using the Host header.
+If no virtual host matches, the default one is used.
+
+The table of the virtual hosts stays pinned in connection_prop->vhosts
+until release_basedir() is called, so the strings remain valid for the
+whole request.
 */
-char* get_basedir(char* http_param) {
-    if (weborf_conf.virtual_host==false) return weborf_conf.basedir;
+void get_basedir(connection_t *connection_prop) {
+    connection_prop->vhost = &weborf_conf.default_vhost;
+    connection_prop->basedir = weborf_conf.default_vhost.basedir;
 
-    char* result;
-    char* h=strstr(http_param,"\r\nHost: ");
+    if (weborf_conf.virtual_host==false) return;
 
-    if (h==NULL) return weborf_conf.basedir;
+    char* h=strstr(connection_prop->http_param,"\r\nHost: ");
+    if (h==NULL) return;
 
     h+=8;//Removing "Host:" string
     char* end=strstr(h,"\r");
-    if (end==NULL) return weborf_conf.basedir;
-    end[0]=0;
-    result=getenv(h);
-    end[0]='\r';
+    if (end==NULL) return;
 
-    if (result==NULL) return weborf_conf.basedir; //Reqeusted host doesn't exist
+    connection_prop->vhosts = vhost_acquire();
+    if (connection_prop->vhosts == NULL) return;
 
-    return result;
+    vhost_t *vhost = vhost_find(connection_prop->vhosts, h, end - h);
+    if (vhost) {
+        connection_prop->vhost = vhost;
+        connection_prop->basedir = vhost->basedir;
+    }
+}
+
+/**
+Unpins the virtual hosts used by the request.
+*/
+static inline void release_basedir(connection_t *connection_prop) {
+    if (connection_prop->vhosts) {
+        vhost_release(connection_prop->vhosts);
+        connection_prop->vhosts = NULL;
+        connection_prop->vhost = &weborf_conf.default_vhost;
+    }
 }
 
 
@@ -1112,35 +1816,27 @@ static inline char *reason_phrase(int code) {
 }
 
 /**
-This function sends a code header to the specified socket
+This function writes a code header in head, that must be at least
+HEADBUF bytes long, and returns its length.
 size is the Content-Length field.
 headers can be NULL or some extra headers to add. Headers must be
 separated by \r\n and must have an \r\n at the end.
 
 Content says if the size is for content-length or for entity-length
 
-Timestamp is the timestamp for the content. Set to -1 to use the current
-timestamp for Last-Modified and to omit ETag.
+st is the stat of the content, used for ETag and Last-Modified. Set to NULL
+to omit them.
 
 This function will automatically take care of generating Connection header when
 needed, according to keep_alive and protocol_version of connection_prop
 
 */
-int send_http_header(int code, unsigned long long int *size,char* headers,bool content,time_t timestamp,connection_t* connection_prop) {
-    fd_t sock = connection_prop->sock;
-    int len_head,wrote;
-    char *head=malloc(HEADBUF);
-    char* h_ptr=head;
+static int http_header(int code, unsigned long long int *size,char* headers,bool content,struct stat *st,connection_t* connection_prop,char *head) {
+    int len_head;
     int left_head=HEADBUF;
 
     connection_prop->status_code=code; //Sets status code, for the logs
 
-    if (head==NULL) {
-#ifdef SERVERDBG
-        syslog(LOG_CRIT,"Not enough memory to allocate buffers");
-#endif
-        return ERR_NOMEM;
-    }
     if (headers==NULL) headers="";
 
     /*Defines the Connection header
@@ -1164,27 +1860,16 @@ int send_http_header(int code, unsigned long long int *size,char* headers,bool c
     head+=len_head;
     left_head-=len_head;
 
-    //Creating ETag and date from timestamp
-    if (timestamp!=-1) {
-        //Sends ETag, if a timestamp is set
-        len_head = snprintf(head,left_head,"ETag: \"%d\"\r\n",(int)timestamp);
+    //Creating ETag and Last-Modified from the stat of the content
+    if (st!=NULL) {
+        char etag[ETAGLEN];
+        char date[HTTPDATELEN];
+        format_etag(st, etag, sizeof(etag));
+        format_http_date(st->st_mtime, date, sizeof(date));
+        len_head = snprintf(head,left_head,"ETag: %s\r\nLast-Modified: %s\r\n",etag,date);
         head+=len_head;
         left_head-=len_head;
     }
-#ifdef SEND_LAST_MODIFIED_HEADER
-    else {//timestamp with now, to be eventually used by Last-Modified
-        timestamp=time(NULL);
-    }
-
-    {
-        //Sends Date
-        struct tm  ts;
-        localtime_r((time_t)&timestamp,&ts);
-        len_head = strftime(head,left_head, "Last-Modified: %a, %d %b %Y %H:%M:%S GMT\r\n", &ts);
-        head+=len_head;
-        left_head-=len_head;
-    }
-#endif
 
     if (size != NULL && connection_prop->keep_alive==true) {
         //Content length (or entity length) and extra headers
@@ -1202,9 +1887,27 @@ int send_http_header(int code, unsigned long long int *size,char* headers,bool c
     //head+=len_head; Not necessary because the snprintf was the last one
     left_head-=len_head;
 
-    wrote = myio_write(sock, h_ptr, HEADBUF - left_head);
-    free(h_ptr);
-    if (wrote!=HEADBUF-left_head) return ERR_BRKPIPE;
+    return HEADBUF - left_head;
+}
+
+/**
+This function sends a code header to the specified socket.
+The parameters are the same of http_header.
+*/
+int send_http_header(int code, unsigned long long int *size,char* headers,bool content,struct stat *st,connection_t* connection_prop) {
+    char *head=malloc(HEADBUF);
+
+    if (head==NULL) {
+#ifdef SERVERDBG
+        syslog(LOG_CRIT,"Not enough memory to allocate buffers");
+#endif
+        return ERR_NOMEM;
+    }
+
+    int len_head = http_header(code, size, headers, content, st, connection_prop, head);
+    int wrote = myio_write(connection_prop->sock, head, len_head);
+    free(head);
+    if (wrote!=len_head) return ERR_BRKPIPE;
     return 0;
 }
 
@@ -1219,10 +1922,17 @@ void inetd() {
     int bufFull=0;                                  //Amount of buf used
     connection_t connection_prop;                   //Struct to contain properties of the connection
     buffered_read_t read_b;                         //Buffer for buffered reader
-    char * buf=calloc(INBUFFER+1,sizeof(char));     //Buffer to contain the HTTP request
+    weborf_tunables_t *tunables=tunables_acquire(); //Sizes of the buffers
+    size_t buf_size=tunables->request_buffer;
+    char * buf=calloc(buf_size+1,sizeof(char));     //Buffer to contain the HTTP request
     connection_prop.strfile=malloc(URI_LEN);        //buffer for filename
+    connection_prop.vhosts=NULL;
+    connection_prop.tunables=NULL;
 
     thread_prop.id=0;
+    thread_prop.auth_sock=-1;
+    thread_prop.uring=NULL;
+    thread_prop.coro=NULL;
     signal(SIGPIPE, SIG_IGN);//Ignores SIGPIPE
 
     pthread_setspecific(thread_key, (void *)&thread_prop); //Set thread_prop as thread variable
@@ -1239,7 +1949,7 @@ void inetd() {
     int addr_l=sizeof(struct sockaddr_in);
 #endif
 
-    if (buffer_init(&read_b, BUFFERED_READER_SIZE)!=0 || buf==NULL || connection_prop.strfile==NULL) {
+    if (buffer_init(&read_b, tunables->reader_buffer)!=0 || buf==NULL || connection_prop.strfile==NULL) {
 #ifdef SERVERDBG
         syslog(LOG_CRIT,"Not enough memory to allocate buffers for new thread");
 #endif
@@ -1265,6 +1975,6 @@ void inetd() {
     connection_prop.sock = 0;
 #endif
 
-    handle_requests(buf,&read_b,&bufFull,&connection_prop,thread_prop.id);
+    handle_requests(buf,buf_size,&read_b,&bufFull,&connection_prop,thread_prop.id);
     exit(0);
 }
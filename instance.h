@@ -53,6 +53,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define NO_ACTION -120
 
 //Errors
+#define ERR_OVERLOADED -16
 #define ERR_RANGE_NOT_SATISFIABLE -15
 #define ERR_PRECONDITION_FAILED -14
 #define ERR_NOT_ALLOWED -13
@@ -83,8 +84,8 @@ void *instance(void *);
 int write_file(connection_t * connection_prop);
 int send_err(connection_t *connection_prop,int err,char* descr);
 string_t read_post_data(connection_t * connection_prop, buffered_read_t * read_b);
-char *get_basedir(char *http_param);
-int send_http_header(int code, unsigned long long int *size, char *headers, bool content, time_t timestamp, connection_t * connection_prop);
+void get_basedir(connection_t *connection_prop);
+int send_http_header(int code, unsigned long long int *size, char *headers, bool content, struct stat *st, connection_t * connection_prop);
 int delete_file(connection_t* connection_prop);
 int read_file(connection_t* connection_prop,buffered_read_t* read_b);
 #endif
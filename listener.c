@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 @author Giuseppe Pappalardo <pappalardo@dmi.unict.it>
 @author Salvo Rinaldi <salvin@anche.no>
 */
+#define _GNU_SOURCE //For pipe2()
 #include "options.h"
 
 #include <errno.h>
@@ -35,6 +36,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <pthread.h>
 #include <poll.h>
 #include <time.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
 
 
 #include "listener.h"
@@ -46,10 +52,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "cachedir.h"
 #include "configuration.h"
 #include "mynet.h"
-
-#define _GNU_SOURCE
-
-syn_queue_t queue;              //Queue for opened sockets
+#include "cgi.h"
+#include "auth.h"
+#include "htpasswd.h"
+#include "cachecontrol.h"
+#include "mime.h"
+#include "vhost.h"
+#include "affinity.h"
+#include "park.h"
+
+syn_queue_t *queues;            //Queues for opened sockets, one for each NUMA node
+static unsigned int queues_l;
 
 t_thread_info thread_info;
 
@@ -59,6 +72,18 @@ pthread_attr_t t_attr;          //thread's attributes
 
 pthread_key_t thread_key;            //key for pthread_setspecific
 
+static unsigned int max_threads;     //Can't change while running
+
+static struct {
+    double arrivals;                 //Moving average of the connections per second
+    unsigned long long int wait;     //Average microseconds waited in the queue in the last interval
+} pool_stats;                        //Written by pool_controller() with thread_info.mutex
+
+atomic_bool draining = false;        //Stopping, the connections must not be kept alive
+
+static int wake_pipe[2];             //Wakes up the main loop when there is a pending signal
+static atomic_int pending_signal = 0; //SIGTERM, SIGINT or SIGUSR2 to be handled by the main loop
+
 /**
 Sets t_attr to make detached threads
 and initializes pthread_keys
@@ -72,7 +97,8 @@ static void init_thread_attr() {
 
 /**
 Starts threads
-Specify how many threads start.
+Specify how many threads start, they are less if max-threads would be exceeded.
+No thread is started once the server is stopping.
 */
 void init_threads(unsigned int count) {
     static long int id = 1;
@@ -82,8 +108,11 @@ void init_threads(unsigned int count) {
     pthread_t t_id;//Unused var, thread's system id
 
     pthread_mutex_lock(&thread_info.mutex);
-    //Check condition within the lock
-    if (thread_info.count + count < MAXTHREAD) {
+    //Check condition within the lock, quit() counts the threads with it
+    if (thread_info.count + count > max_threads)
+        count = max_threads - thread_info.count;
+
+    if (count > 0 && !atomic_load(&draining)) {
 
         //Start
         for (i = 1; i <= count; i++)
@@ -126,105 +155,519 @@ static void init_thread_info() {
 
 
 /**
-This function, terminates threads if there are too many free threads.
+Returns the queue with the most threads waiting for a socket.
+*/
+static unsigned int queue_most_idle() {
+    unsigned int best = 0;
+    int idle = q_idle(&queues[0]);
+
+    for (unsigned int i = 1; i < queues_l; i++) {
+        int n = q_idle(&queues[i]);
+        if (n > idle) {
+            idle = n;
+            best = i;
+        }
+    }
+    return best;
+}
 
-It only takes action every THREADCONTROL seconds.
+/**
+Chooses the queue for a new connection: the one of the node whose CPU
+received it, so it is served from local memory, unless no thread of that
+node is free.
 */
-static void t_shape() {
-    static time_t last_action = 0;
+static unsigned int queue_for(int sock) {
+    if (queues_l == 1)
+        return 0;
+
+    unsigned int node = affinity_socket_node(sock);
+    if (q_idle(&queues[node]) > 0)
+        return node;
+    return queue_most_idle();
+}
 
-    if (last_action + 10 > time(NULL)) {
-        return;
+/**
+Grows and shrinks the pool of threads between min-threads and max-threads,
+so the accept loop never waits for a thread to be created.
+
+Every POOL_INTERVAL milliseconds it measures the busy threads, the arrival
+rate and how long the sockets waited in the queue. The pool is kept at the
+average of the busy threads plus low-threads free ones. When the sockets
+are waiting, the missing threads are started at once. When more than
+max-free-threads threads are free for POOL_SHRINK_TICKS intervals, a quarter
+of the excess is retired.
+Setting min-threads equal to max-threads gives a pool of fixed size,
+started with the server.
+*/
+static void *pool_controller(void *unused) {
+    double busy_avg = 0;        //Moving average of the busy threads
+    unsigned int idle_ticks = 0;//Consecutive intervals with too many free threads
+
+    while (!atomic_load(&draining)) {
+        unsigned long int puts, gets;
+        unsigned long long int wait;
+        int queued;
+
+        usleep(POOL_INTERVAL * 1000);
+        puts = gets = wait = queued = 0;
+        for (unsigned int i = 0; i < queues_l; i++) {
+            unsigned long int q_puts, q_gets;
+            unsigned long long int q_wait;
+            int q_queued;
+            q_stats(&queues[i], &q_puts, &q_gets, &q_wait, &q_queued);
+            puts += q_puts;
+            gets += q_gets;
+            wait += q_wait;
+            queued += q_queued;
+        }
+        weborf_tunables_t *tunables = tunables_acquire();
+
+        pthread_mutex_lock(&thread_info.mutex);
+        unsigned int count = thread_info.count;
+        unsigned int free = thread_info.free;
+        busy_avg = busy_avg * 0.8 + (count - free) * 0.2;
+        pool_stats.arrivals = pool_stats.arrivals * 0.8 + puts * (1000.0 / POOL_INTERVAL) * 0.2;
+        pool_stats.wait = gets ? wait / gets : 0;
+        pthread_mutex_unlock(&thread_info.mutex);
+
+        unsigned int target = (unsigned int)(busy_avg + 0.999) + tunables->low_threads;
+        if (queued > 0 || pool_stats.wait > POOL_MAX_WAIT) {
+            unsigned int needed = count - free + queued + tunables->low_threads;
+            if (needed > target)
+                target = needed;
+        }
+        if (target < tunables->min_threads)
+            target = tunables->min_threads;
+        if (target > max_threads)
+            target = max_threads;
+
+        if (target > count) {
+            idle_ticks = 0;
+            init_threads(target - count);
+        } else if (free > tunables->max_free_threads && count > target) {
+            if (++idle_ticks >= POOL_SHRINK_TICKS) {
+                //The thread who will read a termination order, will terminate
+                unsigned int retire = (count - target + 3) / 4;
+                if (retire > free - tunables->max_free_threads)
+                    retire = free - tunables->max_free_threads;
+                for (unsigned int i = 0; i < retire; i++)
+                    q_put(&queues[queue_most_idle()], -1);
+                idle_ticks = 0;
+            }
+        } else {
+            idle_ticks = 0;
+        }
+        tunables_release(tunables);
     }
-    last_action = time(NULL);
+    return NULL;
+}
+
+/**
+ * Waits for the signals blocked by block_signals().
+ * SIGHUP reloads the files that can change at runtime and SIGUSR1 prints
+ * the status, here where taking locks is safe. The others are passed to
+ * the main loop, that is the one that must stop accepting.
+ * The signals are blocked in all the other threads, so no system call
+ * is ever interrupted by them.
+ * */
+static void *signal_thread(void *sigset) {
+    int sig;
 
-    if (thread_info.free > MAXFREETHREAD) { //Too many free threads, terminates one of them
-        //Write the termination order to the queue, the thread who will read it, will terminate
-        q_put(&queue,-1);
+    while (sigwait((sigset_t *)sigset, &sig) == 0) {
+        if (sig == SIGUSR1) {
+            print_queue_status();
+            continue;
+        }
+        if (sig != SIGHUP) {
+            atomic_store(&pending_signal, sig);
+            if (write(wake_pipe[1], "", 1) == -1) {
+                //The pipe is full, the main loop is already being woken up
+            }
+            continue;
+        }
+#ifdef SERVERDBG
+        syslog(LOG_INFO, "Reloading configuration files");
+#endif
+        configuration_reload();
+        htpasswd_reload();
+        cachecontrol_reload();
+        mime_reload();
     }
+    return NULL;
+}
+
+/**
+ * Blocks SIGHUP, SIGUSR1, SIGTERM, SIGINT and SIGUSR2, it must be called
+ * before starting any thread so that they all inherit the mask.
+ * */
+static void block_signals(sigset_t *sigset) {
+    sigemptyset(sigset);
+    sigaddset(sigset, SIGHUP);
+    sigaddset(sigset, SIGUSR1);
+    sigaddset(sigset, SIGTERM);
+    sigaddset(sigset, SIGINT);
+    sigaddset(sigset, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, sigset, NULL);
 }
 
+/**
+ * Executes again the program, with the same command line, passing it the
+ * listening socket s. This starts the new version, when the executable
+ * has been replaced.
+ * Returns 0 if the new program is running, and this process must stop
+ * accepting connections, or -1 if it could not be started.
+ * */
+static int upgrade(int s, char *argv[]) {
+    int report[2]; //The child writes here errno if exec fails
+    char fd[NBUFFER];
+    int error;
+    ssize_t r;
+
+    if (pipe2(report, O_CLOEXEC) == -1)
+        return -1;
+
+    snprintf(fd, NBUFFER, "%d", s);
+    setenv(LISTEN_FD_ENV, fd, true);
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        sigset_t no_signals;
+        sigemptyset(&no_signals);
+        sigprocmask(SIG_SETMASK, &no_signals, NULL);
+
+        fcntl(s, F_SETFD, 0); //Must survive the exec
+        execvp(argv[0], argv);
+
+        error = errno;
+        if (write(report[1], &error, sizeof(error)) == -1) {
+            //Nothing else can be done, the parent will read EOF
+        }
+        _exit(1);
+    }
+
+    unsetenv(LISTEN_FD_ENV);
+    close(report[1]);
+    if (pid == -1) {
+        error = errno;
+        r = sizeof(error);
+    } else {
+        //EOF means that exec succeeded and closed the pipe
+        while ((r = read(report[0], &error, sizeof(error))) == -1 && errno == EINTR);
+        if (r > 0)
+            waitpid(pid, NULL, 0);
+    }
+    close(report[0]);
+
+    if (r > 0) {
+        syslog(LOG_ERR, "Unable to start %s: %s", argv[0], strerror(error));
+        return -1;
+    }
+    syslog(LOG_INFO, "Started new process %d, handing over the socket", pid);
+    return 0;
+}
 
 /**
- * Set quit action on SIGTERM and SIGINT
- * and prints the internal status on SIGUSR1
+ * Starts weborf_conf.processes workers, sharing the socket s, and starts
+ * them again if they terminate. Every worker has its own threads, so a
+ * crash only affects the requests of that process.
+ * SIGHUP and SIGUSR1 are forwarded to the workers. SIGTERM and SIGINT
+ * stop them, and the master exits when they are done. SIGUSR2 upgrades
+ * the master, that then stops its workers in the same way.
+ *
+ * Returns only in the workers, with the signal mask set by block_signals().
  * */
-static void init_signals() {
-    //Handle SIGINT and SIGTERM
-    signal(SIGINT, quit);
-    signal(SIGTERM, quit);
+static void supervise(int s, char *argv[], sigset_t *signal_set) {
+    pid_t *workers = calloc(weborf_conf.processes, sizeof(pid_t));
+    pid_t master = getpid();
+    unsigned int running = 0;
+    bool stopping = false;
+    sigset_t master_set, worker_mask;
+    int sig;
+
+    if (workers == NULL)
+        exit(NOMEM);
+
+    master_set = *signal_set;
+    sigaddset(&master_set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &master_set, &worker_mask);
+
+    while (true) {
+        for (unsigned int i = 0; i < weborf_conf.processes && !stopping; i++) {
+            if (workers[i] != 0)
+                continue;
+
+            pid_t pid = fork();
+            if (pid == 0) {
+                free(workers);
+                //The workers stop when the master dies
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+                if (getppid() != master)
+                    exit(0);
+                pthread_sigmask(SIG_SETMASK, &worker_mask, NULL);
+                mime_watch_reopen();
+                return;
+            } else if (pid == -1) {
+                syslog(LOG_ERR, "Unable to start a worker: %s", strerror(errno));
+                break;
+            }
+            workers[i] = pid;
+            running++;
+        }
 
-    //Prints queue status with this signal
-    signal(SIGUSR1, print_queue_status);
+        if (stopping && running == 0) {
+            closelog();
+            exit(0);
+        }
+
+        if (sigwait(&master_set, &sig) != 0)
+            continue;
+
+        switch (sig) {
+        case SIGCHLD: {
+            pid_t pid;
+            bool crashed = false;
+            while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+                for (unsigned int i = 0; i < weborf_conf.processes; i++) {
+                    if (workers[i] != pid)
+                        continue;
+                    workers[i] = 0;
+                    running--;
+                    crashed = !stopping;
+                }
+            }
+            //Doesn't fork continuously if the workers die when starting
+            if (crashed) {
+                syslog(LOG_ERR, "A worker terminated, starting it again");
+                sleep(1);
+            }
+            break;
+        }
+        case SIGUSR2:
+            if (stopping || upgrade(s, argv) != 0)
+                break;
+            //The new master is running, stops like on SIGTERM
+            /* fall through */
+        case SIGTERM:
+        case SIGINT:
+            if (!stopping) {
+                stopping = true;
+                close(s);
+            }
+            sig = SIGTERM;
+            /* fall through */
+        default:
+            for (unsigned int i = 0; i < weborf_conf.processes; i++)
+                if (workers[i] != 0)
+                    kill(workers[i], sig);
+        }
+    }
 }
 
 int main(int argc, char *argv[]) {
     int s, s1;          //Socket descriptors
+    static sigset_t signal_set;
 
+    block_signals(&signal_set);
     init_logger();
     init_thread_info();
 
     configuration_load(argc,argv);
 
-    if (weborf_conf.is_inetd) inetd();
+    if (weborf_conf.is_inetd) {
+        //There is no main loop to handle them
+        pthread_sigmask(SIG_UNBLOCK, &signal_set, NULL);
+        inetd();
+    }
+
+    s = net_inherited_socket();
+    if (s == -1) {
+        s = net_create_server_socket();
+        net_bind_and_listen(s);
+    }
+    net_set_listen_options(s);
+
+    //Returns in the workers
+    if (weborf_conf.processes > 1)
+        supervise(s, argv, &signal_set);
 
-    s = net_create_server_socket();
-    net_bind_and_listen(s);
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        exit(NOMEM);
 
     //init the queue for opened sockets
-    if (q_init(&queue, MAXTHREAD + 1) != 0)
+    weborf_tunables_t *tunables = tunables_acquire();
+    max_threads = tunables->max_threads;
+    queues_l = affinity_nodes();
+    queues = calloc(queues_l, sizeof(syn_queue_t));
+    if (queues == NULL)
+        exit(NOMEM);
+    //With coroutines, every thread takes many sockets
+    unsigned int queue_size = max_threads * (weborf_conf.coroutines ? weborf_conf.coroutines : 1) + 1;
+    for (unsigned int i = 0; i < queues_l; i++)
+        if (q_init(&queues[i], queue_size) != 0)
+            exit(NOMEM);
+
+    //Connections accepted in one wakeup, grouped by queue
+    int *batch = malloc(sizeof(int) * ACCEPT_BATCH * queues_l);
+    int *batch_l = malloc(sizeof(int) * queues_l);
+    if (batch == NULL || batch_l == NULL)
         exit(NOMEM);
 
     //Starts the 1st group of threads
     init_thread_attr();
-    init_threads(INITIALTHREAD);
-    init_signals();
-
-    struct pollfd poll_fds[1];
+    init_threads(tunables->initial_threads > tunables->min_threads ? tunables->initial_threads : tunables->min_threads);
+    tunables_release(tunables);
+    pthread_t controller_t;
+    pthread_create(&controller_t, &t_attr, pool_controller, NULL);
+    pthread_t signal_t;
+    pthread_create(&signal_t, &t_attr, signal_thread, &signal_set);
+
+    //Idle keep-alive connections wait in the listener, not in a thread
+    park_init();
+    struct timespec last_sweep;
+    clock_gettime(CLOCK_MONOTONIC, &last_sweep);
+
+    struct pollfd poll_fds[4];
     poll_fds[0].fd = s;
     poll_fds[0].events = POLLIN;
+    poll_fds[1].fd = mime_watch_fd(); //Ignored by poll if it is -1
+    poll_fds[1].events = POLLIN;
+    poll_fds[1].revents = 0;
+    poll_fds[2].fd = wake_pipe[0];
+    poll_fds[2].events = POLLIN;
+    poll_fds[3].fd = park_fd();
+    poll_fds[3].events = POLLIN;
+    poll_fds[3].revents = 0;
 
     while (1) {
-        if (poll(poll_fds, 1, 1000 * THREADCONTROL) == -1) {
+        //Wakes up often enough to close the parked connections that timed out
+        int timeout = park_count() > 0 ? PARK_SWEEP : 1000 * THREADCONTROL;
+        if (poll(poll_fds, 4, timeout) == -1) {
+            if (errno == EINTR)
+                continue;
 #ifdef SERVERDBG
             syslog(LOG_ERR, "Error polling server socket: %d", errno);
 #endif
             exit(11);
         }
 
+        if (poll_fds[2].revents & POLLIN) {
+            char c;
+            while (read(wake_pipe[0], &c, 1) == 1);
 
-        t_shape();
-
-        s1 = accept(s, NULL,NULL);
+            int sig = atomic_exchange(&pending_signal, 0);
+            if (sig == SIGTERM || sig == SIGINT || (sig == SIGUSR2 && upgrade(s, argv) == 0)) {
+                close(s); //The new process, if any, keeps accepting on its copy
+                quit();
+            }
+        }
 
-        if (s1 >= 0 && q_put(&queue, s1)!=0) { //Adds s1 to the queue
-#ifdef REQUESTDBG
-            syslog(LOG_ERR,"Not enough resources, dropping connection...");
-#endif
-            close(s1);
+        if (poll_fds[1].revents & POLLIN)
+            mime_handle_watch();
+        mime_reclaim();
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - last_sweep.tv_sec) * 1000 + (now.tv_nsec - last_sweep.tv_nsec) / 1000000 >= PARK_SWEEP) {
+            tunables = tunables_acquire();
+            park_expire(tunables->read_timeout);
+            tunables_release(tunables);
+            last_sweep = now;
         }
 
-        //Start new thread if needed
-        if (thread_info.free <= LOWTHREAD && thread_info.free<MAXTHREAD) { //Need to start new thread
-            if (thread_info.count + INITIALTHREAD < MAXTHREAD) { //Starts a group of threads
-                init_threads(INITIALTHREAD);
-            } else { //Can't start a group because the limit is close, starting less than a whole group
-                init_threads(MAXTHREAD - thread_info.count);
+        memset(batch_l, 0, sizeof(int) * queues_l);
+
+        //Parked connections with a new request go back in the queue, with the new ones
+        int ready_l = 0;
+        if (poll_fds[3].revents & POLLIN) {
+            int ready[ACCEPT_BATCH];
+            ready_l = park_ready(ready, ACCEPT_BATCH);
+            for (int i = 0; i < ready_l; i++) {
+                unsigned int q = queue_for(ready[i]);
+                batch[q * ACCEPT_BATCH + batch_l[q]++] = ready[i];
             }
         }
 
+        //Accepts all the pending connections, up to ACCEPT_BATCH, and queues them together
+        for (int i = ready_l; i < ACCEPT_BATCH; i++) {
+            //Not inherited by the CGI scripts and on upgrade, non blocking for the coroutines
+            s1 = accept4(s, NULL, NULL, SOCK_CLOEXEC | (weborf_conf.coroutines ? SOCK_NONBLOCK : 0));
+            if (s1 < 0)
+                break;
+
+            unsigned int q = queue_for(s1);
+            batch[q * ACCEPT_BATCH + batch_l[q]++] = s1;
+        }
+
+        for (unsigned int q = 0; q < queues_l; q++) {
+            int *fds = &batch[q * ACCEPT_BATCH];
+            for (int i = q_put_many(&queues[q], fds, batch_l[q]); i < batch_l[q]; i++) {
+#ifdef REQUESTDBG
+                syslog(LOG_ERR,"Not enough resources, dropping connection...");
+#endif
+                park_drop(fds[i]);
+            }
+        }
     }
     return 0;
 
 }
 
 /**
-SIGINT and SIGTERM signal handler
+Stops the server, on SIGINT and SIGTERM or after an upgrade.
+The caller must have stopped accepting connections.
+
+The threads terminate after the request they are serving, the
+connections are not kept alive anymore and the idle ones are closed
+when their read timeout expires.
+After drain-timeout the process exits anyway.
 */
 void quit() {
 #ifdef SERVERDBG
     syslog(LOG_INFO, "Stopping server...");
 #endif
+    atomic_store(&draining, true);
+
+    weborf_tunables_t *tunables = tunables_acquire();
+    struct timespec now, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += tunables->drain_timeout / 1000;
+    deadline.tv_nsec += (tunables->drain_timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    tunables_release(tunables);
+
+    //One termination order for every thread in every queue, no new thread is started now
+    pthread_mutex_lock(&thread_info.mutex);
+    unsigned int to_stop[queues_l];
+    for (unsigned int i = 0; i < queues_l; i++)
+        to_stop[i] = thread_info.count;
+    pthread_mutex_unlock(&thread_info.mutex);
+
+    while (1) {
+        //Nobody is waiting on them anymore, and threads might still park some
+        park_expire(0);
+
+        //They might not fit yet, if the queue still has connections
+        for (unsigned int i = 0; i < queues_l; i++)
+            while (to_stop[i] > 0 && q_put(&queues[i], -1) == 0)
+                to_stop[i]--;
+
+        pthread_mutex_lock(&thread_info.mutex);
+        unsigned int running = thread_info.count;
+        pthread_mutex_unlock(&thread_info.mutex);
+
+        if (running == 0)
+            break;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+            syslog(LOG_WARNING, "%u threads still running, exiting anyway", running);
+            break;
+        }
+        usleep(100000);
+    }
 
     closelog();
     exit(0);
@@ -232,17 +675,20 @@ void quit() {
 
 /**
 Will print the internal status of the queue.
-This function is triggered by SIGUSR1 signal.
+This function is called by the signal thread on SIGUSR1.
 */
 void print_queue_status() {
 
     //Lock because the values are read many times and it's needed that they have the same value all the times
 
-    if ( pthread_mutex_trylock(&queue.mutex)==0) {
-        printf("Queue is unlocked\n");
-        pthread_mutex_unlock(&queue.mutex);
-    } else {
-        printf("Queue is locked\n");
+    for (unsigned int i = 0; i < queues_l; i++) {
+        syn_queue_t *queue = &queues[i];
+        if ( pthread_mutex_trylock(&queue->mutex)==0) {
+            printf("Queue %u is unlocked\n", i);
+            pthread_mutex_unlock(&queue->mutex);
+        } else {
+            printf("Queue %u is locked\n", i);
+        }
     }
 
 
@@ -253,23 +699,54 @@ void print_queue_status() {
         printf("thread_info is locked\n");
     }
 
+    for (unsigned int i = 0; i < queues_l; i++) {
+        syn_queue_t *queue = &queues[i];
+        pthread_mutex_lock(&queue->mutex);
+        printf("=== Queue %u ===\ncount:      %d\t"
+               "size:       %d\n"
+               "head:       %d\t"
+               "tail:       %d\n"
+               "wait_data:  %d\t"
+               "wait_space: %d\n",
+               i,
+               queue->num,queue->size,
+               queue->head,queue->tail,
+               queue->n_wait_dt,queue->n_wait_sp
+              );
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
     pthread_mutex_lock(&thread_info.mutex);
-    printf("=== Queue ===\ncount:      %d\t"
-           "size:       %d\n"
-           "head:       %d\t"
-           "tail:       %d\n"
-           "wait_data:  %d\t"
-           "wait_space: %d\n"
-           "=== Threads ===\n"
+    printf("=== Threads ===\n"
            "Maximum:    %d\n"
            "Started:    %d\n"
            "Free:       %d\n"
-           "Busy:       %d\n",
-           queue.num,queue.size,
-           queue.head,queue.tail,
-           queue.n_wait_dt,queue.n_wait_sp,
-           MAXTHREAD,thread_info.count,
-           thread_info.free,thread_info.count-thread_info.free
+           "Busy:       %d\n"
+           "Arrivals/s: %.1f\n"
+           "Queue wait: %lluus\n"
+           "Parked:     %u\n",
+           max_threads,thread_info.count,
+           thread_info.free,thread_info.count-thread_info.free,
+           pool_stats.arrivals,pool_stats.wait,
+           park_count()
           );
     pthread_mutex_unlock(&thread_info.mutex);
+
+    cgi_print_status(&weborf_conf.default_vhost);
+
+    //The hosts of the same block share the limits, they are printed once
+    vhost_table_t *vhosts = vhost_acquire();
+    if (vhosts) {
+        cgi_limit_t *printed = weborf_conf.default_vhost.cgi_limits;
+        vhost_t *vhost;
+        for (size_t i = 0; (vhost = vhost_at(vhosts, i)) != NULL; i++) {
+            if (vhost->cgi_limits == printed || vhost->cgi_limits == weborf_conf.default_vhost.cgi_limits)
+                continue;
+            printed = vhost->cgi_limits;
+            cgi_print_status(vhost);
+        }
+        vhost_release(vhosts);
+    }
+    auth_cache_print_status();
+    fflush(stdout);
 }
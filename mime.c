@@ -18,588 +18,277 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 @author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
 */
 #include "options.h"
-#include <stdbool.h>
 
-#include <string.h>
-#include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
-typedef struct mimetype_t
-{
-    const char *name;
+#include "mime.h"
+#include "mimetable.h"
+#include "mime_table.h"
+
+/**
+ * Table loaded from a mime.types file.
+ * */
+typedef struct mime_loaded_t {
+    mimetable_t *table;
+    char *buf;                  //Content of the file, the strings of the table point here
     const char **exts;
-} mimetype_t;
-
-const mimetype_t mimetype_map[] = {
-    {
-        "text/html",
-        (const char *[]){
-            ".html",
-            ".htm",
-            ".shtml",
-            ".h5",
-            NULL,
-        },
-    },
-    {
-        "text/css",
-        (const char *[]){
-            ".css",
-            ".scss",
-            NULL,
-        },
-    },
-    {
-        "text/xml",
-        (const char *[]){
-            ".xml",
-            NULL,
-        },
-    },
-    {
-        "image/gif",
-        (const char *[]){
-            ".gif",
-            NULL,
-        },
-    },
-    {
-        "image/jpeg",
-        (const char *[]){
-            ".jpeg",
-            ".jpg",
-            NULL,
-        },
-    },
-    {
-        "application/javascript",
-        (const char *[]){
-            ".js",
-            ".ts",
-            NULL,
-        },
-    },
-    {
-        "application/atom+xml",
-        (const char *[]){
-            ".atom",
-            NULL,
-        },
-    },
-    {
-        "application/rss+xml",
-        (const char *[]){
-            ".rss",
-            NULL,
-        },
-    },
-    {
-        "text/plain",
-        (const char *[]){
-            ".txt",
-            ".log",
-            ".pid",
-            NULL,
-        },
-    },
-    {
-        "text/vnd.sun.j2me.app-descriptor",
-        (const char *[]){
-            ".jad",
-            NULL,
-        },
-    },
-    {
-        "text/vnd.wap.wml",
-        (const char *[]){
-            ".wml",
-            NULL,
-        },
-    },
-    {
-        "text/x-component",
-        (const char *[]){
-            ".htc",
-            NULL,
-        },
-    },
-    {
-        "image/png",
-        (const char *[]){
-            ".png",
-            NULL,
-        },
-    },
-    {
-        "image/svg+xml",
-        (const char *[]){
-            ".svg",
-            ".svgz",
-            NULL,
-        },
-    },
-    {
-        "image/tiff",
-        (const char *[]){
-            ".tif",
-            ".tiff",
-            NULL,
-        },
-    },
-    {
-        "image/vnd.wap.wbmp",
-        (const char *[]){
-            ".wbmp",
-            NULL,
-        },
-    },
-    {
-        "image/webp",
-        (const char *[]){
-            ".webp",
-            NULL,
-        },
-    },
-    {
-        "image/x-icon",
-        (const char *[]){
-            ".ico",
-            NULL,
-        },
-    },
-    {
-        "image/x-ms-bmp",
-        (const char *[]){
-            ".bmp",
-            NULL,
-        },
-    },
-    {
-        "font/woff",
-        (const char *[]){
-            ".woff",
-            NULL,
-        },
-    },
-    {
-        "font/woff2",
-        (const char *[]){
-            ".woff2",
-            NULL,
-        },
-    },
-    {
-        "application/java-archive",
-        (const char *[]){
-            ".jar",
-            ".war",
-            ".ear",
-            NULL,
-        },
-    },
-    {
-        "application/json",
-        (const char *[]){
-            ".json",
-            NULL,
-        },
-    },
-    {
-        "application/mac-binhex40",
-        (const char *[]){
-            ".hqx",
-            NULL,
-        },
-    },
-    {
-        "application/msword",
-        (const char *[]){
-            ".doc",
-            NULL,
-        },
-    },
-    {
-        "application/pdf",
-        (const char *[]){
-            ".pdf",
-            NULL,
-        },
-    },
-    {
-        "application/postscript",
-        (const char *[]){
-            ".ps",
-            ".eps",
-            ".ai",
-            NULL,
-        },
-    },
-    {
-        "application/rtf",
-        (const char *[]){
-            ".rtf",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.apple.mpegurl",
-        (const char *[]){
-            ".m3u8",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.google-earth.kml+xml",
-        (const char *[]){
-            ".kml",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.google-earth.kmz",
-        (const char *[]){
-            ".kmz",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.ms-excel",
-        (const char *[]){
-            ".xls",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.ms-fontobject",
-        (const char *[]){
-            ".eot",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.ms-powerpoint",
-        (const char *[]){
-            ".ppt",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.oasis.opendocument.graphics",
-        (const char *[]){
-            ".odg",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.oasis.opendocument.presentation",
-        (const char *[]){
-            ".odp",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.oasis.opendocument.spreadsheet",
-        (const char *[]){
-            ".ods",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.oasis.opendocument.text",
-        (const char *[]){
-            ".odt",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.openxmlformats-officedocument.presentationml.presentation",
-        (const char *[]){
-            ".pptx",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet",
-        (const char *[]){
-            ".xlsx",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.openxmlformats-officedocument.wordprocessingml.document",
-        (const char *[]){
-            ".docx",
-            NULL,
-        },
-    },
-    {
-        "application/vnd.wap.wmlc",
-        (const char *[]){
-            ".wmlc",
-            NULL,
-        },
-    },
-    {
-        "application/x-7z-compressed",
-        (const char *[]){
-            ".7z",
-            NULL,
-        },
-    },
-    {
-        "application/x-cocoa",
-        (const char *[]){
-            ".cco",
-            NULL,
-        },
-    },
-    {
-        "application/x-java-archive-diff",
-        (const char *[]){
-            ".jardiff",
-            NULL,
-        },
-    },
-    {
-        "application/x-java-jnlp-file",
-        (const char *[]){
-            ".jnlp",
-            NULL,
-        },
-    },
-    {
-        "application/x-makeself",
-        (const char *[]){
-            ".run",
-            NULL,
-        },
-    },
-    {
-        "application/x-perl",
-        (const char *[]){
-            ".pl",
-            ".pm",
-            NULL,
-        },
-    },
-    {
-        "application/x-rar-compressed",
-        (const char *[]){
-            ".rar",
-            NULL,
-        },
-    },
-    {
-        "application/x-redhat-package-manager",
-        (const char *[]){
-            ".rpm",
-            NULL,
-        },
-    },
-    {
-        "application/x-sea",
-        (const char *[]){
-            ".sea",
-            NULL,
-        },
-    },
-    {
-        "application/x-shockwave-flash",
-        (const char *[]){
-            ".swf",
-            NULL,
-        },
-    },
-    {
-        "application/x-x509-ca-cert",
-        (const char *[]){
-            ".der",
-            ".pem",
-            ".crt",
-            NULL,
-        },
-    },
-    {
-        "application/x-xpinstall",
-        (const char *[]){
-            ".xpi",
-            NULL,
-        },
-    },
-    {
-        "application/xhtml+xml",
-        (const char *[]){
-            ".xhtml",
-            NULL,
-        },
-    },
-    {
-        "application/xspf+xml",
-        (const char *[]){
-            ".xspf",
-            NULL,
-        },
-    },
-    {
-        "application/zip",
-        (const char *[]){
-            ".zip",
-            NULL,
-        },
-    },
-    {
-        "audio/midi",
-        (const char *[]){
-            ".mid",
-            ".midi",
-            ".kar",
-            NULL,
-        },
-    },
-    {
-        "audio/mpeg",
-        (const char *[]){
-            ".mp3",
-            NULL,
-        },
-    },
-    {
-        "audio/ogg",
-        (const char *[]){
-            ".ogg",
-            ".opus",
-            NULL,
-        },
-    },
-    {
-        "audio/x-m4a",
-        (const char *[]){
-            ".m4a",
-            ".aac",
-            NULL,
-        },
-    },
-    {
-        "audio/x-realaudio",
-        (const char *[]){
-            ".ra",
-            NULL,
-        },
-    },
-    {
-        "video/3gpp",
-        (const char *[]){
-            ".3gpp",
-            ".3gp",
-            NULL,
-        },
-    },
-    {
-        "video/mp2t",
-        (const char *[]){
-            ".ts",
-            ".m2ts",
-            NULL,
-        },
-    },
-    {
-        "video/mp4",
-        (const char *[]){
-            ".mp4",
-            NULL,
-        },
-    },
-    {
-        "video/mpeg",
-        (const char *[]){
-            ".mpeg",
-            ".mpg",
-            NULL,
-        },
-    },
-    {
-        "video/quicktime",
-        (const char *[]){
-            ".mov",
-            NULL,
-        },
-    },
-    {
-        "video/webm",
-        (const char *[]){
-            ".webm",
-            ".mkv",
-            NULL,
-        },
-    },
-    {
-        "video/x-flv",
-        (const char *[]){
-            ".flv",
-            NULL,
-        },
-    },
-    {
-        "video/x-m4v",
-        (const char *[]){
-            ".m4v",
-            NULL,
-        },
-    },
-    {
-        "video/x-msvideo",
-        (const char *[]){
-            ".avi",
-            NULL,
-        },
-    },
-    {
-        0,
-    }};
-
-char *strlowr(char *str)
-{
-    char *orign = str;
-    for (; *str != '\0'; str++)
-    {
-        *str = tolower(*str);
+    const char **types;
+    time_t retired;             //When it was replaced, on the monotonic clock
+    struct mime_loaded_t *next; //Next replaced table waiting to be freed
+} mime_loaded_t;
+
+//Read without locks by get_mime()
+static _Atomic(mime_loaded_t *) mime_current = NULL;
+
+static pthread_mutex_t mime_mutex = PTHREAD_MUTEX_INITIALIZER; //Serializes reloads and reclaims
+static mime_loaded_t *mime_retired = NULL;
+static char *mime_path = NULL;
+static int mime_watch = -1;
+
+static void mime_free(mime_loaded_t *loaded) {
+    mimetable_free(loaded->table);
+    free(loaded->exts);
+    free(loaded->types);
+    free(loaded->buf);
+    free(loaded);
+}
+
+/**
+ * Parses a file in the format of /etc/mime.types: every line contains
+ * a type followed by its extensions, separated by spaces.
+ * Returns NULL in case of error.
+ * */
+static mime_loaded_t *mime_load(char *path) {
+    mime_loaded_t *loaded = calloc(1, sizeof(mime_loaded_t));
+    if (loaded == NULL)
+        return NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+    if (fd == -1 || fstat(fd, &sb) == -1 || (loaded->buf = malloc(sb.st_size + 1)) == NULL) {
+        if (fd != -1)
+            close(fd);
+        free(loaded);
+        return NULL;
+    }
+    ssize_t r = read(fd, loaded->buf, sb.st_size);
+    close(fd);
+    if (r < 0) {
+        mime_free(loaded);
+        return NULL;
+    }
+    loaded->buf[r] = 0;
+
+    //Every extension is preceded by a blank
+    size_t max = 0;
+    for (char *c = loaded->buf; *c; c++)
+        if (*c == ' ' || *c == '\t')
+            max++;
+    loaded->exts = malloc((max + 1) * sizeof(char *));
+    loaded->types = malloc((max + 1) * sizeof(char *));
+    if (loaded->exts == NULL || loaded->types == NULL) {
+        mime_free(loaded);
+        return NULL;
+    }
+
+    size_t count = 0;
+    char *l_line;
+    for (char *line = strtok_r(loaded->buf, "\n", &l_line); line; line = strtok_r(NULL, "\n", &l_line)) {
+        char *l_field;
+        char *type = strtok_r(line, " \t\r", &l_field);
+        if (type == NULL || type[0] == '#')
+            continue;
+
+        for (char *ext = strtok_r(NULL, " \t\r", &l_field); ext; ext = strtok_r(NULL, " \t\r", &l_field)) {
+            loaded->exts[count] = ext[0] == '.' ? ext + 1 : ext;
+            loaded->types[count++] = type;
+        }
+    }
+
+    loaded->table = mimetable_build(loaded->exts, loaded->types, count);
+    if (loaded->table == NULL) {
+        mime_free(loaded);
+        return NULL;
+    }
+    return loaded;
+}
+
+/**
+ * Returns the seconds on a clock that changes of the system time don't
+ * move, so they can't free a table earlier.
+ * */
+static time_t mime_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ * Frees the replaced tables that nobody can be using any longer.
+ *
+ * Readers never take locks, so a replaced table is kept for
+ * MIME_RECLAIM_GRACE seconds, much longer than a lookup (and the use of
+ * the returned string) can take. Who keeps the type during a transfer
+ * must copy it.
+ * */
+void mime_reclaim() {
+    time_t now = mime_now();
+
+    pthread_mutex_lock(&mime_mutex);
+    mime_loaded_t **prev = &mime_retired;
+    while (*prev) {
+        mime_loaded_t *loaded = *prev;
+        if (now - loaded->retired >= MIME_RECLAIM_GRACE) {
+            *prev = loaded->next;
+            mime_free(loaded);
+        } else {
+            prev = &loaded->next;
+        }
+    }
+    pthread_mutex_unlock(&mime_mutex);
+}
+
+/**
+ * Loads the file again and publishes the new table.
+ * If the file can't be loaded the current table is kept.
+ * */
+void mime_reload() {
+    if (mime_path == NULL)
+        return;
+
+    mime_loaded_t *loaded = mime_load(mime_path);
+    if (loaded == NULL) {
+        syslog(LOG_ERR, "Unable to load %s, keeping the previous MIME types", mime_path);
+        return;
+    }
+
+    pthread_mutex_lock(&mime_mutex);
+    mime_loaded_t *old = atomic_exchange_explicit(&mime_current, loaded, memory_order_acq_rel);
+    if (old) {
+        old->retired = mime_now();
+        old->next = mime_retired;
+        mime_retired = old;
+    }
+    pthread_mutex_unlock(&mime_mutex);
+
+    syslog(LOG_INFO, "Loaded MIME types from %s", mime_path);
+    mime_reclaim();
+}
+
+static void mime_watch_open() {
+#ifdef HAVE_SYS_INOTIFY_H
+    //Watches the directory, editors and package managers replace the file
+    char *dir = strdup(mime_path);
+    if (dir) {
+        mime_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (mime_watch != -1 && inotify_add_watch(mime_watch, dirname(dir), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1) {
+            close(mime_watch);
+            mime_watch = -1;
+        }
+        free(dir);
     }
-    return orign;
+#endif
+}
+
+/**
+ * Loads the MIME types from path, in addition to the builtin ones, and
+ * watches the file for changes. Terminates if the file can't be loaded.
+ * */
+void mime_init(char *path) {
+    mime_path = path;
+
+    mime_loaded_t *loaded = mime_load(path);
+    if (loaded == NULL) {
+        fprintf(stderr, "Unable to load MIME types from %s\n", path);
+        exit(6);
+    }
+    atomic_store_explicit(&mime_current, loaded, memory_order_release);
+    mime_watch_open();
+}
+
+/**
+ * Replaces the watch inherited with fork(), that would deliver each
+ * event to only one of the processes sharing it.
+ * */
+void mime_watch_reopen() {
+    if (mime_watch == -1)
+        return;
+    close(mime_watch);
+    mime_watch = -1;
+    mime_watch_open();
+}
+
+/**
+ * Returns the file descriptor to poll to know when the file changes,
+ * -1 if there is none.
+ * */
+int mime_watch_fd() {
+    return mime_watch;
+}
+
+/**
+ * Reads the pending events on mime_watch_fd(), and reloads the file if
+ * it was changed.
+ * */
+void mime_handle_watch() {
+#ifdef HAVE_SYS_INOTIFY_H
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    char *copy = strdup(mime_path);
+    if (copy == NULL)
+        return;
+    char *name = basename(copy);
+
+    while ((len = read(mime_watch, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            if (event->len && strcmp(event->name, name) == 0)
+                changed = true;
+        }
+    }
+    free(copy);
+
+    if (changed)
+        mime_reload();
+#endif
 }
 
 /**
 returns mimetype of an filextension
+
+The lookup ignores the case of the extension and doesn't modify fname.
 */
 const char *get_mime(const char *fname)
 {
-
     if (!fname)
         return MIME_DEFAULT;
 
-    const mimetype_t *itr = mimetype_map;
-    char *needle = strrchr(fname, '.');
-    *needle = *strlowr(needle);
-
-    size_t len = strlen(needle);
-
-    while (itr->name)
-    {
-        const char **ext = itr->exts;
-        while (*ext)
-        {
-            const bool match =
-                strncmp(*ext, needle, len) == 0 && (*ext)[len] == 0;
-            if (match)
-            {
-                return itr->name;
-            }
-            ++ext;
-        }
-        ++itr;
-    }
+    const char *dot = strrchr(fname, '.');
+    if (dot == NULL || strchr(dot, '/') != NULL) //No extension
+        return MIME_DEFAULT;
 
-    return MIME_DEFAULT;
-}
\ No newline at end of file
+    size_t len = strlen(dot + 1);
+    const char *type = NULL;
+
+    mime_loaded_t *loaded = atomic_load_explicit(&mime_current, memory_order_acquire);
+    if (loaded)
+        type = mimetable_lookup(loaded->table, dot + 1, len);
+    if (type == NULL)
+        type = mimetable_lookup(&mime_builtin, dot + 1, len);
+    return type ? type : MIME_DEFAULT;
+}
@@ -7,4 +7,10 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-const char *get_mime(const char* fname);
\ No newline at end of file
+const char *get_mime(const char* fname);
+void mime_init(char *path);
+void mime_reload();
+int mime_watch_fd();
+void mime_watch_reopen();
+void mime_handle_watch();
+void mime_reclaim();
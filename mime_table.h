@@ -0,0 +1,594 @@
+/* Generated by mimegen from mime_types.h, do not edit */
+
+static uint32_t mime_builtin_seeds[] = {
+    2,
+    1,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    1,
+    0,
+    0,
+    1,
+    3,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    1,
+    2,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    1,
+    0,
+    0,
+    0,
+    3,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    5,
+    0,
+    2,
+    1,
+    0,
+    0,
+    2,
+    1,
+    1,
+    1,
+    0,
+    0,
+    0,
+    1,
+    0,
+    0,
+    0,
+    1,
+};
+
+static const char *mime_builtin_exts[] = {
+    "midi",
+    NULL,
+    "rar",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "webm",
+    NULL,
+    "3gpp",
+    "avi",
+    NULL,
+    "zip",
+    NULL,
+    "ai",
+    "ra",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "wbmp",
+    NULL,
+    NULL,
+    "js",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "xspf",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "xhtml",
+    "h5",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "m2ts",
+    "3gp",
+    NULL,
+    NULL,
+    "xpi",
+    NULL,
+    "pl",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "jar",
+    NULL,
+    "mov",
+    NULL,
+    "eps",
+    "mp4",
+    NULL,
+    NULL,
+    NULL,
+    "opus",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "tiff",
+    "rpm",
+    "ear",
+    "mid",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "ogg",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "mkv",
+    NULL,
+    "ppt",
+    NULL,
+    "ods",
+    "docx",
+    NULL,
+    "htm",
+    NULL,
+    "eot",
+    "odp",
+    "swf",
+    NULL,
+    NULL,
+    NULL,
+    "aac",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "pptx",
+    NULL,
+    NULL,
+    "bmp",
+    "jardiff",
+    NULL,
+    "webp",
+    NULL,
+    NULL,
+    "woff2",
+    NULL,
+    NULL,
+    NULL,
+    "ps",
+    "m4v",
+    NULL,
+    NULL,
+    "7z",
+    NULL,
+    "log",
+    NULL,
+    "xlsx",
+    NULL,
+    "mp3",
+    NULL,
+    NULL,
+    "mpeg",
+    "txt",
+    "jad",
+    NULL,
+    "sea",
+    "m3u8",
+    NULL,
+    "pid",
+    "gif",
+    "json",
+    "svgz",
+    NULL,
+    "odg",
+    "htc",
+    NULL,
+    "tif",
+    "war",
+    "crt",
+    NULL,
+    NULL,
+    NULL,
+    "pdf",
+    NULL,
+    "pem",
+    "mpg",
+    NULL,
+    NULL,
+    NULL,
+    "odt",
+    "run",
+    NULL,
+    "png",
+    "kml",
+    NULL,
+    "xls",
+    "rss",
+    "m4a",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "html",
+    NULL,
+    "xml",
+    NULL,
+    NULL,
+    "css",
+    "der",
+    NULL,
+    NULL,
+    NULL,
+    "ico",
+    "rtf",
+    NULL,
+    "jnlp",
+    NULL,
+    NULL,
+    "wmlc",
+    "cco",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "scss",
+    NULL,
+    NULL,
+    NULL,
+    "kar",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "kmz",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "svg",
+    NULL,
+    NULL,
+    "jpg",
+    NULL,
+    "jpeg",
+    "hqx",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "doc",
+    NULL,
+    NULL,
+    "ts",
+    NULL,
+    "woff",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "shtml",
+    "atom",
+    "flv",
+    "wml",
+    NULL,
+    NULL,
+    "pm",
+    NULL,
+    NULL,
+};
+
+static const char *mime_builtin_types[] = {
+    "audio/midi",
+    NULL,
+    "application/x-rar-compressed",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "video/webm",
+    NULL,
+    "video/3gpp",
+    "video/x-msvideo",
+    NULL,
+    "application/zip",
+    NULL,
+    "application/postscript",
+    "audio/x-realaudio",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "image/vnd.wap.wbmp",
+    NULL,
+    NULL,
+    "application/javascript",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "application/xspf+xml",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "application/xhtml+xml",
+    "text/html",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "video/mp2t",
+    "video/3gpp",
+    NULL,
+    NULL,
+    "application/x-xpinstall",
+    NULL,
+    "application/x-perl",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "application/java-archive",
+    NULL,
+    "video/quicktime",
+    NULL,
+    "application/postscript",
+    "video/mp4",
+    NULL,
+    NULL,
+    NULL,
+    "audio/ogg",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "image/tiff",
+    "application/x-redhat-package-manager",
+    "application/java-archive",
+    "audio/midi",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "audio/ogg",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "video/webm",
+    NULL,
+    "application/vnd.ms-powerpoint",
+    NULL,
+    "application/vnd.oasis.opendocument.spreadsheet",
+    "application/vnd.openxmlformats-officedocument.wordprocessingml.document",
+    NULL,
+    "text/html",
+    NULL,
+    "application/vnd.ms-fontobject",
+    "application/vnd.oasis.opendocument.presentation",
+    "application/x-shockwave-flash",
+    NULL,
+    NULL,
+    NULL,
+    "audio/x-m4a",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "application/vnd.openxmlformats-officedocument.presentationml.presentation",
+    NULL,
+    NULL,
+    "image/x-ms-bmp",
+    "application/x-java-archive-diff",
+    NULL,
+    "image/webp",
+    NULL,
+    NULL,
+    "font/woff2",
+    NULL,
+    NULL,
+    NULL,
+    "application/postscript",
+    "video/x-m4v",
+    NULL,
+    NULL,
+    "application/x-7z-compressed",
+    NULL,
+    "text/plain",
+    NULL,
+    "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet",
+    NULL,
+    "audio/mpeg",
+    NULL,
+    NULL,
+    "video/mpeg",
+    "text/plain",
+    "text/vnd.sun.j2me.app-descriptor",
+    NULL,
+    "application/x-sea",
+    "application/vnd.apple.mpegurl",
+    NULL,
+    "text/plain",
+    "image/gif",
+    "application/json",
+    "image/svg+xml",
+    NULL,
+    "application/vnd.oasis.opendocument.graphics",
+    "text/x-component",
+    NULL,
+    "image/tiff",
+    "application/java-archive",
+    "application/x-x509-ca-cert",
+    NULL,
+    NULL,
+    NULL,
+    "application/pdf",
+    NULL,
+    "application/x-x509-ca-cert",
+    "video/mpeg",
+    NULL,
+    NULL,
+    NULL,
+    "application/vnd.oasis.opendocument.text",
+    "application/x-makeself",
+    NULL,
+    "image/png",
+    "application/vnd.google-earth.kml+xml",
+    NULL,
+    "application/vnd.ms-excel",
+    "application/rss+xml",
+    "audio/x-m4a",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "text/html",
+    NULL,
+    "text/xml",
+    NULL,
+    NULL,
+    "text/css",
+    "application/x-x509-ca-cert",
+    NULL,
+    NULL,
+    NULL,
+    "image/x-icon",
+    "application/rtf",
+    NULL,
+    "application/x-java-jnlp-file",
+    NULL,
+    NULL,
+    "application/vnd.wap.wmlc",
+    "application/x-cocoa",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "text/css",
+    NULL,
+    NULL,
+    NULL,
+    "audio/midi",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "application/vnd.google-earth.kmz",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "image/svg+xml",
+    NULL,
+    NULL,
+    "image/jpeg",
+    NULL,
+    "image/jpeg",
+    "application/mac-binhex40",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "application/msword",
+    NULL,
+    NULL,
+    "application/javascript",
+    NULL,
+    "font/woff",
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    "text/html",
+    "application/atom+xml",
+    "video/x-flv",
+    "text/vnd.wap.wml",
+    NULL,
+    NULL,
+    "application/x-perl",
+    NULL,
+    NULL,
+};
+
+static const mimetable_t mime_builtin = {
+    256,
+    64,
+    mime_builtin_seeds,
+    mime_builtin_exts,
+    mime_builtin_types,
+};
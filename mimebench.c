@@ -0,0 +1,93 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+/**
+ * Microbenchmark of get_mime(), compared with a scan of the whole list
+ * as it was done before the hash table.
+ *
+ * Build with "make mimebench", run with the number of iterations.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "options.h"
+#include "mime.h"
+#include "mime_types.h"
+
+static const char *names[] = {
+    "/srv/www/index.html",
+    "/srv/www/style.CSS",
+    "/srv/www/foto/IMG_0001.JPG",
+    "/srv/www/video/holiday.mp4",
+    "/srv/www/app.js",
+    "/srv/www/data.tar.gz",
+    "/srv/www/README",
+    "/srv/www/font.woff2",
+    "/srv/www/archive.zip",
+    "/srv/www/unknown.xyz",
+};
+#define NAMES (sizeof(names) / sizeof(char *))
+
+static const char *linear_mime(const char *fname) {
+    const char *needle = strrchr(fname, '.');
+    if (needle == NULL)
+        return MIME_DEFAULT;
+
+    for (const mimetype_t *itr = mimetype_map; itr->name; itr++)
+        for (const char **ext = itr->exts; *ext; ext++)
+            if (strcasecmp(*ext, needle) == 0)
+                return itr->name;
+    return MIME_DEFAULT;
+}
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void bench(const char *name, const char *(*f)(const char *), long iterations) {
+    volatile size_t sink = 0;
+    double start = now();
+    for (long i = 0; i < iterations; i++)
+        for (size_t n = 0; n < NAMES; n++)
+            sink += (size_t)f(names[n]);
+    double elapsed = now() - start;
+    printf("%-8s %8.1f ns/lookup\n", name, elapsed * 1e9 / (iterations * NAMES));
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+
+    for (size_t n = 0; n < NAMES; n++) {
+        if (strcmp(get_mime(names[n]), linear_mime(names[n])) != 0) {
+            fprintf(stderr, "Mismatch for %s: %s %s\n", names[n], get_mime(names[n]), linear_mime(names[n]));
+            return 1;
+        }
+    }
+
+    bench("linear", linear_mime, iterations);
+    bench("hash", get_mime, iterations);
+    return 0;
+}
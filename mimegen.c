@@ -0,0 +1,88 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+/**
+ * Build time generator for mime_table.h.
+ *
+ * Reads the builtin list in mime_types.h, builds the perfect hash table
+ * and prints it as C source, so that weborf starts with the table ready.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mimetable.h"
+#include "mime_types.h"
+
+static void print_strings(const char *name, const char **strings, uint32_t size) {
+    printf("static const char *%s[] = {\n", name);
+    for (uint32_t i = 0; i < size; i++) {
+        if (strings[i])
+            printf("    \"%s\",\n", strings[i]);
+        else
+            printf("    NULL,\n");
+    }
+    printf("};\n\n");
+}
+
+int main() {
+    size_t count = 0;
+    for (const mimetype_t *itr = mimetype_map; itr->name; itr++)
+        for (const char **ext = itr->exts; *ext; ext++)
+            count++;
+
+    const char **exts = malloc(count * sizeof(char *));
+    const char **types = malloc(count * sizeof(char *));
+    if (exts == NULL || types == NULL)
+        return 1;
+
+    size_t i = 0;
+    for (const mimetype_t *itr = mimetype_map; itr->name; itr++)
+        for (const char **ext = itr->exts; *ext; ext++) {
+            exts[i] = *ext[0] == '.' ? *ext + 1 : *ext;
+            types[i++] = itr->name;
+        }
+
+    mimetable_t *table = mimetable_build(exts, types, count);
+    if (table == NULL) {
+        fprintf(stderr, "Unable to build the MIME table\n");
+        return 1;
+    }
+
+    printf("/* Generated by mimegen from mime_types.h, do not edit */\n\n");
+    printf("static uint32_t mime_builtin_seeds[] = {\n");
+    for (uint32_t b = 0; b < table->buckets; b++)
+        printf("    %u,\n", table->seeds[b]);
+    printf("};\n\n");
+    print_strings("mime_builtin_exts", table->exts, table->size);
+    print_strings("mime_builtin_types", table->types, table->size);
+    printf("static const mimetable_t mime_builtin = {\n"
+           "    %u,\n"
+           "    %u,\n"
+           "    mime_builtin_seeds,\n"
+           "    mime_builtin_exts,\n"
+           "    mime_builtin_types,\n"
+           "};\n", table->size, table->buckets);
+
+    mimetable_free(table);
+    free(exts);
+    free(types);
+    return 0;
+}
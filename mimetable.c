@@ -0,0 +1,177 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mimetable.h"
+
+#define MAX_SEED 100000         //Gives up on a table size after trying this many seeds for a bucket
+
+typedef struct {
+    uint32_t first;             //Position of the first key in the sorted list
+    uint32_t count;             //Keys in the bucket
+    uint32_t id;
+} mimetable_bucket_t;
+
+static int mimetable_bucket_cmp(const void *a, const void *b) {
+    const mimetable_bucket_t *x = a, *y = b;
+    if (x->count != y->count)
+        return x->count > y->count ? -1 : 1;
+    return x->id < y->id ? -1 : 1;
+}
+
+void mimetable_free(mimetable_t *table) {
+    if (table == NULL)
+        return;
+    free(table->seeds);
+    free(table->exts);
+    free(table->types);
+    free(table);
+}
+
+/**
+ * Tries to place all the keys in a table of the given size.
+ * Returns NULL if a seed could not be found for some bucket.
+ * */
+static mimetable_t *mimetable_place(const char **exts, const char **types, size_t count, uint32_t size) {
+    mimetable_t *table = calloc(1, sizeof(mimetable_t));
+    mimetable_bucket_t *buckets = NULL;
+    uint32_t *order = NULL;
+    uint32_t *key_bucket = NULL;
+    uint32_t *slots = NULL;     //Slots of the keys of the bucket being placed
+
+    if (table == NULL)
+        return NULL;
+    table->size = size;
+    table->buckets = size / 4;
+    table->seeds = calloc(table->buckets, sizeof(uint32_t));
+    table->exts = calloc(size, sizeof(char *));
+    table->types = calloc(size, sizeof(char *));
+    buckets = calloc(table->buckets, sizeof(mimetable_bucket_t));
+    order = malloc(count * sizeof(uint32_t));
+    key_bucket = malloc(count * sizeof(uint32_t));
+    slots = malloc(count * sizeof(uint32_t));
+    if (!table->seeds || !table->exts || !table->types || !buckets || (count && (!order || !key_bucket || !slots)))
+        goto fail;
+
+    //Groups the keys by bucket, dropping the repeated ones
+    for (size_t i = 0; i < count; i++) {
+        key_bucket[i] = mimetable_hash(exts[i], strlen(exts[i]), 0) & (table->buckets - 1);
+        buckets[key_bucket[i]].count++;
+    }
+    for (uint32_t b = 0, pos = 0; b < table->buckets; b++) {
+        buckets[b].id = b;
+        buckets[b].first = pos;
+        pos += buckets[b].count;
+        buckets[b].count = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        mimetable_bucket_t *bucket = &buckets[key_bucket[i]];
+        bool repeated = false;
+        for (uint32_t j = 0; j < bucket->count; j++)
+            if (strcasecmp(exts[order[bucket->first + j]], exts[i]) == 0)
+                repeated = true;
+        if (!repeated)
+            order[bucket->first + bucket->count++] = i;
+    }
+
+    //The biggest buckets are placed first, while the table is still empty
+    qsort(buckets, table->buckets, sizeof(mimetable_bucket_t), mimetable_bucket_cmp);
+
+    for (uint32_t b = 0; b < table->buckets && buckets[b].count; b++) {
+        mimetable_bucket_t *bucket = &buckets[b];
+        uint32_t seed;
+
+        for (seed = 0; seed < MAX_SEED; seed++) {
+            uint32_t k;
+            for (k = 0; k < bucket->count; k++) {
+                const char *ext = exts[order[bucket->first + k]];
+                slots[k] = mimetable_hash(ext, strlen(ext), seed) & (size - 1);
+
+                bool taken = table->exts[slots[k]] != NULL;
+                for (uint32_t j = 0; j < k && !taken; j++)
+                    taken = slots[j] == slots[k];
+                if (taken)
+                    break;
+            }
+            if (k == bucket->count)
+                break;
+        }
+        if (seed == MAX_SEED)
+            goto fail;
+
+        table->seeds[bucket->id] = seed;
+        for (uint32_t k = 0; k < bucket->count; k++) {
+            table->exts[slots[k]] = exts[order[bucket->first + k]];
+            table->types[slots[k]] = types[order[bucket->first + k]];
+        }
+    }
+
+    free(buckets);
+    free(order);
+    free(key_bucket);
+    free(slots);
+    return table;
+
+fail:
+    free(buckets);
+    free(order);
+    free(key_bucket);
+    free(slots);
+    mimetable_free(table);
+    return NULL;
+}
+
+/**
+ * Builds a table from count extensions (without the dot) and their types.
+ *
+ * The strings are not copied, they must remain valid as long as the table
+ * is used. When an extension is repeated, only its first type is kept.
+ * Returns NULL if there is not enough memory.
+ * */
+mimetable_t *mimetable_build(const char **exts, const char **types, size_t count) {
+    uint32_t size = 8;
+    while (size < count * 2)
+        size *= 2;
+
+    for (int attempt = 0; attempt < 4; attempt++, size *= 2) {
+        mimetable_t *table = mimetable_place(exts, types, count, size);
+        if (table)
+            return table;
+    }
+    return NULL;
+}
+
+/**
+ * Returns the MIME type of the extension, of length len, or NULL if
+ * it is not in the table. The case of the extension is ignored.
+ * */
+const char *mimetable_lookup(const mimetable_t *table, const char *ext, size_t len) {
+    uint32_t bucket = mimetable_hash(ext, len, 0) & (table->buckets - 1);
+    uint32_t slot = mimetable_hash(ext, len, table->seeds[bucket]) & (table->size - 1);
+    const char *key = table->exts[slot];
+
+    if (key != NULL && strncasecmp(key, ext, len) == 0 && key[len] == 0)
+        return table->types[slot];
+    return NULL;
+}
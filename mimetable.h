@@ -0,0 +1,65 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_MIMETABLE_H
+#define WEBORF_MIMETABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Perfect hash table mapping file extensions (without the dot) to MIME types.
+ *
+ * A key goes in bucket hash(key, 0), and the seed of the bucket gives its
+ * slot: hash(key, seed). Seeds are chosen when building so that no two keys
+ * share a slot, so a lookup computes two hashes and compares one string.
+ * */
+typedef struct {
+    uint32_t size;              //Slots, power of 2
+    uint32_t buckets;           //Buckets, power of 2
+    uint32_t *seeds;            //Seed of every bucket
+    const char **exts;          //Extension in every slot, NULL if the slot is empty
+    const char **types;         //MIME type in every slot
+} mimetable_t;
+
+/**
+ * Case insensitive FNV-1a, with a final mix so that the low bits,
+ * used for the slot, depend on the whole key.
+ * */
+static inline uint32_t mimetable_hash(const char *key, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = key[i];
+        if (c >= 'A' && c <= 'Z')
+            c |= 0x20;
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+mimetable_t *mimetable_build(const char **exts, const char **types, size_t count);
+void mimetable_free(mimetable_t *table);
+const char *mimetable_lookup(const mimetable_t *table, const char *ext, size_t len);
+
+#endif
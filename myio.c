@@ -17,11 +17,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 @author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
 */
+#define _GNU_SOURCE //For splice(), pipe2(), F_SETPIPE_SZ and copy_file_range()
 #include "options.h"
 
 #include <sys/types.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -29,22 +32,77 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <syslog.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <poll.h>
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h> //For FICLONE
+#endif
 
 #include "instance.h"
 #include "types.h"
 #include "myio.h"
+#include "coro.h"
 
 #ifdef HAVE_LIBSSL
+/**
+ * Waits until the SSL operation that returned r can be retried, for up
+ * to timeout milliseconds.
+ * Returns false if it failed for another reason, or on timeout.
+ */
+static bool myio_ssl_retry(SSL *ssl, int r, int timeout) {
+    switch (SSL_get_error(ssl, r)) {
+    case SSL_ERROR_WANT_READ:
+        return coro_wait(SSL_get_fd(ssl), POLLIN, timeout) > 0;
+    case SSL_ERROR_WANT_WRITE:
+        return coro_wait(SSL_get_fd(ssl), POLLOUT, timeout) > 0;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Does the TLS handshake, waiting up to timeout milliseconds
+ * every time the client is slow.
+ * Returns 1 on success, like SSL_accept.
+ */
+int myio_ssl_accept(SSL *ssl, int timeout) {
+    int r;
+    while ((r = SSL_accept(ssl)) != 1 && myio_ssl_retry(ssl, r, timeout));
+    return r;
+}
+#endif
+
 /*
  * Does a write to an fd_t
  *
  * If there is an ssl object attached, it will do an ssl write,
  * otherwise it will do a normal write.
+ * Non blocking sockets, used by the coroutines, are waited for
+ * until everything is written.
  */
 int myio_write(fd_t fd, const void *buf, size_t count) {
-    if (fd.ssl)
-        return SSL_write(fd.ssl, buf, count);
-    return write(fd.fd, buf, count);
+    size_t wrote = 0;
+
+    while (wrote < count) {
+        int r;
+#ifdef HAVE_LIBSSL
+        if (fd.ssl) {
+            r = SSL_write(fd.ssl, buf + wrote, count - wrote);
+            if (r <= 0 && myio_ssl_retry(fd.ssl, r, -1))
+                continue;
+        } else
+#endif
+        {
+            r = write(myio_getfd(fd), buf + wrote, count - wrote);
+            if (r == -1 && errno == EAGAIN && coro_wait(myio_getfd(fd), POLLOUT, -1) > 0)
+                continue;
+        }
+
+        if (r <= 0)
+            return wrote > 0 ? wrote : r;
+        wrote += r;
+    }
+    return wrote;
 }
 
 /**
@@ -52,23 +110,35 @@ int myio_write(fd_t fd, const void *buf, size_t count) {
  *
  * If there is an ssl object attached, it will do an ssl read,
  * otherwise it will do a normal read.
+ * Non blocking sockets are waited for until some data arrives.
  */
 int myio_read(fd_t fd, void *buf, size_t count) {
-    if (fd.ssl)
-        return SSL_read(fd.ssl, buf, count);
-    return read(fd.fd, buf, count);
-}
+    while (true) {
+        int r;
+#ifdef HAVE_LIBSSL
+        if (fd.ssl) {
+            r = SSL_read(fd.ssl, buf, count);
+            if (r <= 0 && myio_ssl_retry(fd.ssl, r, -1))
+                continue;
+            return r;
+        }
 #endif
+        r = read(myio_getfd(fd), buf, count);
+        if (r == -1 && errno == EAGAIN && coro_wait(myio_getfd(fd), POLLIN, -1) > 0)
+            continue;
+        return r;
+    }
+}
 
 /**
 Copies count bytes from the file descriptor "from" to the
-file descriptor "to".
-It is possible to use lseek on the descriptors before calling
-this function.
-Will not close any descriptor
+file descriptor "to", with reads of bufsize bytes.
+
+Returns 0 if all of them were copied, ERR_BRKPIPE if "from" ended
+earlier or "to" could not be written.
 */
-int fd_copy(fd_t from, fd_t to, off_t count) {
-    char *buf=malloc(FILEBUF);//Buffer to read from file
+static int fd_copy_buf(fd_t from, fd_t to, off_t count, size_t bufsize) {
+    char *buf=malloc(bufsize);//Buffer to read from file
     int reads,wrote;
 
     if (buf==NULL) {
@@ -79,11 +149,10 @@ int fd_copy(fd_t from, fd_t to, off_t count) {
     }
 
     //Sends file
-    while (count>0 && (reads=myio_read(from, buf, FILEBUF<count ? FILEBUF : count)) > 0) {
+    while (count>0 && (reads=myio_read(from, buf, bufsize<count ? bufsize : count)) > 0) {
         if (reads == 0) { // Descriptor is over
             return ERR_NODATA;
         }
-        count -= reads;
         wrote = myio_write(to, buf, reads);
         if (wrote != reads) { //Error writing to the descriptor
 #ifdef SOCKETDBG
@@ -91,66 +160,129 @@ int fd_copy(fd_t from, fd_t to, off_t count) {
 #endif
             break;
         }
+        count -= reads;
     }
 
     free(buf);
-    return 0;
+    return count > 0 ? ERR_BRKPIPE : 0;
 }
 
-
 /**
-Returns true if the specified file exists
+Copies count bytes from the file descriptor "from" to the
+file descriptor "to".
+It is possible to use lseek on the descriptors before calling
+this function.
+Will not close any descriptor
 */
-bool file_exists(char *file) {
-    return access(file, R_OK) == 0;
+int fd_copy(fd_t from, fd_t to, off_t count) {
+    return fd_copy_buf(from, to, count, FILEBUF);
 }
 
 /**
-Deletes a directory and its content.
-This function is something like rm -rf
+Sends count bytes of the file "from" to "to", starting from the
+current position of the file.
 
-dir is the directory to delete
-file is a buffer. Allocated outside because it
-will be reused by every recoursive call.
-Its size is file_s
+If use_sendfile is true and "to" is not an SSL connection, the data
+is copied by the kernel with sendfile(2). Otherwise, or if the file
+doesn't support it, it is copied with reads of bufsize bytes.
+Will not close any descriptor
 
-Returns 0 on success
+Returns 0 if all of them were sent, ERR_BRKPIPE if the file was
+truncated or the client is gone.
 */
-int dir_remove(char * dir) {
-    /*
-    If it is a file, removes it
-    Otherwise list the directory's content,
-    then do a recoursive call and do
-    rmdir on self
-    */
-    if (unlink(dir)==0)
-        return 0;
-
-    DIR *dp = opendir(dir); //Open dir
-    struct dirent *entry;
+int fd_send(int from, fd_t to, off_t count, size_t bufsize, bool use_sendfile) {
+#ifdef HAVE_LIBSSL
+    if (to.ssl)
+        use_sendfile = false;
+#endif
 
-    if (dp == NULL) {
-        return 1;
+    while (use_sendfile && count > 0) {
+        ssize_t sent = sendfile(myio_getfd(to), from, NULL, count);
+        if (sent > 0) {
+            count -= sent;
+        } else if (sent == -1 && errno == EINTR) {
+            continue;
+        } else if (sent == -1 && errno == EAGAIN && coro_wait(myio_getfd(to), POLLOUT, -1) > 0) {
+            continue;
+        } else if (sent == -1 && (errno == EINVAL || errno == ENOSYS)) {
+            break; //Copies the rest normally
+        } else { //The file was truncated or the client is gone
+#ifdef SOCKETDBG
+            syslog(LOG_ERR, "error sending the file");
+#endif
+            return ERR_BRKPIPE;
+        }
     }
 
-    char*file=malloc(PATH_LEN);//Buffer for path
-    if (file==NULL)
-        return ERR_NOMEM;
+    if (count == 0)
+        return 0;
+    return fd_copy_buf(fd2fd_t(from), to, count, bufsize);
+}
+
+/**
+Receives count bytes from the socket "from" and writes them to the file
+"to", at its current position. The data goes through a pipe with
+splice(2), so it is never copied in user space.
+Waits up to timeout milliseconds every time the client is slow.
+
+Returns the bytes written, less than count if the client went away or
+the file could not be written, or -1 if splice can't be used and the
+caller must copy the data itself.
+*/
+ssize_t fd_receive(fd_t from, int to, off_t count, int timeout) {
+#ifdef HAVE_SPLICE
+    int sock = myio_getfd(from);
+    int pipefd[2];
+    off_t received = 0;
 
-    //Cycles trough dir's elements
-    while ((entry=readdir(dp)) != NULL) { //Cycles trough dir's elements
+#ifdef HAVE_LIBSSL
+    if (from.ssl)
+        return -1;
+#endif
+    if (pipe2(pipefd, O_CLOEXEC) == -1)
+        return -1;
+    //Larger pipes need fewer calls, the default size is used if it is not allowed
+    fcntl(pipefd[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+
+    while (received < count) {
+        if (coro_wait(sock, POLLIN, timeout) <= 0) //Timeout
+            break;
 
-        //skips dir . and .. but not all hidden files
-        if (entry->d_name[0]=='.' && (entry->d_name[1]==0 || (entry->d_name[1]=='.' && entry->d_name[2]==0)))
+        ssize_t r = splice(sock, NULL, pipefd[1], NULL, count - received, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (r == -1 && (errno == EAGAIN || errno == EINTR))
             continue;
+        if (r == -1 && received == 0 && (errno == EINVAL || errno == ENOSYS)) {
+            received = -1; //Not supported for this socket or file
+            break;
+        }
+        if (r <= 0) //The client is gone
+            break;
 
-        snprintf(file, PATH_LEN, "%s/%s", dir, entry->d_name);
-        dir_remove(file);
+        //Empties the pipe into the file
+        while (r > 0) {
+            ssize_t w = splice(pipefd[0], NULL, to, NULL, r, SPLICE_F_MOVE);
+            if (w <= 0)
+                goto end;
+            r -= w;
+            received += w;
+        }
     }
 
-    closedir(dp);
-    free(file);
-    return rmdir(dir);
+end:
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return received;
+#else
+    return -1;
+#endif
+}
+
+
+/**
+Returns true if the specified file exists
+*/
+bool file_exists(char *file) {
+    return access(file, R_OK) == 0;
 }
 
 #ifdef WEBDAV
@@ -173,140 +305,94 @@ int file_move(char* source, char* dest) {
 }
 
 /**
-Copies a file into another file
+Copies the content of fd_from into fd_to.
+The copy is first attempted as a clone sharing the extents, then with
+copy_file_range(), that stays inside the kernel, and finally with reads
+and writes for the filesystems that support neither.
 
 Returns 0 on success
 */
-int file_copy(char* source, char* dest) {
-    int fd_from=-1;
-    int fd_to=-1;
-    ssize_t read_,write_;
-    int retval=0;
-    char *buf=NULL;
-
-    //Open destination file
-    if ((fd_to=open(dest,O_WRONLY|O_CREAT,S_IRUSR|S_IWUSR))<0) {
-        retval=ERR_FORBIDDEN;
-        goto escape;
-    }
-
-    if ((fd_from=open(source,O_RDONLY | O_LARGEFILE))<0) {
-        retval = ERR_FILENOTFOUND;
-        goto escape;
-    }
+static int fd_copy_content(int fd_from, int fd_to) {
+#ifdef FICLONE
+    if (ioctl(fd_to, FICLONE, fd_from) == 0)
+        return 0;
+#endif
 
-    buf=malloc(FILEBUF);//Buffer to read from file
-    if (buf==NULL) {
-        retval= ERR_NOMEM;
-        goto escape;
+#ifdef HAVE_COPY_FILE_RANGE
+    bool copied = false;
+    for (;;) {
+        ssize_t r = copy_file_range(fd_from, NULL, fd_to, NULL, COPY_CHUNK, 0);
+        if (r == 0)
+            return 0;
+        if (r > 0) {
+            copied = true;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        //Unsupported for these files, nothing has been copied yet
+        if (!copied && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+            break;
+        return (errno == ENOSPC || errno == EDQUOT) ? ERR_INSUFFICIENT_STORAGE : ERR_BRKPIPE;
     }
+#endif
 
-    while ((read_=read(fd_from,buf,FILEBUF))>0) {
-        write_=write(fd_to,buf,read_);
+    char *buf = malloc(COPY_BUFFER);
+    if (buf == NULL)
+        return ERR_NOMEM;
 
-        if (write_!=read_) {
-            retval= ERR_BRKPIPE;
+    int retval = 0;
+    ssize_t read_;
+    while ((read_ = read(fd_from, buf, COPY_BUFFER)) > 0) {
+        if (write(fd_to, buf, read_) != read_) {
+            retval = (errno == ENOSPC || errno == EDQUOT) ? ERR_INSUFFICIENT_STORAGE : ERR_BRKPIPE;
             break;
         }
     }
-
-escape:
+    if (read_ < 0)
+        retval = ERR_BRKPIPE;
     free(buf);
-    if (fd_from>=0) close(fd_from);
-    if (fd_to>=0) close(fd_to);
     return retval;
 }
 
-/**This function copies a directory.
-The destination directory will be created and
-will be filled with the same content of the source directory
-
-Returns 0 on success
-*/
-int dir_copy (char* source, char* dest) {
-    return dir_move_copy(source,dest,COPY);
-}
-
-/**This function moves a directory.
-The destination directory will be created and
-will be filled with the same content of the source directory.
-Then, the source directory will be deleted.
-
-Returns 0 on success
-*/
-int dir_move(char* source, char* dest) {
-    int retval;
-
-    if ((retval=rename(source,dest))==0) {
-        return 0;
-    } else if (retval==-1 && errno==EXDEV) {
-        return dir_move_copy(source,dest,MOVE);
-    } else {
-        return 1;
-    }
-
-}
-
 /**
-Moves or copies a directory, depending on the method used
+Copies a file into another file, keeping its permissions and times.
+The names are relative to the directories src_dir and dest_dir, that
+can be AT_FDCWD.
 
 Returns 0 on success
 */
-int dir_move_copy (char* source, char* dest,int method) {
-    struct stat f_prop; //File's property
+int file_copy_at(int src_dir, const char* source, int dest_dir, const char* dest) {
+    int fd_from=-1;
+    int fd_to=-1;
     int retval=0;
+    struct stat f_prop;
 
-    if (mkdir(dest,S_IRWXU | S_IRWXG | S_IRWXO)!=0) {//Attemps to create destination directory
-        return ERR_FORBIDDEN;
+    if ((fd_from=openat(src_dir,source,O_RDONLY | O_LARGEFILE))<0 || fstat(fd_from,&f_prop)!=0) {
+        retval = ERR_FILENOTFOUND;
+        goto escape;
     }
 
-    DIR *dp = opendir(source); //Open dir
-    struct dirent *entry;
-    int return_code;
-
-
-    if (dp == NULL) {
-        return ERR_FILENOTFOUND;
+    //Open destination file
+    if ((fd_to=openat(dest_dir,dest,O_WRONLY|O_CREAT|O_TRUNC,S_IRUSR|S_IWUSR))<0) {
+        retval=ERR_FORBIDDEN;
+        goto escape;
     }
 
-    char*src_file=malloc(PATH_LEN*2);//Buffer for path
-    if (src_file==NULL)
-        return ERR_NOMEM;
-    char* dest_file=src_file+PATH_LEN;
-
-    //Cycles trough dir's elements
-    while ((entry=readdir(dp)) != NULL) {
-
-        //skips dir . and .. but not all hidden files
-        if (entry->d_name[0]=='.' && (entry->d_name[1]==0 || (entry->d_name[1]=='.' && entry->d_name[2]==0)))
-            continue;
+    if ((retval=fd_copy_content(fd_from,fd_to))!=0)
+        goto escape;
 
-        snprintf(src_file,PATH_LEN,"%s/%s",source, entry->d_name);
-        snprintf(dest_file,PATH_LEN,"%s/%s",dest, entry->d_name);
-
-        stat(src_file, &f_prop);
-        if (S_ISDIR(f_prop.st_mode)) {//Directory
-            retval=dir_move_copy(src_file,dest_file,method);
-        } else {//File
-            if (method==MOVE) {
-                retval=file_move(src_file,dest_file);
-            } else {
-                retval=file_copy(src_file,dest_file);
-            }
-        }
-
-        if (retval!=0)
-            goto escape;
-    }
+    struct timespec times[2] = {f_prop.st_atim, f_prop.st_mtim};
+    fchmod(fd_to,f_prop.st_mode & 07777);
+    futimens(fd_to,times);
 
 escape:
-    closedir(dp);
-    free(src_file);
-
-    //Removing directory after that its content has been moved
-    if (retval==0 && method==MOVE) {
-        return rmdir(source);
-    }
+    if (fd_from>=0) close(fd_from);
+    if (fd_to>=0) close(fd_to);
     return retval;
 }
+
+int file_copy(char* source, char* dest) {
+    return file_copy_at(AT_FDCWD,source,AT_FDCWD,dest);
+}
 #endif
@@ -24,9 +24,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "types.h"
 #include "options.h"
 
-#ifdef HAVE_LIBSSL
 int myio_write(fd_t fd, const void *buf, size_t count);
 int myio_read(fd_t fd, void *buf, size_t count);
+
+#ifdef HAVE_LIBSSL
+int myio_ssl_accept(SSL *ssl, int timeout);
 static inline int myio_getfd(fd_t fd) { return fd.fd; }
 static inline fd_t fd2fd_t(int fd) {
     fd_t r;
@@ -35,22 +37,19 @@ static inline fd_t fd2fd_t(int fd) {
     return r;
 }
 #else
-#define myio_read read
-#define myio_write write
 static inline int myio_getfd(fd_t fd) { return fd; }
 static inline fd_t fd2fd_t(int fd) { return fd; }
 #endif
 
 int fd_copy(fd_t from, fd_t to, off_t count);
-int dir_remove(char * dir);
+int fd_send(int from, fd_t to, off_t count, size_t bufsize, bool use_sendfile);
+ssize_t fd_receive(fd_t from, int to, off_t count, int timeout);
 bool file_exists(char *file);
 
 #ifdef WEBDAV
-int dir_move_copy (char* source, char* dest,int method);
+int file_copy_at(int src_dir, const char* source, int dest_dir, const char* dest);
 int file_copy(char* source, char* dest);
 int file_move(char* source, char* dest);
-int dir_move (char* source, char* dest);
-int dir_copy (char* source, char* dest);
 #endif
 
 #endif
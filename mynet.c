@@ -29,6 +29,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "types.h"
 #include "mynet.h"
@@ -77,12 +79,58 @@ int net_create_server_socket() {
     }
 
     int flags = fcntl(s, F_GETFL, 0);
-    flags |= O_NONBLOCK | O_CLOEXEC;
+    flags |= O_NONBLOCK;
     fcntl(s, F_SETFL, flags);
+    fcntl(s, F_SETFD, FD_CLOEXEC); //Not inherited by the CGI scripts
 
     return s;
 }
 
+/**
+ * Returns the listening socket passed by the process that started
+ * this one, or -1 if there is none.
+ *
+ * It is either the one passed in LISTEN_FD_ENV, when upgrading, or
+ * the first one passed by systemd socket activation (LISTEN_FDS).
+ * */
+int net_inherited_socket() {
+    char *env = getenv(LISTEN_FD_ENV);
+    char *listen_pid = getenv("LISTEN_PID");
+    char *listen_fds = getenv("LISTEN_FDS");
+    int s;
+
+    if (env != NULL) {
+        s = strtol(env, NULL, 10);
+        unsetenv(LISTEN_FD_ENV); //Must not reach the CGI scripts
+    } else if (listen_pid != NULL && listen_fds != NULL && strtol(listen_pid, NULL, 10) == getpid()) {
+        int count = strtol(listen_fds, NULL, 10);
+        if (count < 1)
+            return -1;
+        if (count > 1)
+            syslog(LOG_WARNING, "Received %d sockets, only the first one is used", count);
+        s = SD_LISTEN_FDS_START;
+        unsetenv("LISTEN_PID");
+        unsetenv("LISTEN_FDS");
+        unsetenv("LISTEN_FDNAMES");
+    } else {
+        return -1;
+    }
+
+    int val;
+    socklen_t len = sizeof(val);
+    if (getsockopt(s, SOL_SOCKET, SO_ACCEPTCONN, &val, &len) != 0 || !val) {
+        syslog(LOG_ERR, "Inherited file descriptor %d is not a listening socket", s);
+        return -1;
+    }
+
+    int flags = fcntl(s, F_GETFL, 0);
+    fcntl(s, F_SETFL, flags | O_NONBLOCK);
+    fcntl(s, F_SETFD, FD_CLOEXEC);
+
+    syslog(LOG_INFO, "Listening on inherited socket %d", s);
+    return s;
+}
+
 #ifdef IPV6
 /**
  * Accepts an ip address.
@@ -166,7 +214,19 @@ void net_bind_and_listen(int s) {
         syslog(LOG_ERR, "Port %u already in use", port);
         exit(3);
     }
-    listen(s, MAXQ); //Listen to the socket
+    listen(s, weborf_conf.backlog); //Listen to the socket
+}
+
+
+/**
+ * Sets the options of the listening socket that also apply to the
+ * inherited ones.
+ * With TCP_DEFER_ACCEPT a connection is accepted only when the request
+ * arrives, so the threads never wait for it.
+ * */
+void net_set_listen_options(int s) {
+    if (weborf_conf.defer_accept > 0 && setsockopt(s, IPPROTO_TCP, TCP_DEFER_ACCEPT, &weborf_conf.defer_accept, sizeof(weborf_conf.defer_accept)) != 0)
+        syslog(LOG_WARNING, "Unable to set TCP_DEFER_ACCEPT");
 }
 
 
@@ -24,7 +24,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "types.h"
 #include "options.h"
 
+//Environment variable with the listening socket, passed on upgrade
+#define LISTEN_FD_ENV "WEBORF_LISTEN_FD"
+
+//First socket passed by systemd socket activation
+#define SD_LISTEN_FDS_START 3
+
 int net_create_server_socket();
+int net_inherited_socket();
+void net_set_listen_options(int s);
 void net_bind_and_listen(int s);
 void net_getpeername(int,char*);
 
@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "mystring.h"
 
@@ -132,3 +133,18 @@ false otherwise
 bool endsWith(char *str, char *end, size_t len_str, size_t len_end) {
     return strcmp(str+len_str-len_end,end)==0;
 }
+
+/**
+FNV-1a hash of the first len bytes of data.
+
+Used for the hash tables of the server, it is fast but not meant to
+resist collisions crafted on purpose.
+*/
+uint64_t string_hash(const char *data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -21,6 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef WEBORF_MYSTRING_H
 #define WEBORF_MYSTRING_H
 
+#include <stdint.h>
+
 #include "types.h"
 
 void split_get_params(connection_t* connection_prop);
@@ -29,5 +31,6 @@ void delChar(char *string, int pos, int n);
 void strReplace(char *string, char *substr, char with);
 void replaceEscape(char *string);
 void strToUpper(char *str);
+uint64_t string_hash(const char *data, size_t len);
 
 #endif
@@ -0,0 +1,163 @@
+/*
+Weborf
+Copyright (C) 2007-2019  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+ */
+
+#include "config.h"
+#include <unistd.h> //Needed because it defines the _POSIX_IPV6
+
+#ifndef WEBORF_OPTIONS_H
+#define WEBORF_OPTIONS_H
+
+#define NAME "WebList"
+//#define VERSION PACKAGE_VERSION
+#define SIGNATURE NAME "/" VERSION  " (GNU/Linux)"
+
+//----------Network
+#define MAXQ 64                 //Default queue for connect requests, see --backlog
+#define ACCEPT_BATCH 64         //Connections accepted at every wakeup of the main loop
+#define PARK_SWEEP 500          //Milliseconds between the checks for timed out idle connections
+#define PORT "8080"             //Default port
+
+#ifdef _POSIX_IPV6              //Enables ipv6 if supported
+//Delete the following line to use IPv4 instead.
+#define IPV6
+#endif
+
+#ifdef IPV6
+#define IPVERSION '6'
+#else
+#define IPVERSION '4'
+#endif
+
+//The values of the threads, READ_TIMEOUT, DRAIN_TIMEOUT, INBUFFER, FILEBUF, MAXSCRIPTOUT,
+//BUFFERED_READER_SIZE and POST_MAX_SIZE are the defaults of the tunables
+//that can be changed at runtime with --config
+
+//-----------Threads
+#define MAXTHREAD 300           //Max threads
+#define MINTHREAD 3             //Threads that are always running
+#define INITIALTHREAD 6         //Threads started when starting
+#define LOWTHREAD 3             //Free threads kept ready for the bursts
+#define MAXFREETHREAD 6         //Maximum number of free threads, before starting to slowly close them
+#define THREADCONTROL 10        //Polling frequence in seconds
+#define POOL_INTERVAL 100       //Milliseconds between the decisions of the pool controller
+#define POOL_MAX_WAIT 1000      //Microseconds a socket can wait in the queue before the pool grows
+#define POOL_SHRINK_TICKS 10    //Intervals with too many free threads before retiring some
+#define MAXPROCESSES 256        //Max value for --processes
+#define MAXCOROUTINES 65536     //Max value for --coroutines
+#define COROUTINE_STACK 262144  //Stack of every coroutine, in bytes
+#define COROUTINE_POLL 10       //Milliseconds between the checks of the queue by a thread running coroutines
+
+//------------Server
+#define INDEX "index.html"      //Default index file that weborf will search
+#define BASEDIR "/mnt"      //Default basedir
+#define READ_TIMEOUT 6000       //Timeout before closing inactive keep-alive connections, in milliseconds
+#define DRAIN_TIMEOUT 30000     //Time given to the open connections to finish when stopping, in milliseconds
+
+//------------Buffers
+#define INBUFFER 1024           //Size for buffer with the HTTP request
+#define FILEBUF 4096            //Size of reads
+#define COPY_CHUNK 1073741824   //Bytes moved by every copy_file_range() of a WebDAV COPY or MOVE
+#define COPY_BUFFER 131072      //Buffer to copy files when the kernel can't do it
+#define TREE_WORKERS 4          //Threads walking a collection for DELETE, COPY and MOVE, including the one of the request
+#define TREE_MAXFAILURES 64     //Failed members listed in the multistatus response, the others are omitted
+#define MAXSCRIPTOUT  512000    //Maximum size for a page generated by a script or internally
+#define HEADBUF 1024            //Buffer for headers
+#define URING_BUFFER 65536      //Registered buffer of every thread, smaller files are sent with one io_uring submission
+#define SPLICE_PIPE_SIZE 1048576//Pipe moving the uploaded files from the socket to the disk
+#define PUT_TEMP_SUFFIX ".weborf-XXXXXX"//Uploads are written to a temporary file next to the destination
+#define PUT_PARTIAL_SUFFIX ".weborf-partial"//Staging file of the uploads sent in parts with Content-Range
+#define UPLOAD_EXTENTS_SUFFIX ".extents"//Added to the staging file, for the list of the parts received
+#define UPLOAD_MAXEXTENTS 16    //Separate parts of an upload, a part that would make more is refused
+#define UPLOADRANGELEN (UPLOAD_MAXEXTENTS * 42 + 8)//Range header listing the parts of an upload
+#define PWDLIMIT 300            //Max size for password
+#define INDEXMAXLEN 30
+#define NBUFFER 15              //Buffer to contain the string representation of an integer
+#define RBUFFER 128             //Buffer to contain a range
+#define MAXRANGES 16            //More ranges in a request are ignored, and the whole file is sent
+#define BOUNDARYLEN 17          //Boundary of the multipart/byteranges responses
+#define BUFFERED_READER_SIZE 2048
+#define DATEBUFFER 50           //Buffer for text date
+#define URI_LEN 256
+#define ESCAPED_FNAME_LEN 256 * 3 //To contain escaped filenames, d_name size is 256 on linux
+#define PATH_LEN 1024
+#define MIMETYPELEN 15          //Size of mimetype string
+
+//Number of index pages allowed to search
+#define MAXINDEXCOUNT 10
+
+//-------------LIMITS
+#define POST_MAX_SIZE 2000000   //Maximum allowed size for POST data
+
+//-------------HTML
+#define CSS_PAGE "/.style.css"
+#define HTMLHEAD "<!DOCTYPE HTML>\n" \
+    "<html><head><meta http-equiv=\"content-type\" content=\"text/html; charset=UTF-8\"><title>" NAME "</title> <link rel=\"stylesheet\" href=\"" CSS_PAGE "\"></head>" \
+    "<body><h2>" NAME "</h2><div>"
+#define HTMLFOOT "</div><span>" SIGNATURE "</span></body></html>"
+
+//-------------SCRIPTS
+#define SCRPT_TIMEOUT 60        //Timeout for the scripts, in seconds
+
+#define CGI_MAXRUNNING 16       //Scripts executed at the same time by each interpreter, 0 for no limit
+#define CGI_MAXWAITING 64       //Requests allowed to wait for an interpreter to be free
+#define CGI_WAIT_TIMEOUT 10000  //Maximum wait for an interpreter to be free, in milliseconds
+#define CGI_RETRY_AFTER "5"     //Retry-After sent when a request is refused, in seconds
+
+#define CGI_PHP "/usr/data/bin/php"
+#define CGI_PY "/usr/data/bin/python"
+
+//-------------COMPRESSING PAGES
+//#define __COMPRESSION         //enables support for compressing pages, comment to disable
+#ifdef __COMPRESSION
+#define SIZE_COMPRESS_MIN 512
+#define SIZE_COMPRESS_MAX 4000000000
+#define GZIPNICE 4              //Nice value for gzip process
+#endif
+
+#define ETAGLEN 56              //Strong ETag, 3 64 bit numbers in hex, quotes included
+#define HTTPDATELEN 32          //Date in the format of Last-Modified
+#define CACHECONTROLLEN 64      //Cache-Control header of a rule of --cache-control
+#define CACHECONTROL_RECLAIM_GRACE 30//Seconds replaced --cache-control rules are kept before freeing them
+
+#define SEND_MIMETYPES          //Enables support to sending the mimetype to the client
+#define MIME_DEFAULT "application/octet-stream"
+#define MIME_RECLAIM_GRACE 30   //Seconds a replaced MIME table is kept before freeing it
+
+//-------------RANGE
+#define __RANGE                 //Enables support to range (partial download)
+
+//-------------WEBDAV
+#define WEBDAV                  //Enables webdav support
+#define MAXPROPCOUNT 100         //Number of supported properties
+
+//-------------Logging options
+#define THREADDBG
+#define SOCKETDBG
+#define SENDINGDBG
+#define SERVERDBG
+#define REQUESTDBG
+
+//EMBEDDED_AUTH is defined by configure, unless --disable-embedded-auth is given
+
+//-------------AUTHENTICATION CACHE
+#define AUTH_CACHE_SIZE 1024    //Decisions kept by the cache, must be a power of 2
+#define AUTH_CACHE_LOCKS 16     //Mutexes protecting the cache, must divide AUTH_CACHE_SIZE
+
+#endif
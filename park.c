@@ -0,0 +1,257 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include "options.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "park.h"
+
+/**
+ * Keep-alive connections waiting for their next request are parked here,
+ * instead of holding a thread. The main loop polls park_fd(), and queues
+ * again the connections that become readable.
+ * The slots are indexed by file descriptor.
+ * */
+typedef enum {
+    PARK_FREE = 0,
+    PARK_WAITING,               //In the epoll set
+    PARK_RESUMED,               //Queued, waiting for a thread
+} park_state_t;
+
+typedef struct {
+    park_state_t state;
+    struct timespec since;      //When it was parked
+#ifdef HAVE_LIBSSL
+    SSL *ssl;                   //The TLS session continues with the next request
+#endif
+} park_slot_t;
+
+static pthread_mutex_t park_mutex = PTHREAD_MUTEX_INITIALIZER;
+static park_slot_t *park_slots = NULL;
+static int park_slots_l = 0;
+static int park_max_fd = -1;    //Highest parked file descriptor
+static unsigned int park_waiting = 0;
+static int park_epoll = -1;
+
+/**
+ * Creates the set of the parked connections. If it fails, the
+ * connections are never parked.
+ * */
+void park_init() {
+#ifdef HAVE_SYS_EPOLL_H
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+        return;
+
+    park_slots_l = limit.rlim_cur;
+    park_slots = calloc(park_slots_l, sizeof(park_slot_t));
+    park_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (park_slots == NULL || park_epoll == -1) {
+        syslog(LOG_ERR, "Unable to create the set of parked connections");
+        free(park_slots);
+        park_slots = NULL;
+        if (park_epoll != -1)
+            close(park_epoll);
+        park_epoll = -1;
+    }
+#endif
+}
+
+/**
+ * Returns the file descriptor to poll to know when parked connections
+ * are readable, -1 if the connections are not parked.
+ * */
+int park_fd() {
+    return park_epoll;
+}
+
+/**
+ * Returns the number of connections waiting for their next request.
+ * */
+unsigned int park_count() {
+    pthread_mutex_lock(&park_mutex);
+    unsigned int count = park_waiting;
+    pthread_mutex_unlock(&park_mutex);
+    return count;
+}
+
+static void park_close(int fd) {
+#ifdef HAVE_LIBSSL
+    if (park_slots[fd].ssl) {
+        SSL_shutdown(park_slots[fd].ssl);
+        SSL_free(park_slots[fd].ssl);
+    }
+#endif
+    close(fd);
+    memset(&park_slots[fd], 0, sizeof(park_slot_t));
+}
+
+/**
+ * Parks a connection, that has no buffered data, until the client sends
+ * the next request. The calling thread can take another socket.
+ * Returns false if it can't be parked.
+ * */
+bool park_connection(fd_t sock) {
+#ifdef HAVE_SYS_EPOLL_H
+#ifdef HAVE_LIBSSL
+    int fd = sock.fd;
+    //Data already decrypted can't be seen by epoll
+    if (sock.ssl && SSL_pending(sock.ssl) > 0)
+        return false;
+#else
+    int fd = sock;
+#endif
+    if (park_epoll == -1 || fd >= park_slots_l)
+        return false;
+
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+        .data.fd = fd,
+    };
+
+    pthread_mutex_lock(&park_mutex);
+    park_slot_t *slot = &park_slots[fd];
+    slot->state = PARK_WAITING;
+    clock_gettime(CLOCK_MONOTONIC, &slot->since);
+#ifdef HAVE_LIBSSL
+    slot->ssl = sock.ssl;
+#endif
+    bool parked = epoll_ctl(park_epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+    if (parked) {
+        park_waiting++;
+        if (fd > park_max_fd)
+            park_max_fd = fd;
+    } else {
+        memset(slot, 0, sizeof(park_slot_t));
+    }
+    pthread_mutex_unlock(&park_mutex);
+    return parked;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Takes from the set up to max connections that are readable, or closed
+ * by the client, and writes them in fds, so they can be queued again.
+ * Returns how many they are.
+ * */
+int park_ready(int *fds, int max) {
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[max];
+    int count = epoll_wait(park_epoll, events, max, 0);
+    if (count <= 0)
+        return 0;
+
+    pthread_mutex_lock(&park_mutex);
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        epoll_ctl(park_epoll, EPOLL_CTL_DEL, fd, NULL);
+        park_slots[fd].state = PARK_RESUMED;
+        park_waiting--;
+        fds[i] = fd;
+    }
+    pthread_mutex_unlock(&park_mutex);
+    return count;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Called by the thread that took the socket from the queue.
+ * Returns true if it was a parked connection, and then restores its
+ * TLS session in sock.
+ * */
+bool park_resume(fd_t *sock) {
+#ifdef HAVE_LIBSSL
+    int fd = sock->fd;
+#else
+    int fd = *sock;
+#endif
+    if (park_slots == NULL || fd >= park_slots_l)
+        return false;
+
+    pthread_mutex_lock(&park_mutex);
+    bool resumed = park_slots[fd].state == PARK_RESUMED;
+    if (resumed) {
+#ifdef HAVE_LIBSSL
+        sock->ssl = park_slots[fd].ssl;
+#endif
+        memset(&park_slots[fd], 0, sizeof(park_slot_t));
+    }
+    pthread_mutex_unlock(&park_mutex);
+    return resumed;
+}
+
+/**
+ * Closes the parked connections that have been waiting for more than
+ * timeout milliseconds, or all of them if timeout is 0.
+ * */
+void park_expire(unsigned int timeout) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&park_mutex);
+    for (int fd = 0; fd <= park_max_fd; fd++) {
+        park_slot_t *slot = &park_slots[fd];
+        if (slot->state != PARK_WAITING)
+            continue;
+
+        long long int waited = (now.tv_sec - slot->since.tv_sec) * 1000LL + (now.tv_nsec - slot->since.tv_nsec) / 1000000;
+        if (timeout != 0 && waited < timeout)
+            continue;
+
+#ifdef HAVE_SYS_EPOLL_H
+        epoll_ctl(park_epoll, EPOLL_CTL_DEL, fd, NULL);
+#endif
+        park_close(fd);
+        park_waiting--;
+    }
+    pthread_mutex_unlock(&park_mutex);
+}
+
+/**
+ * Closes a connection that could not be queued again, with its
+ * TLS session if it was parked.
+ * */
+void park_drop(int fd) {
+    if (park_slots != NULL && fd < park_slots_l) {
+        pthread_mutex_lock(&park_mutex);
+        if (park_slots[fd].state == PARK_RESUMED) {
+            park_close(fd);
+            pthread_mutex_unlock(&park_mutex);
+            return;
+        }
+        pthread_mutex_unlock(&park_mutex);
+    }
+    close(fd);
+}
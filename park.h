@@ -0,0 +1,35 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_PARK_H
+#define WEBORF_PARK_H
+
+#include "types.h"
+
+void park_init();
+int park_fd();
+unsigned int park_count();
+bool park_connection(fd_t sock);
+int park_ready(int *fds, int max);
+bool park_resume(fd_t *sock);
+void park_expire(unsigned int timeout);
+void park_drop(int fd);
+
+#endif
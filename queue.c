@@ -25,6 +25,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <pthread.h>
 #include <netinet/in.h>
+#include <time.h>
 
 #include "queue.h"
 
@@ -38,10 +39,15 @@ int q_init(syn_queue_t * q, int size) {
     q->size = size;
 
     q->data = (int *) malloc(sizeof(int) * size);
+    q->enqueued = malloc(sizeof(struct timespec) * size);
 
-    if (q->data == NULL) { //Error, unable to allocate memory
+    if (q->data == NULL || q->enqueued == NULL) { //Error, unable to allocate memory
+        free(q->data);
+        free(q->enqueued);
         return 1;
     }
+    q->puts = q->gets = 0;
+    q->wait = 0;
 
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->for_space, NULL);
@@ -56,6 +62,25 @@ Requires the pointer to the queue struct
 */
 void q_free(syn_queue_t * q) {
     free(q->data);
+    free(q->enqueued);
+}
+
+/**
+Removes the head of the queue, that must not be empty, and writes it in val.
+Must be called with the lock.
+*/
+static void q_take(syn_queue_t * q, int *val) {
+    *val = q->data[q->head]; //Sets the value
+
+    if (*val >= 0) { //Termination orders are not counted
+        struct timespec now, *enqueued = &q->enqueued[q->head];
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        q->wait += (now.tv_sec - enqueued->tv_sec) * 1000000LL + (now.tv_nsec - enqueued->tv_nsec) / 1000;
+        q->gets++;
+    }
+
+    q->head = (q->head + 1) % q->size; //Moves the head
+    q->num--; //Reduces count of the queue
 }
 
 int q_get(syn_queue_t * q, int *val) {
@@ -64,10 +89,7 @@ int q_get(syn_queue_t * q, int *val) {
         q->n_wait_dt++;
         pthread_cond_wait(&q->for_data, &q->mutex);
     }
-    *val = q->data[q->head]; //Sets the value
-
-    q->head = (q->head + 1) % q->size; //Moves the head
-    q->num--; //Reduces count of the queue
+    q_take(q, val);
 
     /*if ((q->num == q->size) && (q->n_wait_sp > 0)) {
         q->n_wait_sp--;
@@ -78,30 +100,83 @@ int q_get(syn_queue_t * q, int *val) {
     return 0; //   will not proceed
 }
 
+/**
+Like q_get, but doesn't wait.
+Returns 0 if a value was written in val, 1 if the queue is empty.
+*/
+int q_try_get(syn_queue_t * q, int *val) {
+    pthread_mutex_lock(&q->mutex);
+    int empty = q->num == 0;
+    if (!empty)
+        q_take(q, val);
+    pthread_mutex_unlock(&q->mutex);
+    return empty;
+}
 
+/**
+Puts val in the queue.
+Returns 0 on success and 1 if the queue is full.
+*/
 int q_put(syn_queue_t * q, int val) {
+    return q_put_many(q, &val, 1) == 1 ? 0 : 1;
+}
+
+/**
+Puts count values in the queue, taking the lock once, and wakes up a
+sleeping thread for each of them.
+Returns how many were put, less than count if the queue is full.
+*/
+int q_put_many(syn_queue_t * q, int *vals, int count) {
+    struct timespec now;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
     pthread_mutex_lock(&q->mutex);
 
-    //Wakes up a sleeping thread
-    if (q->n_wait_dt > 0) {
-        q->n_wait_dt--;
-        pthread_cond_signal(&q->for_data);
-    } // unlock also needed after signal
-
-    //Fails if queue is full
-    if (q->num == q->size) {
-        pthread_mutex_unlock(&q->mutex); // or threads blocked on wait
-        return 1; // will not proceed
-        //while (q->num == q->size) {
-        //q->n_wait_sp++;
-        //pthread_cond_wait(&q->for_space, &q->mutex);
+    //Stops when the queue is full
+    for (i = 0; i < count && q->num < q->size; i++) {
+        q->data[q->tail] = vals[i]; //Set the data in position
+        if (vals[i] >= 0) {
+            q->enqueued[q->tail] = now;
+            q->puts++;
+        }
+
+        q->tail = (q->tail + 1) % q->size; //Moves the tail
+        q->num++; //Increases count of filled positions
+
+        //Wakes up a sleeping thread
+        if (q->n_wait_dt > 0) {
+            q->n_wait_dt--;
+            pthread_cond_signal(&q->for_data);
+        } // unlock also needed after signal
     }
-    q->data[q->tail] = val; //Set the data in position
 
-    q->tail = (q->tail + 1) % q->size; //Moves the tail
+    pthread_mutex_unlock(&q->mutex); // or threads blocked on wait
+    return i;
+}
 
-    q->num++; //Increases count of filled positions
+/**
+Gets the sockets put in and taken from the queue since the last call,
+the microseconds they waited in total and how many are waiting now.
+Then resets the counters.
+*/
+void q_stats(syn_queue_t * q, unsigned long int *puts, unsigned long int *gets, unsigned long long int *wait, int *queued) {
+    pthread_mutex_lock(&q->mutex);
+    *puts = q->puts;
+    *gets = q->gets;
+    *wait = q->wait;
+    *queued = q->num;
+    q->puts = q->gets = 0;
+    q->wait = 0;
+    pthread_mutex_unlock(&q->mutex);
+}
 
-    pthread_mutex_unlock(&q->mutex); // or threads blocked on wait
-    return 0; // will not proceed
+/**
+Returns how many threads are waiting for a socket.
+*/
+int q_idle(syn_queue_t * q) {
+    pthread_mutex_lock(&q->mutex);
+    int idle = q->n_wait_dt;
+    pthread_mutex_unlock(&q->mutex);
+    return idle;
 }
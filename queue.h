@@ -27,7 +27,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 int q_init(syn_queue_t * q, int size);
 
 int q_put(syn_queue_t * q, int val);
+int q_put_many(syn_queue_t * q, int *vals, int count);
 int q_get(syn_queue_t * q, int *val);
+int q_try_get(syn_queue_t * q, int *val);
+int q_idle(syn_queue_t * q);
+void q_stats(syn_queue_t * q, unsigned long int *puts, unsigned long int *gets, unsigned long long int *wait, int *queued);
 
 void q_free(syn_queue_t * q);
 
@@ -0,0 +1,411 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+#include "options.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "scgi.h"
+#include "cgi.h"
+#include "instance.h"
+#include "myio.h"
+#include "utils.h"
+
+//Space reserved before the variables, for the netstring length or the uwsgi header
+#define SCGI_RESERVED 16
+
+#define PROTO_SCGI 0
+#define PROTO_UWSGI 1
+
+extern weborf_configuration_t weborf_conf;
+
+typedef struct {
+    char *data;     //Buffer, the first SCGI_RESERVED bytes are left for the packet header
+    size_t len;     //Used bytes, including the reserved ones
+    size_t size;    //Allocated bytes
+    int proto;      //PROTO_SCGI or PROTO_UWSGI
+} scgi_buf_t;
+
+/**
+Returns true if the CGI executor is not a binary but an
+SCGI or uwsgi unix socket, in the form scgi:/path or uwsgi:/path
+*/
+bool scgi_is_backend(const char *executor) {
+    return strncmp(executor, SCGI_PREFIX, strlen(SCGI_PREFIX)) == 0 ||
+           strncmp(executor, UWSGI_PREFIX, strlen(UWSGI_PREFIX)) == 0;
+}
+
+/**
+Makes sure that there are at least needed free bytes in the buffer.
+Returns 0 on success.
+*/
+static int scgi_buf_reserve(scgi_buf_t *b, size_t needed) {
+    if (b->len + needed <= b->size)
+        return 0;
+
+    size_t size = b->size * 2;
+    while (size < b->len + needed)
+        size *= 2;
+
+    char *data = realloc(b->data, size);
+    if (data == NULL)
+        return ERR_NOMEM;
+    b->data = data;
+    b->size = size;
+    return 0;
+}
+
+/**
+Appends a variable to the request, encoded according to the protocol.
+
+If header is true, the name is an HTTP header name and it will be
+converted to the HTTP_NAME form used by CGI.
+
+Returns 0 on success.
+*/
+static int scgi_add_var(scgi_buf_t *b, const char *name, size_t name_l, const char *val, size_t val_l, bool header) {
+    size_t prefix_l = header ? 5 : 0;
+    size_t key_l = name_l + prefix_l;
+
+    if (b->proto == PROTO_UWSGI && (key_l > 0xffff || val_l > 0xffff))
+        return ERR_NOMEM;
+
+    if (scgi_buf_reserve(b, key_l + val_l + 4) != 0)
+        return ERR_NOMEM;
+
+    char *d = b->data + b->len;
+
+    if (b->proto == PROTO_UWSGI) {
+        d[0] = key_l & 0xff;
+        d[1] = (key_l >> 8) & 0xff;
+        d += 2;
+    }
+
+    memcpy(d, "HTTP_", prefix_l);
+    for (size_t i = 0; i < name_l; i++) {
+        char c = name[i];
+        if (header)
+            c = (c == '-') ? '_' : toupper(c);
+        d[prefix_l + i] = c;
+    }
+    d += key_l;
+
+    if (b->proto == PROTO_UWSGI) {
+        d[0] = val_l & 0xff;
+        d[1] = (val_l >> 8) & 0xff;
+        d += 2;
+    } else {
+        *(d++) = '\0';
+    }
+
+    memcpy(d, val, val_l);
+    d += val_l;
+    if (b->proto == PROTO_SCGI)
+        *(d++) = '\0';
+
+    b->len = d - b->data;
+    return 0;
+}
+
+static inline int scgi_add_str(scgi_buf_t *b, const char *name, const char *val) {
+    if (val == NULL)
+        val = "";
+    return scgi_add_var(b, name, strlen(name), val, strlen(val), false);
+}
+
+/**
+Encodes every header of the request directly from http_param, which
+is left unchanged.
+
+The first line of http_param is the protocol and is used as
+SERVER_PROTOCOL. Also sets SERVER_NAME from the Host header.
+*/
+static int scgi_add_headers(scgi_buf_t *b, char *http_param) {
+    char *line = http_param;
+    char *end;
+    bool first = true;
+    int r = 0;
+
+    while (r == 0 && (end = strstr(line, "\r\n")) != NULL) {
+        if (first) {
+            r = scgi_add_var(b, "SERVER_PROTOCOL", 15, line, end - line, false);
+            first = false;
+        } else {
+            char *sep = memchr(line, ':', end - line);
+            if (sep != NULL && sep + 1 < end && sep[1] == ' ') {
+                char *val = sep + 2;
+                r = scgi_add_var(b, line, sep - line, val, end - val, true);
+
+                if (r == 0 && sep - line == 4 && strncasecmp(line, "Host", 4) == 0) {
+                    //Server name is the host without the port
+                    char *port;
+                    if (val[0] == '[') { //IPv6 address, the port follows the ]
+                        char *bracket = memchr(val, ']', end - val);
+                        port = bracket ? memchr(bracket, ':', end - bracket) : NULL;
+                    } else {
+                        port = memchr(val, ':', end - val);
+                    }
+                    r = scgi_add_var(b, "SERVER_NAME", 11, val, (port ? port : end) - val, false);
+                }
+            }
+        }
+        line = end + 2;
+    }
+    return r;
+}
+
+/**
+Builds the complete request packet, with all the variables and the
+netstring or uwsgi header in front of them.
+
+The packet starts at the returned pointer, and its length is stored
+into packet_l.
+Returns NULL if there is not enough memory.
+*/
+static char *scgi_build_request(scgi_buf_t *b, connection_t *connection_prop, long long int content_l, size_t *packet_l) {
+    char tmp[NBUFFER+2];
+    int r = 0;
+
+    //SCGI requires CONTENT_LENGTH to be the first variable
+    snprintf(tmp, sizeof(tmp), "%lld", content_l);
+    r |= scgi_add_str(b, "CONTENT_LENGTH", tmp);
+    if (b->proto == PROTO_SCGI)
+        r |= scgi_add_str(b, "SCGI", "1");
+
+    {
+        char content_type[HEADBUF];
+        if (get_param_value(connection_prop->http_param, "Content-Type", content_type, HEADBUF, strlen("Content-Type")))
+            r |= scgi_add_str(b, "CONTENT_TYPE", content_type);
+    }
+
+    r |= scgi_add_str(b, "GATEWAY_INTERFACE", "CGI/1.1");
+    r |= scgi_add_str(b, "SERVER_SOFTWARE", SIGNATURE);
+    r |= scgi_add_str(b, "SERVER_PORT", weborf_conf.port);
+    r |= scgi_add_str(b, "REQUEST_METHOD", connection_prop->method);
+    r |= scgi_add_str(b, "SCRIPT_NAME", connection_prop->page);
+    r |= scgi_add_str(b, "SCRIPT_FILENAME", connection_prop->strfile);
+    r |= scgi_add_str(b, "PATH_INFO", "");
+    r |= scgi_add_str(b, "DOCUMENT_ROOT", connection_prop->basedir);
+    r |= scgi_add_str(b, "REMOTE_ADDR", connection_prop->ip_addr);
+    r |= scgi_add_str(b, "QUERY_STRING", connection_prop->get_params);
+#ifdef HAVE_LIBSSL
+    if (connection_prop->sock.ssl)
+        r |= scgi_add_str(b, "HTTPS", "on");
+#endif
+
+    //Request URI with or without a query
+    if (connection_prop->get_params == NULL) {
+        r |= scgi_add_str(b, "REQUEST_URI", connection_prop->page);
+    } else {
+        //file and params were the same string.
+        //Joining them again temporarily
+        int delim = connection_prop->page_len;
+        connection_prop->page[delim] = '?';
+        r |= scgi_add_str(b, "REQUEST_URI", connection_prop->page);
+        connection_prop->page[delim] = '\0';
+    }
+
+    r |= scgi_add_headers(b, connection_prop->http_param);
+
+    if (r != 0)
+        return NULL;
+
+    size_t vars_l = b->len - SCGI_RESERVED;
+    char *start;
+
+    if (b->proto == PROTO_UWSGI) {
+        if (vars_l > 0xffff)
+            return NULL;
+        start = b->data + SCGI_RESERVED - 4;
+        start[0] = 0; //modifier1, 0 is WSGI
+        start[1] = vars_l & 0xff;
+        start[2] = (vars_l >> 8) & 0xff;
+        start[3] = 0; //modifier2
+    } else {
+        //Netstring: length:vars,
+        int l = snprintf(tmp, sizeof(tmp), "%zu:", vars_l);
+        if (scgi_buf_reserve(b, 1) != 0)
+            return NULL;
+        start = b->data + SCGI_RESERVED - l;
+        memcpy(start, tmp, l);
+        b->data[b->len++] = ',';
+    }
+
+    *packet_l = b->data + b->len - start;
+    return start;
+}
+
+/**
+Writes the whole buffer to the descriptor, retrying on short writes.
+Returns 0 on success.
+*/
+static int scgi_write_all(int fd, const char *buf, size_t count) {
+    while (count > 0) {
+        ssize_t w = write(fd, buf, count);
+        if (w <= 0) {
+            if (w == -1 && errno == EINTR)
+                continue;
+            return ERR_BRKPIPE;
+        }
+        buf += w;
+        count -= w;
+    }
+    return 0;
+}
+
+/**
+Connects to the unix socket of the backend.
+Returns the socket, or -1 in case of failure.
+*/
+static int scgi_connect(char *path) {
+    struct sockaddr_un remote;
+
+    if (strlen(path) >= sizeof(remote.sun_path))
+        return -1;
+
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s == -1)
+        return -1;
+
+    memset(&remote, 0, sizeof(remote));
+    remote.sun_family = AF_UNIX;
+    strcpy(remote.sun_path, path);
+
+    if (connect(s, (struct sockaddr *)&remote, sizeof(remote)) == -1) {
+        close(s);
+        return -1;
+    }
+
+    //Don't wait forever for a stuck application
+    struct timeval timeout;
+    timeout.tv_sec = SCRPT_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return s;
+}
+
+/**
+Forwards the request to an SCGI or uwsgi application listening on a unix
+socket, and sends its output to the client.
+
+backend is scgi:/path/to/socket or uwsgi:/path/to/socket.
+
+The variables are encoded directly from the request headers, without
+spawning any process.
+If post_param contains data, it is sent as request body, otherwise the
+body is streamed from the client to the application as it is read.
+The response is streamed back to the client.
+*/
+int scgi_exec_page(char *backend, string_t *post_param, buffered_read_t *read_b, connection_t *connection_prop) {
+    scgi_buf_t b;
+    int retval = 0;
+    long long int content_l = 0;
+    char *path;
+
+#ifdef SENDINGDBG
+    syslog(LOG_INFO, "Forwarding %s to %s", connection_prop->page, backend);
+#endif
+
+    if (strncmp(backend, UWSGI_PREFIX, strlen(UWSGI_PREFIX)) == 0) {
+        b.proto = PROTO_UWSGI;
+        path = backend + strlen(UWSGI_PREFIX);
+    } else {
+        b.proto = PROTO_SCGI;
+        path = backend + strlen(SCGI_PREFIX);
+    }
+
+    if (post_param->data != NULL) {
+        content_l = post_param->len;
+    } else {
+        char a[NBUFFER];
+        if (get_param_value(connection_prop->http_param, "Content-Length", a, NBUFFER, strlen("Content-Length")))
+            content_l = strtoll(a, NULL, 0);
+        if (content_l < 0)
+            return ERR_NOTHTTP;
+    }
+
+    //Body might not be read completely, can't reuse the connection
+    connection_prop->keep_alive = false;
+
+    b.size = HEADBUF + connection_prop->tunables->request_buffer;
+    b.len = SCGI_RESERVED;
+    b.data = malloc(b.size);
+    if (b.data == NULL)
+        return ERR_NOMEM;
+
+    size_t packet_l;
+    char *packet = scgi_build_request(&b, connection_prop, content_l, &packet_l);
+    if (packet == NULL) {
+        free(b.data);
+        return ERR_NOMEM;
+    }
+
+    int s = scgi_connect(path);
+    if (s == -1) {
+#ifdef SERVERDBG
+        syslog(LOG_ERR, "Unable to connect to %s", backend);
+#endif
+        free(b.data);
+        return ERR_SERVICE_UNAVAILABLE;
+    }
+
+    retval = scgi_write_all(s, packet, packet_l);
+    free(b.data);
+
+    //Request body
+    if (retval == 0 && post_param->data != NULL) {
+        retval = scgi_write_all(s, post_param->data, post_param->len);
+    } else if (retval == 0 && content_l > 0) {
+        size_t buf_size = connection_prop->tunables->file_buffer;
+        char *buf = malloc(buf_size);
+        if (buf == NULL) {
+            retval = ERR_NOMEM;
+        }
+
+        while (retval == 0 && content_l > 0) {
+            ssize_t r = buffer_read(connection_prop->sock, buf, content_l > buf_size ? buf_size : content_l, read_b);
+            if (r <= 0) {
+                retval = ERR_NODATA;
+                break;
+            }
+            content_l -= r;
+            retval = scgi_write_all(s, buf, r);
+        }
+        free(buf);
+    }
+
+    if (retval == 0)
+        retval = cgi_relay_output(connection_prop, s);
+    else if (retval == ERR_BRKPIPE)
+        retval = ERR_SERVICE_UNAVAILABLE;
+
+    close(s);
+    return retval;
+}
@@ -0,0 +1,34 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_SCGI_H
+#define WEBORF_SCGI_H
+
+#include "options.h"
+#include "types.h"
+#include "buffered_reader.h"
+
+#define SCGI_PREFIX "scgi:"
+#define UWSGI_PREFIX "uwsgi:"
+
+bool scgi_is_backend(const char *executor);
+int scgi_exec_page(char *backend, string_t *post_param, buffered_read_t *read_b, connection_t *connection_prop);
+
+#endif
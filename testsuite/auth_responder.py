@@ -0,0 +1,54 @@
+#!/usr/bin/python3
+# Minimal authentication daemon for --auth-keepalive used by the testsuite.
+# It closes every connection after two requests, so weborf has to connect
+# again, and appends a line to the log for every connection and request.
+#
+# Usage: auth_responder.py /path/to/socket /path/to/log
+
+import os
+import socketserver
+import struct
+import sys
+
+
+def read_exactly(conn, size: int) -> bytes:
+    data = b''
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            raise EOFError()
+        data += chunk
+    return data
+
+
+def log(line: str) -> None:
+    with open(sys.argv[2], 'a') as f:
+        f.write(line + '\n')
+
+
+class Handler(socketserver.BaseRequestHandler):
+    def handle(self):
+        log('connection')
+        try:
+            for _ in range(2):
+                size = struct.unpack('!I', read_exactly(self.request, 4))[0]
+                page, addr, method, username, password = read_exactly(self.request, size).split(b'\r\n')[:5]
+                log('request')
+                if username == b'user' and password == b'secret':
+                    self.request.sendall(struct.pack('!I', 0))
+                else:
+                    self.request.sendall(struct.pack('!I', 6) + b'denied')
+        except EOFError:
+            pass
+
+
+def main():
+    path = sys.argv[1]
+    try:
+        os.remove(path)
+    except OSError:
+        pass
+    socketserver.ThreadingUnixStreamServer(path, Handler).serve_forever()
+
+
+main()
@@ -0,0 +1,74 @@
+#!/usr/bin/python3
+# Minimal SCGI and uwsgi application used by the testsuite.
+# It replies with some of the variables it received and with the request body.
+#
+# Usage: scgi_responder.py scgi|uwsgi /path/to/socket
+
+import os
+import socket
+import struct
+import sys
+
+
+def read_exactly(conn, size: int) -> bytes:
+    data = b''
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            raise EOFError()
+        data += chunk
+    return data
+
+
+def read_scgi(conn) -> dict[bytes, bytes]:
+    length = b''
+    while not length.endswith(b':'):
+        length += read_exactly(conn, 1)
+    payload = read_exactly(conn, int(length[:-1]) + 1)
+    assert payload.endswith(b',')
+    fields = payload[:-1].split(b'\0')[:-1]
+    return dict(zip(fields[::2], fields[1::2]))
+
+
+def read_uwsgi(conn) -> dict[bytes, bytes]:
+    modifier1, size, modifier2 = struct.unpack('<BHB', read_exactly(conn, 4))
+    assert modifier1 == 0 and modifier2 == 0
+    payload = read_exactly(conn, size)
+    r = {}
+    while payload:
+        key_l = struct.unpack('<H', payload[:2])[0]
+        key = payload[2:2 + key_l]
+        payload = payload[2 + key_l:]
+        val_l = struct.unpack('<H', payload[:2])[0]
+        r[key] = payload[2:2 + val_l]
+        payload = payload[2 + val_l:]
+    return r
+
+
+def main():
+    proto, path = sys.argv[1:3]
+    try:
+        os.remove(path)
+    except OSError:
+        pass
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(path)
+    server.listen(5)
+
+    while True:
+        conn, _ = server.accept()
+        env = read_scgi(conn) if proto == 'scgi' else read_uwsgi(conn)
+        body = read_exactly(conn, int(env[b'CONTENT_LENGTH']))
+
+        if proto == 'scgi':
+            conn.sendall(b'Status: 200 OK\r\nContent-Type: text/plain\r\n\r\n')
+        else:
+            conn.sendall(b'HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\n')
+        for k in (b'SCGI', b'REQUEST_METHOD', b'REQUEST_URI', b'QUERY_STRING', b'SERVER_NAME', b'HTTP_X_TEST'):
+            if k in env:
+                conn.sendall(k + b'\t' + env[k] + b'\n')
+        conn.sendall(b'BODY\t' + body + b'\n')
+        conn.close()
+
+
+main()
@@ -0,0 +1,561 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#define _GNU_SOURCE //For O_DIRECTORY and O_NOFOLLOW
+#include "options.h"
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "treewalk.h"
+#include "instance.h"
+#include "myio.h"
+#include "coro.h"
+
+/**
+ * Parallel walk of a directory tree, to delete, copy or move it.
+ *
+ * Every directory is a node in a queue, and up to TREE_WORKERS threads
+ * take nodes and handle their entries: the files immediately, the
+ * subdirectories by adding them to the queue. All the paths are relative
+ * to the roots, opened once, and the entries are reached with the *at()
+ * calls on the descriptor of their directory.
+ *
+ * In a coroutine, the thread of the request must keep serving the other
+ * connections, so all the nodes are left to the other threads, and the
+ * coroutine waits for done_fd.
+ *
+ * A node is finished when it has been listed and all its subdirectories
+ * are finished. Then it can be removed, or get the permissions and times
+ * of the source. A node with a failure inside is not removed, and only
+ * the failure is reported, as RFC 4918 requires for the multistatus.
+ * */
+
+typedef struct tree_node_t {
+    struct tree_node_t *parent;
+    struct tree_node_t *next;   //Next in the queue
+    unsigned int pending;       //Its own listing, plus the subdirectories not finished
+    bool failed;                //Something inside could not be done
+    char path[];                //Relative to the roots, empty for the roots
+} tree_node_t;
+
+typedef struct {
+    int method;                 //DELETE, COPY or MOVE
+    int src_root;
+    int dest_root;              //-1 for DELETE
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    tree_node_t *head;
+    tree_node_t *tail;
+    unsigned int idle;          //Threads waiting for a node
+    unsigned int threads;       //Threads started, besides the one of the request
+    pthread_t tids[TREE_WORKERS];
+    bool done;
+    int done_fd;                //Eventfd written when done, -1 if the request's thread is walking too
+    bool root_failed;           //The root can't be removed, or could not be listed
+    tree_failures_t *failures;
+} tree_walk_t;
+
+static void *tree_worker(void *arg);
+
+/**
+ * Returns the path of the node, usable with the *at() calls.
+ * */
+static inline const char *tree_path(tree_node_t *node) {
+    return node->path[0] ? node->path : ".";
+}
+
+/**
+ * Returns the status code for errno.
+ * */
+static int tree_status(int err) {
+    switch (err) {
+    case ENOENT:
+        return 404;
+    case ENOSPC:
+    case EDQUOT:
+        return 507;
+    case EEXIST:
+    case ENOTEMPTY:
+        return 409;
+    case EACCES:
+    case EPERM:
+    case EROFS:
+    case EBUSY:
+    case ENAMETOOLONG:
+        return 403;
+    }
+    return 500;
+}
+
+/**
+ * Returns the status code for the return value of file_copy_at().
+ * */
+static inline int tree_copy_status(int retval) {
+    switch (retval) {
+    case ERR_FILENOTFOUND:
+        return 404;
+    case ERR_FORBIDDEN:
+        return 403;
+    case ERR_INSUFFICIENT_STORAGE:
+        return 507;
+    }
+    return 500;
+}
+
+/**
+ * Writes in path the path of name inside node, that must have
+ * space for both plus 2 bytes.
+ * */
+static inline void tree_join(char *path, tree_node_t *node, const char *name) {
+    if (node->path[0])
+        sprintf(path, "%s/%s", node->path, name);
+    else
+        strcpy(path, name);
+}
+
+/**
+ * Records that name, in the directory of node, failed with status.
+ * If name is NULL, the node itself failed.
+ * */
+static void tree_fail(tree_walk_t *walk, tree_node_t *node, const char *name, int status) {
+    char *path = malloc(strlen(node->path) + (name ? strlen(name) : 0) + 2);
+
+    if (path && name)
+        tree_join(path, node, name);
+    else if (path)
+        strcpy(path, node->path);
+
+    pthread_mutex_lock(&walk->mutex);
+    tree_failures_t *failures = walk->failures;
+    if (path && failures->stored < TREE_MAXFAILURES) {
+        failures->items[failures->stored].status = status;
+        failures->items[failures->stored].path = path;
+        failures->stored++;
+        path = NULL;
+    }
+    failures->count++;
+    pthread_mutex_unlock(&walk->mutex);
+    free(path);
+}
+
+/**
+ * Returns a new node for the subdirectory name of parent, or for the
+ * roots if parent is NULL. Returns NULL if there is not enough memory.
+ * */
+static tree_node_t *tree_node_new(tree_node_t *parent, const char *name) {
+    tree_node_t *node = malloc(sizeof(tree_node_t) + (parent ? strlen(parent->path) : 0) + strlen(name) + 2);
+    if (node == NULL)
+        return NULL;
+
+    node->parent = parent;
+    node->next = NULL;
+    node->pending = 1;
+    node->failed = false;
+    if (parent)
+        tree_join(node->path, parent, name);
+    else
+        node->path[0] = 0;
+    return node;
+}
+
+/**
+ * Adds the subdirectory name of parent to the queue, and starts another
+ * thread if all of them are busy.
+ * Returns false if there is not enough memory.
+ * */
+static bool tree_push(tree_walk_t *walk, tree_node_t *parent, const char *name) {
+    tree_node_t *node = tree_node_new(parent, name);
+    if (node == NULL)
+        return false;
+
+    pthread_mutex_lock(&walk->mutex);
+    parent->pending++;
+    if (walk->tail)
+        walk->tail->next = node;
+    else
+        walk->head = node;
+    walk->tail = node;
+
+    //More work than threads to do it
+    if (walk->idle == 0 && walk->threads < TREE_WORKERS - 1) {
+        if (pthread_create(&walk->tids[walk->threads], NULL, tree_worker, walk) == 0)
+            walk->threads++;
+    } else {
+        pthread_cond_signal(&walk->cond);
+    }
+    pthread_mutex_unlock(&walk->mutex);
+    return true;
+}
+
+/**
+ * Called when the subtree of node is done: the directory is removed
+ * after its content, and a copy gets the permissions and times of the
+ * source only now, since creating its content changed them.
+ * The roots are left to the caller.
+ * */
+static void tree_finish(tree_walk_t *walk, tree_node_t *node) {
+    const char *path = tree_path(node);
+
+#ifdef WEBDAV
+    if (walk->method != DELETE) {
+        struct stat f_prop;
+        if (fstatat(walk->src_root, path, &f_prop, 0) == 0) {
+            struct timespec times[2] = {f_prop.st_atim, f_prop.st_mtim};
+            fchmodat(walk->dest_root, path, f_prop.st_mode & 07777, 0);
+            utimensat(walk->dest_root, path, times, 0);
+        }
+    }
+#endif
+
+    if (walk->method == COPY || node->failed || node->parent == NULL)
+        return;
+
+    if (unlinkat(walk->src_root, path, AT_REMOVEDIR) != 0) {
+        node->failed = true;
+        tree_fail(walk, node, NULL, tree_status(errno));
+    }
+}
+
+/**
+ * Releases the listing of node, or one of its subdirectories, and
+ * finishes the nodes that have nothing else pending, up to the root.
+ * */
+static void tree_release(tree_walk_t *walk, tree_node_t *node, bool failed) {
+    while (node != NULL) {
+        pthread_mutex_lock(&walk->mutex);
+        node->failed |= failed;
+        unsigned int pending = --node->pending;
+        pthread_mutex_unlock(&walk->mutex);
+
+        if (pending)
+            return;
+
+        tree_finish(walk, node);
+        failed = node->failed;
+        tree_node_t *parent = node->parent;
+        free(node);
+        node = parent;
+    }
+
+    //The root is finished
+    pthread_mutex_lock(&walk->mutex);
+    walk->root_failed = failed;
+    walk->done = true;
+    pthread_cond_broadcast(&walk->cond);
+    if (walk->done_fd != -1) {
+        uint64_t one = 1;
+        if (write(walk->done_fd, &one, sizeof(one)) == -1)
+            syslog(LOG_ERR, "Unable to signal the end of a walk");
+    }
+    pthread_mutex_unlock(&walk->mutex);
+}
+
+#ifdef WEBDAV
+/**
+ * Copies or moves the entry name of the directory src_fd into dest_fd.
+ * Returns false if it failed.
+ * */
+static bool tree_copy_entry(tree_walk_t *walk, tree_node_t *node, int src_fd, int dest_fd, struct dirent *entry) {
+    const char *name = entry->d_name;
+    bool is_dir = entry->d_type == DT_DIR;
+
+    //Links are followed, as the files are copied
+    if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+        struct stat f_prop;
+        if (fstatat(src_fd, name, &f_prop, 0) != 0) {
+            tree_fail(walk, node, name, tree_status(errno));
+            return false;
+        }
+        is_dir = S_ISDIR(f_prop.st_mode);
+    }
+
+    if (is_dir) {
+        if (mkdirat(dest_fd, name, S_IRWXU | S_IRWXG | S_IRWXO) != 0) {
+            tree_fail(walk, node, name, tree_status(errno));
+            return false;
+        }
+        if (!tree_push(walk, node, name)) {
+            tree_fail(walk, node, name, 503);
+            return false;
+        }
+        return true;
+    }
+
+    //A move only gets here across devices, so the file is copied
+    int retval = file_copy_at(src_fd, name, dest_fd, name);
+    if (retval != 0) {
+        tree_fail(walk, node, name, tree_copy_status(retval));
+        return false;
+    }
+    if (walk->method == MOVE && unlinkat(src_fd, name, 0) != 0) {
+        tree_fail(walk, node, name, tree_status(errno));
+        return false;
+    }
+    return true;
+}
+#endif
+
+/**
+ * Deletes the entry name of the directory fd, or adds it to the queue
+ * if it is a directory.
+ * Returns false if it failed.
+ * */
+static bool tree_remove_entry(tree_walk_t *walk, tree_node_t *node, int fd, struct dirent *entry) {
+    const char *name = entry->d_name;
+
+    if (entry->d_type != DT_DIR) {
+        if (unlinkat(fd, name, 0) == 0)
+            return true;
+        if (errno != EISDIR) {
+            tree_fail(walk, node, name, tree_status(errno));
+            return false;
+        }
+    }
+
+    if (!tree_push(walk, node, name)) {
+        tree_fail(walk, node, name, 503);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Handles all the entries of the directory of node.
+ * */
+static void tree_list(tree_walk_t *walk, tree_node_t *node) {
+    bool failed = false;
+    int dest_fd = -1;
+    int fd = openat(walk->src_root, tree_path(node), O_RDONLY | O_DIRECTORY | (walk->method == DELETE ? O_NOFOLLOW : 0));
+    DIR *dp = fd == -1 ? NULL : fdopendir(fd);
+
+    if (dp == NULL) {
+        if (fd != -1)
+            close(fd);
+        //The root is reported by the caller
+        if (node->parent)
+            tree_fail(walk, node, NULL, tree_status(errno));
+        tree_release(walk, node, true);
+        return;
+    }
+
+    if (walk->method != DELETE && (dest_fd = openat(walk->dest_root, tree_path(node), O_RDONLY | O_DIRECTORY)) == -1) {
+        if (node->parent)
+            tree_fail(walk, node, NULL, tree_status(errno));
+        closedir(dp);
+        tree_release(walk, node, true);
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != NULL) {
+        //skips dir . and .. but not all hidden files
+        if (entry->d_name[0] == '.' && (entry->d_name[1] == 0 || (entry->d_name[1] == '.' && entry->d_name[2] == 0)))
+            continue;
+
+#ifdef WEBDAV
+        if (walk->method != DELETE) {
+            failed |= !tree_copy_entry(walk, node, fd, dest_fd, entry);
+            continue;
+        }
+#endif
+        failed |= !tree_remove_entry(walk, node, fd, entry);
+    }
+
+    closedir(dp);
+    if (dest_fd != -1)
+        close(dest_fd);
+    tree_release(walk, node, failed);
+}
+
+/**
+ * Takes nodes from the queue until the whole tree is done.
+ * */
+static void *tree_worker(void *arg) {
+    tree_walk_t *walk = arg;
+
+    pthread_mutex_lock(&walk->mutex);
+    while (!walk->done) {
+        tree_node_t *node = walk->head;
+        if (node == NULL) {
+            walk->idle++;
+            pthread_cond_wait(&walk->cond, &walk->mutex);
+            walk->idle--;
+            continue;
+        }
+
+        walk->head = node->next;
+        if (walk->head == NULL)
+            walk->tail = NULL;
+        pthread_mutex_unlock(&walk->mutex);
+
+        tree_list(walk, node);
+
+        pthread_mutex_lock(&walk->mutex);
+    }
+    pthread_mutex_unlock(&walk->mutex);
+    return NULL;
+}
+
+/**
+ * Gives the root to a new thread, so the one of the request is free.
+ * Returns false if the thread could not be started.
+ * */
+static bool tree_start(tree_walk_t *walk, tree_node_t *root) {
+    bool started;
+
+    pthread_mutex_lock(&walk->mutex);
+    walk->head = walk->tail = root;
+    started = pthread_create(&walk->tids[0], NULL, tree_worker, walk) == 0;
+    if (started)
+        walk->threads = 1;
+    else
+        walk->head = walk->tail = NULL;
+    pthread_mutex_unlock(&walk->mutex);
+    return started;
+}
+
+/**
+ * Walks the tree of source, that must be a directory, with the method
+ * DELETE, COPY or MOVE. For COPY and MOVE, dest is created first.
+ *
+ * Returns 0 when the walk was done, and the members that failed are in
+ * failures. Otherwise returns the error for the root.
+ * */
+static int tree_walk(const char *source, const char *dest, int method, tree_failures_t *failures) {
+    tree_walk_t walk = {
+        .method = method,
+        .dest_root = -1,
+        .done_fd = -1,
+        .failures = failures,
+    };
+
+    failures->count = failures->stored = 0;
+
+    walk.src_root = open(source, O_RDONLY | O_DIRECTORY | (method == DELETE ? O_NOFOLLOW : 0));
+    if (walk.src_root == -1)
+        return errno == ENOENT ? ERR_FILENOTFOUND : ERR_FORBIDDEN;
+
+    if (method != DELETE) {
+        if (mkdir(dest, S_IRWXU | S_IRWXG | S_IRWXO) != 0 || (walk.dest_root = open(dest, O_RDONLY | O_DIRECTORY)) == -1) {
+            close(walk.src_root);
+            return ERR_FORBIDDEN;
+        }
+    }
+
+    pthread_mutex_init(&walk.mutex, NULL);
+    pthread_cond_init(&walk.cond, NULL);
+
+    int retval = 0;
+    if (coro_running())
+        walk.done_fd = eventfd(0, EFD_CLOEXEC);
+
+    tree_node_t *root = tree_node_new(NULL, "");
+    if (root == NULL) {
+        retval = ERR_NOMEM;
+    } else if (walk.done_fd != -1 && tree_start(&walk, root)) {
+        uint64_t value;
+        while (coro_wait(walk.done_fd, POLLIN, -1) <= 0 || read(walk.done_fd, &value, sizeof(value)) != sizeof(value))
+            ; //Waits again if woken for nothing
+    } else {
+        tree_list(&walk, root);
+        tree_worker(&walk);
+    }
+
+    //They are done, or about to return
+    for (unsigned int i = 0; i < walk.threads; i++)
+        pthread_join(walk.tids[i], NULL);
+    if (walk.done_fd != -1)
+        close(walk.done_fd);
+
+    pthread_cond_destroy(&walk.cond);
+    pthread_mutex_destroy(&walk.mutex);
+    close(walk.src_root);
+    if (walk.dest_root != -1)
+        close(walk.dest_root);
+
+    if (retval == 0 && walk.root_failed && failures->count == 0) {
+        //The root could not be listed, nothing was done
+        if (method != DELETE)
+            rmdir(dest);
+        retval = ERR_FORBIDDEN;
+    } else if (retval == 0 && method != COPY && !walk.root_failed && rmdir(source) != 0) {
+        retval = ERR_FORBIDDEN;
+    }
+    return retval;
+}
+
+/**
+Deletes a directory and its content, like rm -rf.
+
+Returns 0 when it was done, and the members that could not be deleted
+are in failures.
+*/
+int dir_remove(const char *dir, tree_failures_t *failures) {
+    return tree_walk(dir, NULL, DELETE, failures);
+}
+
+#ifdef WEBDAV
+/**
+Copies a directory.
+The destination directory will be created and
+will be filled with the same content of the source directory.
+
+Returns 0 when it was done, and the members that could not be copied
+are in failures.
+*/
+int dir_copy(const char *source, const char *dest, tree_failures_t *failures) {
+    return tree_walk(source, dest, COPY, failures);
+}
+
+/**
+Moves a directory. When it is on another device, the content is copied
+and the source directory is deleted.
+
+Returns 0 when it was done, and the members that could not be moved
+are in failures.
+*/
+int dir_move(const char *source, const char *dest, tree_failures_t *failures) {
+    failures->count = failures->stored = 0;
+
+    if (rename(source, dest) == 0)
+        return 0;
+    if (errno != EXDEV)
+        return ERR_FORBIDDEN;
+    return tree_walk(source, dest, MOVE, failures);
+}
+#endif
+
+void tree_failures_free(tree_failures_t *failures) {
+    for (size_t i = 0; i < failures->stored; i++)
+        free(failures->items[i].path);
+    failures->count = failures->stored = 0;
+}
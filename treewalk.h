@@ -0,0 +1,48 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_TREEWALK_H
+#define WEBORF_TREEWALK_H
+
+#include "options.h"
+#include "types.h"
+
+/**
+ * Members of a collection that could not be deleted, copied or moved.
+ * The paths are relative to the collection.
+ * */
+typedef struct {
+    size_t count;               //Failures, including the ones not stored
+    size_t stored;
+    struct {
+        int status;             //HTTP status code
+        char *path;
+    } items[TREE_MAXFAILURES];
+} tree_failures_t;
+
+int dir_remove(const char *dir, tree_failures_t *failures);
+void tree_failures_free(tree_failures_t *failures);
+
+#ifdef WEBDAV
+int dir_copy(const char *source, const char *dest, tree_failures_t *failures);
+int dir_move(const char *source, const char *dest, tree_failures_t *failures);
+#endif
+
+#endif
@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdbool.h> //Adds boolean type
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <netinet/in.h>
 
@@ -42,6 +43,9 @@ typedef int fd_t;
 
 typedef struct {
     long int id;                //ID of the thread
+    int auth_sock;              //Persistent connection to the authentication daemon, -1 if not connected
+    struct uring_t *uring;      //io_uring for the static files, NULL if not available
+    struct coro_sched_t *coro;  //Scheduler of the coroutines, NULL if the thread serves one connection at a time
 } thread_prop_t;
 
 typedef struct {
@@ -64,8 +68,83 @@ typedef struct {
     pthread_mutex_t mutex;        //mutex to modify the queue
     pthread_cond_t for_space, for_data;
     int n_wait_sp, n_wait_dt;
+
+    struct timespec *enqueued;    //When each socket was put in the queue
+    unsigned long int puts, gets; //Sockets put and taken since the last q_stats()
+    unsigned long long int wait;  //Microseconds spent in the queue by the taken sockets
 } syn_queue_t;
 
+/**
+ * Concurrency limit of one interpreter.
+ *
+ * running is the number of scripts executed at the moment, when it
+ * reaches cgi_maxrunning, requests wait on for_slot until a script
+ * terminates. Requests served in coroutines wait on slot_fd instead,
+ * so the thread can run the coroutines that hold the slots.
+ * */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t for_slot;        //Signaled when a script terminates
+    int slot_fd;                    //Semaphore eventfd, incremented when a script terminates, -1 until needed
+    unsigned int running;           //Scripts being executed
+    unsigned int waiting;           //Requests waiting for a free slot
+    unsigned int coro_waiting;      //Of them, the ones waiting on slot_fd
+    unsigned long long int served;  //Executed scripts
+    unsigned long long int shed;    //Requests refused because the queue was full
+    unsigned long long int timedout;//Requests refused after waiting too long
+    unsigned long long int waited;  //Requests that had to wait
+    unsigned long long int wait_total;//Total time spent waiting, in milliseconds
+    unsigned long long int wait_max;//Longest wait, in milliseconds
+} cgi_limit_t;
+
+/**
+ * Settings of a site. Every request is served using one of these,
+ * the default one is built from the command line.
+ * */
+typedef struct {
+    char *host;                 //Lower case host name without port, *.domain for all its subdomains
+    char *basedir;              //Basedir for the host
+    char *indexes[MAXINDEXCOUNT];//List of pointers to index files
+    int indexes_l;              //Count of the list
+    bool exec_script;           //Enable CGI if true
+    array_ll cgi_paths;         //Paths to cgi binaries
+    unsigned int cgi_maxrunning;//Scripts running at the same time for each interpreter
+    unsigned int cgi_maxwaiting;//Requests waiting for each interpreter
+    unsigned int cgi_wait_timeout;//Max wait for an interpreter in milliseconds
+    cgi_limit_t *cgi_limits;    //One for each interpreter, can be shared with other hosts
+    char *cachedir;             //Directory for the cached files, NULL to disable the cache
+    bool auth;                  //False if the requests are not authenticated
+#ifdef SEND_MIMETYPES
+    bool send_content_type;     //True if we want to send the content type
+#endif
+    bool sendfile;              //Send the files with sendfile(2) when possible
+    size_t read_size;           //Size of the reads when copying files to the socket, 0 for the default
+} vhost_t;
+
+typedef struct vhost_table_t vhost_table_t;
+
+/**
+ * Settings that can be changed without recompiling, see --config.
+ * A snapshot is never modified: reloading the file creates a new one,
+ * and the requests keep using the one they started with.
+ * */
+typedef struct {
+    unsigned int refs;          //Requests using it, plus one while it is the current one
+    unsigned int version;       //Increased at every reload
+    unsigned int max_threads;   //Max threads, only read at startup
+    unsigned int min_threads;   //Threads that are always running
+    unsigned int initial_threads;//Threads started when starting
+    unsigned int low_threads;   //Free threads kept ready for the bursts
+    unsigned int max_free_threads;//Maximum number of free threads, before starting to slowly close them
+    unsigned int read_timeout;  //Timeout before closing inactive connections, in milliseconds
+    unsigned int drain_timeout; //Time given to the open connections to finish when stopping, in milliseconds
+    size_t request_buffer;      //Size for buffer with the HTTP request, used by the new threads
+    size_t file_buffer;         //Size of reads
+    size_t max_page_size;       //Maximum size for a page generated by a script or internally
+    size_t reader_buffer;       //Size of the buffered reader, used by the new threads
+    size_t post_max_size;       //Maximum allowed size for POST data
+} weborf_tunables_t;
+
 typedef struct {
     fd_t sock;                 //File and ssl descriptor for the socket
 #ifdef IPV6
@@ -87,6 +166,9 @@ typedef struct {
     struct stat strfile_stat;   //Stat of strfile
     int strfile_fd;             //File descriptor for strfile
     char *basedir;              //Basedir for the host
+    vhost_t *vhost;             //Virtual host of the request, never NULL after get_basedir()
+    vhost_table_t *vhosts;      //Virtual hosts in use by the request, NULL if not pinned
+    weborf_tunables_t *tunables;//Settings pinned by the request
     unsigned int status_code;   //HTTP status code
 
 } connection_t;
@@ -105,11 +187,27 @@ typedef struct {
 typedef struct {
     char *basedir;
     char* authsock;             //Executable that will authenticate
+    bool auth_keepalive;        //Use persistent connections to the authentication daemon
+    unsigned int auth_cache_ttl;//Seconds a granted authorization is cached, 0 to disable the cache
+    unsigned int auth_cache_negative_ttl;//Seconds a denied authorization is cached
+    char *auth_cache_prefix[MAXINDEXCOUNT];//Paths sharing the same decision
+    int auth_cache_prefix_l;    //Count of the list
+    char *htpasswd;             //File with the credentials, NULL if not used
+    char *auth_rules;           //File with the rules for the credentials, NULL if not used
+    char *cache_control;        //File with the Cache-Control rules, NULL if not used
+    char *config;               //File with the tunables, NULL if not used
+    unsigned int processes;     //Processes sharing the listening socket, each with its threads
+    int backlog;                //Queue for connect requests
+    int defer_accept;           //Seconds TCP_DEFER_ACCEPT waits for the request, 0 if not used
+    unsigned int coroutines;    //Connections served at the same time by each thread, 0 to serve one without coroutines
 #ifdef SEND_MIMETYPES
     bool send_content_type;     //True if we want to send the content type
 #endif
     bool is_inetd;              //True if it expects to be executed by inetd
     array_ll cgi_paths;         //Paths to cgi binaries
+    unsigned int cgi_maxrunning;//Scripts running at the same time for each interpreter
+    unsigned int cgi_maxwaiting;//Requests waiting for each interpreter
+    unsigned int cgi_wait_timeout;//Max wait for an interpreter in milliseconds
     bool virtual_host;          //True if must check for virtual hosts
     bool exec_script;           //Enable CGI if false
     char *ip;                   //IP addr with default value
@@ -117,6 +215,8 @@ typedef struct {
 
     char *indexes[MAXINDEXCOUNT];//List of pointers to index files
     int indexes_l;              //Count of the list
+    char *cachedir;             //Directory for the cached files, NULL if not used
+    vhost_t default_vhost;      //Used for the requests without a matching virtual host
 #ifdef HAVE_LIBSSL
     SSL_CTX *sslctx;            //SSL context
 #endif
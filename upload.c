@@ -0,0 +1,242 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include "options.h"
+
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "upload.h"
+
+/**
+ * Resumable uploads.
+ *
+ * The parts of the file are written in the staging file, the destination
+ * followed by PUT_PARTIAL_SUFFIX. The ranges received so far are in a
+ * file with the same name followed by UPLOAD_EXTENTS_SUFFIX: the total
+ * size on the first line, then one from-to range per line, sorted and
+ * merged. It is locked while it is read and updated, so parts can
+ * arrive at the same time.
+ * */
+
+typedef struct {
+    unsigned long long int from;
+    unsigned long long int to;  //Last byte, included
+} upload_extent_t;
+
+typedef struct {
+    unsigned long long int total;
+    upload_extent_t extents[UPLOAD_MAXEXTENTS + 1]; //One more, for the one being added
+    int count;
+} upload_state_t;
+
+/**
+ * Reads the state from the extents file fd.
+ * An empty file is a new upload.
+ * Returns false if the file is not valid.
+ * */
+static bool upload_read(int fd, upload_state_t *state) {
+    char buf[UPLOAD_MAXEXTENTS * 42 + 24];
+    ssize_t r = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (r < 0)
+        return false;
+    buf[r] = 0;
+
+    state->count = 0;
+    state->total = 0;
+    if (r == 0)
+        return true;
+
+    char *lasts;
+    char *line = strtok_r(buf, "\n", &lasts);
+    if (line == NULL || sscanf(line, "%llu", &state->total) != 1)
+        return false;
+
+    while ((line = strtok_r(NULL, "\n", &lasts)) != NULL && state->count < UPLOAD_MAXEXTENTS) {
+        upload_extent_t *e = &state->extents[state->count];
+        if (sscanf(line, "%llu-%llu", &e->from, &e->to) != 2)
+            return false;
+        state->count++;
+    }
+    return true;
+}
+
+static bool upload_write(int fd, upload_state_t *state) {
+    char buf[UPLOAD_MAXEXTENTS * 42 + 24];
+    int len = snprintf(buf, sizeof(buf), "%llu\n", state->total);
+    for (int i = 0; i < state->count; i++)
+        len += snprintf(buf + len, sizeof(buf) - len, "%llu-%llu\n", state->extents[i].from, state->extents[i].to);
+    return pwrite(fd, buf, len, 0) == len && ftruncate(fd, len) == 0;
+}
+
+/**
+ * Adds an extent, keeping them sorted and merged.
+ * Returns false if there would be too many extents.
+ * */
+static bool upload_add(upload_state_t *state, unsigned long long int from, unsigned long long int to) {
+    int i = 0;
+    while (i < state->count && state->extents[i].from < from)
+        i++;
+    memmove(&state->extents[i + 1], &state->extents[i], (state->count - i) * sizeof(upload_extent_t));
+    state->extents[i].from = from;
+    state->extents[i].to = to;
+    state->count++;
+
+    //Merges the overlapping and adjacent extents
+    int n = 0;
+    for (i = 1; i < state->count; i++) {
+        upload_extent_t *last = &state->extents[n];
+        if (state->extents[i].from <= last->to + 1) {
+            if (state->extents[i].to > last->to)
+                last->to = state->extents[i].to;
+        } else {
+            state->extents[++n] = state->extents[i];
+        }
+    }
+    state->count = n + 1;
+    return state->count <= UPLOAD_MAXEXTENTS;
+}
+
+/**
+ * Writes in range the extents, in the format of a Range header,
+ * like bytes=0-99,200-299. Writes an empty string if there are none.
+ * */
+static void upload_format(upload_state_t *state, char *range, size_t size) {
+    int len = 0;
+    range[0] = 0;
+    for (int i = 0; i < state->count && (size_t) len < size; i++)
+        len += snprintf(range + len, size - len, "%s%llu-%llu", i ? "," : "bytes=", state->extents[i].from, state->extents[i].to);
+}
+
+/**
+ * Opens and locks the extents file of stage, writing its name in extents.
+ * Returns -1 if it doesn't exist, or if the upload was completed while
+ * waiting for the lock.
+ * */
+static int upload_lock(const char *stage, char *extents, size_t size, int flags) {
+    struct stat st;
+
+    snprintf(extents, size, "%s" UPLOAD_EXTENTS_SUFFIX, stage);
+    int fd = open(extents, O_RDWR | O_CLOEXEC | flags, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        return -1;
+    if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1 || st.st_nlink == 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Records that the bytes from-to, of an upload of total bytes, have been
+ * written to the staging file stage. When the whole file has arrived, it
+ * replaces dest.
+ * Writes in range the extents received so far, in the format of a Range
+ * header, range must be at least UPLOADRANGELEN bytes.
+ *
+ * Returns UPLOAD_COMPLETE, UPLOAD_PARTIAL, UPLOAD_CONFLICT if the total
+ * is not the one of the previous parts or there are too many extents, or
+ * UPLOAD_ERROR.
+ * */
+int upload_record(const char *stage, const char *dest, unsigned long long int from, unsigned long long int to, unsigned long long int total, char *range, size_t size) {
+    char extents[PATH_LEN];
+    upload_state_t state;
+    int result = UPLOAD_ERROR;
+
+    int fd = upload_lock(stage, extents, sizeof(extents), O_CREAT);
+    if (fd == -1)
+        return UPLOAD_ERROR;
+
+    if (!upload_read(fd, &state))
+        goto end;
+    if (state.count == 0)
+        state.total = total;
+    if (state.total != total || !upload_add(&state, from, to)) {
+        result = UPLOAD_CONFLICT;
+        goto end;
+    }
+
+    upload_format(&state, range, size);
+    if (state.count == 1 && state.extents[0].from == 0 && state.extents[0].to == total - 1) {
+        //Complete, published while still holding the lock
+        if (rename(stage, dest) == 0 && unlink(extents) == 0)
+            result = UPLOAD_COMPLETE;
+    } else if (upload_write(fd, &state)) {
+        result = UPLOAD_PARTIAL;
+    }
+
+end:
+    close(fd);
+    return result;
+}
+
+/**
+ * Writes in range the extents of the upload staged in stage received so
+ * far, like upload_record does. If the upload has not started, the string
+ * is empty.
+ * Returns UPLOAD_PARTIAL, UPLOAD_CONFLICT if the total is not the one of
+ * the previous parts, or UPLOAD_ERROR.
+ * */
+int upload_status(const char *stage, unsigned long long int total, char *range, size_t size) {
+    char extents[PATH_LEN];
+    upload_state_t state;
+    int result = UPLOAD_ERROR;
+
+    range[0] = 0;
+    int fd = upload_lock(stage, extents, sizeof(extents), 0);
+    if (fd == -1)
+        return UPLOAD_PARTIAL;
+
+    if (upload_read(fd, &state)) {
+        if (state.count != 0 && state.total != total) {
+            result = UPLOAD_CONFLICT;
+        } else {
+            upload_format(&state, range, size);
+            result = UPLOAD_PARTIAL;
+        }
+    }
+    close(fd);
+    return result;
+}
+
+/**
+ * Returns how many bytes from the beginning of the file have been
+ * received for the upload staged in stage, so a client can resume from
+ * there, or -1 if stage is not a staging file.
+ * */
+long long int upload_received(const char *stage) {
+    char extents[PATH_LEN];
+    upload_state_t state;
+
+    int fd = upload_lock(stage, extents, sizeof(extents), 0);
+    if (fd == -1)
+        return -1;
+
+    long long int received = -1;
+    if (upload_read(fd, &state))
+        received = state.count && state.extents[0].from == 0 ? (long long int) state.extents[0].to + 1 : 0;
+    close(fd);
+    return received;
+}
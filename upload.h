@@ -0,0 +1,36 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_UPLOAD_H
+#define WEBORF_UPLOAD_H
+
+#include "options.h"
+#include "types.h"
+
+#define UPLOAD_COMPLETE 1
+#define UPLOAD_PARTIAL 0
+#define UPLOAD_CONFLICT -1
+#define UPLOAD_ERROR -2
+
+int upload_record(const char *stage, const char *dest, unsigned long long int from, unsigned long long int to, unsigned long long int total, char *range, size_t size);
+int upload_status(const char *stage, unsigned long long int total, char *range, size_t size);
+long long int upload_received(const char *stage);
+
+#endif
@@ -0,0 +1,259 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include "options.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "uring.h"
+#include "instance.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#define URING_ENTRIES 4         //Operations submitted together for a file
+
+/**
+ * Ring of a thread, with its registered buffer.
+ * */
+struct uring_t {
+    int fd;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    char *buffer;               //Registered buffer, index 0
+    size_t size;
+};
+
+/**
+ * Returns true if the kernel knows all the operations used here.
+ * */
+static bool uring_probe(int fd) {
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    if (probe == NULL)
+        return false;
+
+    bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    int ops[] = {IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_CLOSE};
+    for (size_t i = 0; supported && i < sizeof(ops) / sizeof(int); i++)
+        supported = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+void uring_free(uring_t *ring) {
+    if (ring == NULL)
+        return;
+    if (ring->buffer != NULL)
+        munmap(ring->buffer, ring->size);
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring != NULL)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    free(ring);
+}
+
+/**
+ * Creates a ring with a registered buffer of size bytes.
+ * Returns NULL if io_uring is not available, in that case the normal
+ * system calls must be used.
+ * */
+uring_t *uring_init(size_t size) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (fd == -1)
+        return NULL;
+
+    uring_t *ring = calloc(1, sizeof(uring_t));
+    if (ring == NULL) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+
+    //Reads at the current position are needed for the ranges
+    if (!(params.features & IORING_FEAT_RW_CUR_POS) || !uring_probe(fd))
+        goto fail;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    ring->buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    //NULL is what uring_free() expects for the missing ones
+    if (ring->sq_ring == MAP_FAILED) ring->sq_ring = NULL;
+    if (ring->cq_ring == MAP_FAILED) ring->cq_ring = NULL;
+    if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+    if (ring->buffer == MAP_FAILED) ring->buffer = NULL;
+    if (!ring->sq_ring || !ring->cq_ring || !ring->sqes || !ring->buffer)
+        goto fail;
+    ring->size = size;
+
+    ring->sq_tail = ring->sq_ring + params.sq_off.tail;
+    ring->sq_mask = ring->sq_ring + params.sq_off.ring_mask;
+    ring->sq_array = ring->sq_ring + params.sq_off.array;
+    ring->cq_head = ring->cq_ring + params.cq_off.head;
+    ring->cq_tail = ring->cq_ring + params.cq_off.tail;
+    ring->cq_mask = ring->cq_ring + params.cq_off.ring_mask;
+    ring->cqes = ring->cq_ring + params.cq_off.cqes;
+
+    //The buffer is pinned once, instead of at every operation
+    struct iovec iov = { .iov_base = ring->buffer, .iov_len = size };
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, &iov, 1) != 0)
+        goto fail;
+
+    return ring;
+
+fail:
+    uring_free(ring);
+    return NULL;
+}
+
+/**
+ * Returns the registered buffer, and its size in size.
+ * */
+char *uring_buffer(uring_t *ring, size_t *size) {
+    *size = ring->size;
+    return ring->buffer;
+}
+
+static void uring_prep(uring_t *ring, unsigned int tail, int op, int fd, char *buf, size_t len, int flags) {
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->flags = flags;
+    if (op != IORING_OP_CLOSE)
+        sqe->off = (__u64) -1; //Current position of the file
+    sqe->addr = (unsigned long) buf;
+    sqe->len = len;
+    sqe->buf_index = 0;
+    sqe->user_data = op;
+    ring->sq_array[index] = index;
+}
+
+/**
+ * Sends to the socket the head_len bytes already in the registered
+ * buffer, followed by count bytes read from the current position of
+ * file, and then closes file.
+ * The read, the write and the close are submitted with one system call,
+ * linked so that each one runs only if the previous one succeeded.
+ *
+ * Returns 0 if everything was sent, ERR_BRKPIPE if nothing was written
+ * to the socket and ERR_SOCKWRITE if the write failed or was interrupted.
+ * *closed is set to true if file was closed.
+ * */
+int uring_send_file(uring_t *ring, int file, int sock, size_t head_len, size_t count, bool *closed) {
+    unsigned int tail = *ring->sq_tail;
+    int wrote = -ECANCELED;
+
+    *closed = false;
+    uring_prep(ring, tail++, IORING_OP_READ_FIXED, file, ring->buffer + head_len, count, IOSQE_IO_LINK);
+    uring_prep(ring, tail++, IORING_OP_WRITE_FIXED, sock, ring->buffer, head_len + count, IOSQE_IO_LINK);
+    uring_prep(ring, tail++, IORING_OP_CLOSE, file, NULL, 0, 0);
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int submit = 3;
+    int pending = 3;
+    while (pending > 0) {
+        int r = syscall(__NR_io_uring_enter, ring->fd, submit, pending, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r == -1 && errno != EINTR) {
+            syslog(LOG_ERR, "io_uring_enter failed: %d", errno);
+            return submit == 3 ? ERR_BRKPIPE : ERR_SOCKWRITE;
+        } else if (r > 0) {
+            submit -= r;
+        }
+
+        unsigned int head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            if (cqe->user_data == IORING_OP_WRITE_FIXED)
+                wrote = cqe->res;
+            else if (cqe->user_data == IORING_OP_CLOSE)
+                *closed = cqe->res == 0;
+            head++;
+            pending--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    //A short read cancels the rest, a short write is completed here
+    if (wrote == -ECANCELED)
+        return ERR_BRKPIPE;
+    else if (wrote < 0)
+        return ERR_SOCKWRITE;
+    size_t total = head_len + count;
+    while ((size_t) wrote < total) {
+        int r = write(sock, ring->buffer + wrote, total - wrote);
+        if (r <= 0)
+            return ERR_SOCKWRITE;
+        wrote += r;
+    }
+    return 0;
+}
+
+#else
+
+uring_t *uring_init(size_t size) {
+    return NULL;
+}
+
+void uring_free(uring_t *ring) {
+}
+
+char *uring_buffer(uring_t *ring, size_t *size) {
+    return NULL;
+}
+
+int uring_send_file(uring_t *ring, int file, int sock, size_t head_len, size_t count, bool *closed) {
+    return ERR_BRKPIPE;
+}
+
+#endif
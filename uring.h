@@ -0,0 +1,34 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_URING_H
+#define WEBORF_URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct uring_t uring_t;
+
+uring_t *uring_init(size_t size);
+void uring_free(uring_t *ring);
+char *uring_buffer(uring_t *ring, size_t *size);
+int uring_send_file(uring_t *ring, int file, int sock, size_t head_len, size_t count, bool *closed);
+
+#endif
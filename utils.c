@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 @author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
 
  */
+#define _GNU_SOURCE //For strptime() and timegm()
 #include "options.h"
 
 #include <sys/types.h>
@@ -187,12 +188,15 @@ int list_dir(connection_t *connection_prop, char *html, unsigned int bufsize, bo
     char last_modified[URI_LEN];
 
     //Print link to parent directory, if there is any
-    if (parent) {
+    if (parent && maxsize > 0) {
         printf_s=snprintf(html+pagesize,maxsize,"<d><c><a href=\"../\">上一级目录</a></c><c>-</c><c>-</c></d>");
         maxsize-=printf_s;
         pagesize+=printf_s;
     }
 
+    if (maxsize <= 0)
+        errcode = -2; // Out of memory
+
     for (i=0; i<counter; i++) {
         //Skipping hidden files
         if (namelist[i]->d_name[0] == '.' || errcode) {
@@ -257,6 +261,8 @@ escape:
     free(namelist);
     if (errcode == 0) {
         printf_s=snprintf(html+pagesize,maxsize, "%s", HTMLFOOT);
+        if (printf_s >= maxsize)
+            return -2; // Out of memory
         pagesize+=printf_s;
         return pagesize;
     } else
@@ -288,15 +294,30 @@ void help() {
            "\t(*) Has webdav support\n"
 #endif
 
+#ifdef EMBEDDED_AUTH
+           "\t(*) Has embedded authentication\n"
+#endif
+
            " # Default port is        %s\n"
            " # Default base directory %s\n"
            " # Signature used         %s\n\n", PORT,BASEDIR,SIGNATURE);
 
     printf("  -a, --auth    followed by absolute path of the program to handle authentication\n"
+           "      --auth-keepalive reuse the connections to the authentication program\n"
+           "      --auth-cache ttl[,denied_ttl] seconds to remember authentication decisions\n"
+           "                   keyed only on Authorization, Host, address, method and path\n"
+           "      --auth-cache-prefix list of paths, comma-separated, sharing the same decision\n"
+           "      --htpasswd    file with the credentials, in htpasswd format\n"
+           "      --auth-rules  file with the rules deciding which requests need credentials\n"
            "  -b, --basedir followed by absolute path of basedir\n"
            "  -C, --cache   sets the directory to use for cache files\n"
            "  -c, --cgi     list of cgi files and binary to execute them comma-separated\n"
+           "                binary can be scgi:/path or uwsgi:/path to use a unix socket\n"
+           "      --cgi-limit running[,waiting[,timeout]] scripts running and waiting\n"
+           "                for each interpreter, and maximum wait in milliseconds\n"
            "  -h, --help    display this help and exit\n"
+           "      --mime-types file in the format of /etc/mime.types, reloaded when it changes\n"
+           "      --cache-control file with the rules for the Cache-Control header\n"
            "  -I, --index   list of index files, comma-separated\n"
            "  -i, --ip  followed by IP address to listen (dotted format)\n"
            "  -k, --caps    lists the capabilities of the binary\n"
@@ -304,6 +325,13 @@ void help() {
            "  -T  --inetd   must be specified when using weblist with inetd or xinetd\n"
            "  -t  --tar     will send the directories as .tar.gz files\n"
            "  -V, --virtual list of virtualhosts in the form host=basedir, comma-separated\n"
+           "      --vhost-config file with the settings of each virtualhost\n"
+           "      --config  file with the tunables, reloaded on SIGHUP\n"
+           "      --processes number of processes sharing the socket, each with its threads\n"
+           "      --cpus    list of CPUs, like 0-3,8, or all, to pin the threads to\n"
+           "      --backlog length of the queue of the connections not accepted yet\n"
+           "      --defer-accept seconds to wait for the request before accepting\n"
+           "      --coroutines connections served at the same time by each thread\n"
            "  -v, --version print program version\n"
 #ifdef HAVE_LIBSSL
            "  -S, --cert    the certificate to use\n"
@@ -360,4 +388,38 @@ bool get_param_value(char *http_param, char *parameter, char *buf, ssize_t size,
     return true;
 }
 
+/**
+Writes in buf the strong ETag of the file described by st, quotes
+included. It is derived from the inode, the size and the modification
+time in nanoseconds, so it changes whenever the content might have.
+buf must be at least ETAGLEN bytes.
+*/
+void format_etag(const struct stat *st, char *buf, size_t size) {
+    unsigned long long int mtime = (unsigned long long int) st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+    snprintf(buf, size, "\"%llx-%llx-%llx\"", (unsigned long long int) st->st_ino, (unsigned long long int) st->st_size, mtime);
+}
+
+/**
+Writes in buf the HTTP-date of timestamp, like "Sun, 06 Nov 1994 08:49:37 GMT".
+buf must be at least HTTPDATELEN bytes.
+*/
+void format_http_date(time_t timestamp, char *buf, size_t size) {
+    struct tm ts;
+    gmtime_r(&timestamp, &ts);
+    strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &ts);
+}
+
+/**
+Parses an HTTP-date in the preferred format, as sent in If-Modified-Since
+and similar headers.
+Returns -1 if the date is not valid.
+*/
+time_t parse_http_date(const char *date) {
+    struct tm ts;
+    memset(&ts, 0, sizeof(ts));
 
+    char *end = strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &ts);
+    if (end == NULL || *end != 0)
+        return -1;
+    return timegm(&ts);
+}
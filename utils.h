@@ -30,5 +30,8 @@ void version();
 void moo();
 bool get_param_value(char *http_param, char *parameter, char *buf, ssize_t size,ssize_t param_len);
 void daemonize();
+void format_etag(const struct stat *st, char *buf, size_t size);
+void format_http_date(time_t timestamp, char *buf, size_t size);
+time_t parse_http_date(const char *date);
 
 #endif
@@ -0,0 +1,219 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#include "options.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "vhost.h"
+#include "mystring.h"
+
+#define HOST_LEN 256            //Longer host names are never found
+
+/**
+ * Open addressing hash table of the virtual hosts.
+ * It is never modified once published: a new configuration builds a new
+ * table, and the old one is freed when the last request using it is done.
+ * */
+struct vhost_table_t {
+    unsigned int refs;          //Requests using the table, plus one while it is published
+    size_t size;                //Slots, power of 2
+    vhost_t **slots;            //NULL for empty slots
+    vhost_t *vhosts;            //Records, owned by the table
+    size_t count;
+    bool wildcards;             //True if some host starts with *.
+};
+
+static pthread_mutex_t vhost_mutex = PTHREAD_MUTEX_INITIALIZER;
+static vhost_table_t *vhost_current = NULL;
+
+/**
+ * Copies the host name in out, in lower case and without the port.
+ * Returns the length, or 0 if it is empty or doesn't fit.
+ * */
+static size_t vhost_normalize(const char *host, size_t len, char *out, size_t size) {
+    size_t end = len;
+
+    if (len > 0 && host[0] == '[') { //IPv6 address, the port is after ]
+        const char *bracket = memchr(host, ']', len);
+        if (bracket)
+            end = bracket - host + 1;
+    } else {
+        const char *colon = memchr(host, ':', len);
+        if (colon)
+            end = colon - host;
+    }
+
+    //A trailing dot refers to the same host
+    if (end > 0 && host[end - 1] == '.')
+        end--;
+
+    if (end == 0 || end >= size)
+        return 0;
+
+    for (size_t i = 0; i < end; i++) {
+        char c = host[i];
+        out[i] = (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+    }
+    out[end] = 0;
+    return end;
+}
+
+static vhost_t *vhost_get(vhost_table_t *table, const char *host, size_t len) {
+    size_t mask = table->size - 1;
+    size_t i = string_hash(host, len) & mask;
+
+    while (table->slots[i] != NULL) {
+        if (strncmp(table->slots[i]->host, host, len) == 0 && table->slots[i]->host[len] == 0)
+            return table->slots[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void vhost_free(vhost_table_t *table) {
+    free(table->slots);
+    free(table->vhosts);
+    free(table);
+}
+
+/**
+ * Builds a table from count records. The table takes ownership of the
+ * array, not of the strings, and the host names are normalized in place.
+ * When the same host appears more than once, the first one is used.
+ * Returns NULL if there is not enough memory.
+ * */
+vhost_table_t *vhost_build(vhost_t *vhosts, size_t count) {
+    vhost_table_t *table = calloc(1, sizeof(vhost_table_t));
+    if (table == NULL)
+        return NULL;
+
+    table->refs = 1;
+    table->vhosts = vhosts;
+    table->count = count;
+    table->size = 8;
+    while (table->size < count * 2)
+        table->size *= 2;
+    table->slots = calloc(table->size, sizeof(vhost_t *));
+    if (table->slots == NULL) {
+        free(table);
+        return NULL;
+    }
+
+    for (size_t v = 0; v < count; v++) {
+        char *host = vhosts[v].host;
+        size_t len = vhost_normalize(host, strlen(host), host, strlen(host) + 1);
+        if (len == 0)
+            continue;
+
+        if (vhost_get(table, host, len) != NULL) {
+            fprintf(stderr, "Virtual host %s is repeated, using the first one\n", host);
+            continue;
+        }
+
+        if (host[0] == '*')
+            table->wildcards = true;
+
+        size_t i = string_hash(host, len) & (table->size - 1);
+        while (table->slots[i] != NULL)
+            i = (i + 1) & (table->size - 1);
+        table->slots[i] = &vhosts[v];
+    }
+    return table;
+}
+
+/**
+ * Makes table the one used by the new requests.
+ * */
+void vhost_publish(vhost_table_t *table) {
+    pthread_mutex_lock(&vhost_mutex);
+    vhost_table_t *old = vhost_current;
+    vhost_current = table;
+    pthread_mutex_unlock(&vhost_mutex);
+
+    if (old)
+        vhost_release(old);
+}
+
+/**
+ * Returns the current table, that remains valid until it is passed
+ * to vhost_release(). Returns NULL if there are no virtual hosts.
+ * */
+vhost_table_t *vhost_acquire() {
+    pthread_mutex_lock(&vhost_mutex);
+    vhost_table_t *table = vhost_current;
+    if (table)
+        table->refs++;
+    pthread_mutex_unlock(&vhost_mutex);
+    return table;
+}
+
+void vhost_release(vhost_table_t *table) {
+    pthread_mutex_lock(&vhost_mutex);
+    unsigned int refs = --table->refs;
+    pthread_mutex_unlock(&vhost_mutex);
+
+    if (refs == 0)
+        vhost_free(table);
+}
+
+/**
+ * Finds the virtual host for the value of a Host header, of length len.
+ * The case and the port are ignored. If the exact name is not present,
+ * *.domain matches for every subdomain, the longest domain first.
+ * Returns NULL if there is no matching virtual host.
+ * */
+vhost_t *vhost_find(vhost_table_t *table, const char *host, size_t len) {
+    char name[HOST_LEN + 1];
+
+    //name[0] is left free to put the * of the wildcards
+    len = vhost_normalize(host, len, name + 1, HOST_LEN);
+    if (len == 0)
+        return NULL;
+
+    vhost_t *vhost = vhost_get(table, name + 1, len);
+    if (vhost || !table->wildcards)
+        return vhost;
+
+    for (size_t i = 1; i < len; i++) {
+        if (name[i + 1] != '.')
+            continue;
+
+        //Temporarily turns "sub.example.com" into "*.example.com"
+        char prev = name[i];
+        name[i] = '*';
+        vhost = vhost_get(table, name + i, len - i + 1);
+        name[i] = prev;
+        if (vhost)
+            return vhost;
+    }
+    return NULL;
+}
+
+/**
+ * Returns the i-th host of the table, in the order they were given
+ * to vhost_build(), or NULL after the last one.
+ * */
+vhost_t *vhost_at(vhost_table_t *table, size_t i) {
+    return i < table->count ? &table->vhosts[i] : NULL;
+}
@@ -0,0 +1,34 @@
+/*
+Weborf
+Copyright (C) 2026  Salvo "LtWorf" Tomaselli
+
+Weborf is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+@author Salvo "LtWorf" Tomaselli <tiposchi@tiscali.it>
+*/
+
+#ifndef WEBORF_VHOST_H
+#define WEBORF_VHOST_H
+
+#include "options.h"
+#include "types.h"
+
+vhost_table_t *vhost_build(vhost_t *vhosts, size_t count);
+void vhost_publish(vhost_table_t *table);
+vhost_table_t *vhost_acquire();
+void vhost_release(vhost_table_t *table);
+vhost_t *vhost_find(vhost_table_t *table, const char *host, size_t len);
+vhost_t *vhost_at(vhost_table_t *table, size_t i);
+
+#endif
@@ -43,6 +43,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "mystring.h"
 #include "utils.h"
 #include "cachedir.h"
+#include "upload.h"
 
 typedef struct {
     bool getetag :1;
@@ -84,7 +85,7 @@ static inline void escape_uri(char *source, char *dest, int dest_size) {
             dest_size--;
         } else {
             //Prints % followed by 2 digits hex code of the character
-            sprintf(dest,"%%%02x",source[i]);
+            sprintf(dest,"%%%02x",(unsigned char)source[i]);
             dest+=3;
             dest_size-=3;
         }
@@ -241,13 +242,24 @@ static inline int printprops(fd_t sock, char *page, u_dav_details props,char* fi
     pagesize += printf_s;
 
     if (props.dav_details.getetag) {
-        printf_s = snprintf(xml + pagesize, maxsize, "<D:getetag>%lld</D:getetag>\n", (long long int)stat_s.st_mtime);
+        char etag[ETAGLEN];
+        format_etag(&stat_s, etag, sizeof(etag));
+        printf_s = snprintf(xml + pagesize, maxsize, "<D:getetag>%s</D:getetag>\n", etag);
         maxsize -= printf_s;
         pagesize += printf_s;
     }
 
     if (props.dav_details.getcontentlength) {
-        printf_s = snprintf(xml + pagesize, maxsize, "<D:getcontentlength>%lld</D:getcontentlength>\n", (long long int)stat_s.st_size);
+        long long int length = stat_s.st_size;
+
+        //For the staging file of an upload, the bytes from where it can be resumed
+        size_t file_l = strlen(file);
+        if (endsWith(file, PUT_PARTIAL_SUFFIX, file_l, strlen(PUT_PARTIAL_SUFFIX))) {
+            long long int received = upload_received(file);
+            if (received != -1)
+                length = received;
+        }
+        printf_s = snprintf(xml + pagesize, maxsize, "<D:getcontentlength>%lld</D:getcontentlength>\n", length);
         maxsize -= printf_s;
         pagesize += printf_s;
     }
@@ -304,7 +316,7 @@ authentication is enabled.
 */
 int propfind(connection_t* connection_prop, string_t *post_param) {
     //Forbids the method if no authentication is in use
-    if (weborf_conf.authsock == NULL) {
+    if (!connection_prop->vhost->auth) {
         return ERR_NOT_ALLOWED;
     }
 
@@ -319,7 +331,7 @@ int propfind(connection_t* connection_prop, string_t *post_param) {
         if (S_ISDIR(connection_prop->strfile_stat.st_mode) && !endsWith(connection_prop->strfile,"/",connection_prop->strfile_len,1)) {//Putting the ending / and redirect
             char head[URI_LEN+12];//12 is the size for the location header
             snprintf(head,URI_LEN+12,"Location: %s/\r\n",connection_prop->page);
-            send_http_header(301, NULL, head, true, -1, connection_prop);
+            send_http_header(301, NULL, head, true, NULL, connection_prop);
             return 0;
         }
     } // End redirection
@@ -328,7 +340,7 @@ int propfind(connection_t* connection_prop, string_t *post_param) {
     u_dav_details props = {0};
     props.dav_details.type = 1; //I need to avoid the struct to be fully 0 in each case
     fd_t dest_fd = connection_prop->sock;
-    const bool has_cache = cache_is_enabled();
+    const bool has_cache = cache_is_enabled(connection_prop);
 
     int retval=get_props(connection_prop,post_param,&props);//splitting props
     if (retval!=0) {
@@ -337,7 +349,7 @@ int propfind(connection_t* connection_prop, string_t *post_param) {
 
     //Sets keep alive to false (have no clue about how big is the generated xml) and sends a multistatus header code
     connection_prop->keep_alive=false;
-    send_http_header(207, NULL, "Content-Type: text/xml; charset=\"utf-8\"\r\n", false, -1, connection_prop);
+    send_http_header(207, NULL, "Content-Type: text/xml; charset=\"utf-8\"\r\n", false, NULL, connection_prop);
 
     //Check if exists in cache
     if (has_cache) {
@@ -416,11 +428,77 @@ int propfind(connection_t* connection_prop, string_t *post_param) {
     return 0;
 }
 
+/**
+Returns the reason phrase of the status codes of the members of a
+collection that failed.
+*/
+static inline const char *multistatus_reason(int status) {
+    switch (status) {
+    case 403:
+        return "Forbidden";
+    case 404:
+        return "Not Found";
+    case 409:
+        return "Conflict";
+    case 503:
+        return "Service Unavailable";
+    case 507:
+        return "Insufficient Storage";
+    }
+    return "Internal Server Error";
+}
+
+/**
+Sends a multistatus response with the members of a collection that
+could not be deleted, copied or moved. Their paths are relative to base,
+the path of the collection.
+*/
+int send_multistatus(connection_t* connection_prop, char *base, tree_failures_t *failures) {
+    const size_t href_size = PATH_LEN * 3;
+    const size_t item_len = href_size + 128; //The href and the rest of the response element
+    const size_t xml_size = failures->stored * item_len + 128;
+    char *href = malloc(href_size);
+    char *xml = malloc(xml_size);
+    if (href == NULL || xml == NULL) {
+        free(href);
+        free(xml);
+        return ERR_NOMEM;
+    }
+    size_t base_len;
+    unsigned long long int len = 0;
+
+    //Leaves space for the /
+    href[0] = 0;
+    escape_uri(base, href, href_size - 1);
+    base_len = strlen(href);
+    //The paths are appended after a /
+    if (base_len == 0 || href[base_len - 1] != '/')
+        href[base_len++] = '/';
+
+    len += snprintf(xml, xml_size, "<?xml version=\"1.0\" encoding=\"utf-8\" ?><D:multistatus xmlns:D=\"DAV:\">");
+    for (size_t i = 0; i < failures->stored; i++) {
+        href[base_len] = 0;
+        //A path that doesn't fit is cut, like the base
+        if (base_len < href_size)
+            escape_uri(failures->items[i].path, href + base_len, href_size - base_len);
+        len += snprintf(xml + len, xml_size - len,
+                        "<D:response><D:href>%s</D:href><D:status>HTTP/1.1 %d %s</D:status></D:response>",
+                        href, failures->items[i].status, multistatus_reason(failures->items[i].status));
+    }
+    len += snprintf(xml + len, xml_size - len, "</D:multistatus>");
+
+    send_http_header(207, &len, "Content-Type: text/xml; charset=\"utf-8\"\r\n", true, NULL, connection_prop);
+    myio_write(connection_prop->sock, xml, len);
+    free(href);
+    free(xml);
+    return 0;
+}
+
 /**
 This funcion should be named mkdir. But standards writers are weird people.
 */
 int mkcol(connection_t* connection_prop) {
-    if (weborf_conf.authsock==NULL) {
+    if (!connection_prop->vhost->auth) {
         return ERR_NOT_ALLOWED;
     }
 
@@ -502,6 +580,10 @@ int copy_move(connection_t* connection_prop) {
         dest += strlen(host);
     }
 
+    //Decoded like the requested page, so the hrefs of a multistatus are escaped only once
+    replaceEscape(dest);
+    strReplace(dest,"../",'\0');
+
     //Local path for destination file
     snprintf(destination,PATH_LEN,"%s%s",connection_prop->basedir,dest);
 
@@ -519,11 +601,20 @@ int copy_move(connection_t* connection_prop) {
 
     stat(connection_prop->strfile, &f_prop);
     if (S_ISDIR(f_prop.st_mode)) { //Directory
+        tree_failures_t failures;
         if (connection_prop->method_id==COPY) {
-            retval=dir_copy(connection_prop->strfile,destination);
+            retval=dir_copy(connection_prop->strfile,destination,&failures);
         } else {//Move
-            retval=dir_move(connection_prop->strfile,destination);
+            retval=dir_move(connection_prop->strfile,destination,&failures);
+        }
+
+        //Some members failed, the errors are reported for the destination
+        if (retval==0 && failures.count) {
+            retval=send_multistatus(connection_prop,dest,&failures);
+            tree_failures_free(&failures);
+            goto escape;
         }
+        tree_failures_free(&failures);
     } else { //Normal file
         if (connection_prop->method_id==COPY) {
             retval=file_copy(connection_prop->strfile,destination);
@@ -22,8 +22,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define WEBORF_WEBDAV_H
 
 #include "types.h"
+#include "treewalk.h"
 
 int propfind(connection_t* connection_prop,string_t *post_param);
 int mkcol(connection_t* connection_prop);
 int copy_move(connection_t* connection_prop);
+int send_multistatus(connection_t* connection_prop, char *base, tree_failures_t *failures);
 #endif